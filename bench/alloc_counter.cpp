@@ -0,0 +1,34 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Kept in a translation unit of its own: code that inlined this operator
+// new next to a delete-expression would see malloc paired with delete.
+static thread_local bool tCounting = false;
+static thread_local uint64_t tAllocs = 0;
+
+void alloc_counter::start() {
+    tAllocs = 0;
+    tCounting = true;
+}
+
+uint64_t alloc_counter::stop() {
+    tCounting = false;
+    return tAllocs;
+}
+
+void* operator new(size_t n) {
+    if (tCounting) tAllocs++;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t n) {
+    return operator new(n);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+// Counts C++ heap allocations made by one thread, for checking that the
+// allocation-free request paths stay that way. Linking alloc_counter.cpp
+// replaces the global operator new; other threads (the in-process mock's)
+// are not counted, and neither are libcurl's own malloc calls.
+namespace alloc_counter {
+
+// Starts counting on the calling thread.
+void start();
+
+// Stops counting and returns the allocations since start().
+uint64_t stop();
+
+} // namespace alloc_counter
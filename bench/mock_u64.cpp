@@ -0,0 +1,344 @@
+#include "mock_u64.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string lower(std::string s) {
+    for (auto& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return s;
+}
+
+static std::string queryParam(const std::string& query, const std::string& key) {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.size();
+        std::string kv = query.substr(pos, amp - pos);
+        size_t eq = kv.find('=');
+        if (eq != std::string::npos && kv.compare(0, eq, key) == 0) return kv.substr(eq + 1);
+        pos = amp + 1;
+    }
+    return "";
+}
+
+static bool sendAll(int fd, const char* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+MockU64::MockU64() : MockU64(Options()) {}
+
+MockU64::MockU64(Options opts) : opts_(std::move(opts)), memory_(0x10000, 0), rng_(12345) {
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) throw std::runtime_error("MockU64: socket() failed");
+    int one = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(opts_.port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd_, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 || listen(listenFd_, 64) != 0) {
+        close(listenFd_);
+        throw std::runtime_error(std::string("MockU64: cannot listen: ") + std::strerror(errno));
+    }
+    socklen_t len = sizeof(sa);
+    getsockname(listenFd_, reinterpret_cast<sockaddr*>(&sa), &len);
+    port_ = ntohs(sa.sin_port);
+
+    acceptor_ = std::thread([this] { acceptLoop(); });
+}
+
+MockU64::~MockU64() {
+    stop();
+}
+
+void MockU64::stop() {
+    if (stopping_.exchange(true)) return;
+    shutdown(listenFd_, SHUT_RDWR);
+    close(listenFd_);
+    if (acceptor_.joinable()) acceptor_.join();
+
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (int fd : clientFds_) shutdown(fd, SHUT_RDWR);
+        workers.swap(workers_);
+        serviceCv_.notify_all();
+    }
+    for (auto& t : workers) t.join();
+}
+
+void MockU64::setLatency(double latencyMs, double jitterMs) {
+    std::lock_guard<std::mutex> lk(mu_);
+    opts_.latencyMs = latencyMs;
+    opts_.jitterMs = jitterMs;
+}
+
+void MockU64::setErrorRates(double errorRate, double dropRate) {
+    std::lock_guard<std::mutex> lk(mu_);
+    opts_.errorRate = errorRate;
+    opts_.dropRate = dropRate;
+}
+
+std::vector<uint8_t> MockU64::readMemory(uint16_t address, size_t length) {
+    std::lock_guard<std::mutex> lk(mu_);
+    length = std::min<size_t>(length, 0x10000 - address);
+    return std::vector<uint8_t>(memory_.begin() + address, memory_.begin() + address + length);
+}
+
+void MockU64::writeMemory(uint16_t address, const std::vector<uint8_t>& data) {
+    std::lock_guard<std::mutex> lk(mu_);
+    size_t n = std::min<size_t>(data.size(), 0x10000 - address);
+    std::copy(data.begin(), data.begin() + n, memory_.begin() + address);
+}
+
+std::vector<uint8_t> MockU64::lastPrg() {
+    std::lock_guard<std::mutex> lk(mu_);
+    return lastPrg_;
+}
+
+MockU64::Counters MockU64::counters() {
+    std::lock_guard<std::mutex> lk(mu_);
+    return counters_;
+}
+
+void MockU64::acceptLoop() {
+    while (!stopping_) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lk(mu_);
+        if (stopping_) { close(fd); return; }
+        counters_.connections++;
+        clientFds_.push_back(fd);
+        workers_.emplace_back([this, fd] { serveConnection(fd); });
+    }
+}
+
+void MockU64::injectDelay() {
+    double ms;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        ms = opts_.latencyMs;
+        if (opts_.jitterMs > 0) ms += std::uniform_real_distribution<double>(0, opts_.jitterMs)(rng_);
+        if (opts_.slowRate > 0 && std::uniform_real_distribution<double>(0, 1)(rng_) < opts_.slowRate) ms += opts_.slowMs;
+    }
+    if (ms > 0) std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+// Like the device's server, only `capacity` requests are worked on at once;
+// the others wait for a turn, which shows up as latency.
+void MockU64::enterService() {
+    std::unique_lock<std::mutex> lk(mu_);
+    serviceCv_.wait(lk, [&] { return opts_.capacity <= 0 || inService_ < opts_.capacity || stopping_; });
+    inService_++;
+}
+
+void MockU64::leaveService() {
+    std::lock_guard<std::mutex> lk(mu_);
+    inService_--;
+    serviceCv_.notify_one();
+}
+
+void MockU64::serveConnection(int fd) {
+    std::string buf;
+    char chunk[16384];
+
+    auto fill = [&]() -> bool {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) return true;
+        if (n <= 0) return false;
+        buf.append(chunk, static_cast<size_t>(n));
+        return true;
+    };
+
+    for (;;) {
+        size_t hdrEnd;
+        while ((hdrEnd = buf.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) goto done;
+        }
+
+        {
+            Request req;
+            std::string head = buf.substr(0, hdrEnd);
+            buf.erase(0, hdrEnd + 4);
+
+            size_t lineEnd = head.find("\r\n");
+            std::string line = head.substr(0, lineEnd);
+            size_t sp1 = line.find(' ');
+            size_t sp2 = line.find(' ', sp1 + 1);
+            if (sp1 == std::string::npos || sp2 == std::string::npos) goto done;
+            req.method = line.substr(0, sp1);
+            std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            size_t q = target.find('?');
+            req.path = target.substr(0, q);
+            if (q != std::string::npos) req.query = target.substr(q + 1);
+
+            size_t contentLength = 0;
+            size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+            while (pos < head.size()) {
+                size_t e = head.find("\r\n", pos);
+                if (e == std::string::npos) e = head.size();
+                std::string h = head.substr(pos, e - pos);
+                pos = e + 2;
+                size_t colon = h.find(':');
+                if (colon == std::string::npos) continue;
+                std::string name = lower(h.substr(0, colon));
+                std::string value = h.substr(colon + 1);
+                value.erase(0, value.find_first_not_of(' '));
+                if (name == "content-length") contentLength = std::strtoul(value.c_str(), nullptr, 10);
+                else if (name == "x-password") req.password = value;
+                else if (name == "connection" && lower(value) == "close") req.keepAlive = false;
+            }
+
+            while (buf.size() < contentLength) {
+                if (!fill()) goto done;
+            }
+            req.body.assign(buf.begin(), buf.begin() + contentLength);
+            buf.erase(0, contentLength);
+
+            enterService();
+            injectDelay();
+
+            bool drop = false;
+            Response res;
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                counters_.requests++;
+                counters_.bytesIn += req.body.size();
+                std::uniform_real_distribution<double> u(0, 1);
+                if (opts_.dropRate > 0 && u(rng_) < opts_.dropRate) {
+                    counters_.drops++;
+                    drop = true;
+                } else if (opts_.errorRate > 0 && u(rng_) < opts_.errorRate) {
+                    counters_.errorsInjected++;
+                    res.status = 500;
+                    std::string msg = "{\"errors\":[\"injected error\"]}";
+                    res.body.assign(msg.begin(), msg.end());
+                }
+            }
+            if (!drop && res.status != 500) {
+                try {
+                    res = handle(req);
+                } catch (const std::exception& e) {
+                    std::string msg = std::string("{\"errors\":[\"") + e.what() + "\"]}";
+                    res.status = 400;
+                    res.contentType = "application/json";
+                    res.body.assign(msg.begin(), msg.end());
+                }
+            }
+            leaveService();
+            if (drop) goto done;
+
+            const char* reason = res.status == 200 ? "OK" : res.status == 404 ? "Not Found" :
+                                 res.status == 403 ? "Forbidden" : res.status == 400 ? "Bad Request" :
+                                 "Internal Server Error";
+            std::string out = "HTTP/1.1 " + std::to_string(res.status) + " " + reason + "\r\n" +
+                              "Content-Type: " + res.contentType + "\r\n" +
+                              "Content-Length: " + std::to_string(res.body.size()) + "\r\n" +
+                              (req.keepAlive ? "" : "Connection: close\r\n") + "\r\n";
+            out.append(res.body.begin(), res.body.end());
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                counters_.bytesOut += res.body.size();
+            }
+            if (!sendAll(fd, out.data(), out.size()) || !req.keepAlive) goto done;
+        }
+    }
+
+done:
+    std::lock_guard<std::mutex> lk(mu_);
+    clientFds_.erase(std::remove(clientFds_.begin(), clientFds_.end(), fd), clientFds_.end());
+    close(fd);
+}
+
+MockU64::Response MockU64::handle(const Request& req) {
+    Response res;
+    auto json = [&](int status, const std::string& body) {
+        res.status = status;
+        res.contentType = "application/json";
+        res.body.assign(body.begin(), body.end());
+        return res;
+    };
+
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!opts_.password.empty() && req.password != opts_.password) {
+        return json(403, "{\"errors\":[\"Forbidden\"]}");
+    }
+
+    if (req.method == "GET" && req.path == "/v1/version") {
+        return json(200, "{\"version\":\"" + opts_.version + "\",\"errors\":[]}");
+    }
+
+    if (req.method == "POST" && req.path == "/v1/runners:run_prg") {
+        if (req.body.size() < 2) return json(400, "{\"errors\":[\"PRG too short\"]}");
+        counters_.prgRuns++;
+        lastPrg_ = req.body;
+        // Like the real loader: bytes land at the little-endian load address.
+        size_t load = req.body[0] | (req.body[1] << 8);
+        size_t n = std::min<size_t>(req.body.size() - 2, 0x10000 - load);
+        std::copy(req.body.begin() + 2, req.body.begin() + 2 + n, memory_.begin() + load);
+        return json(200, "{\"errors\":[]}");
+    }
+
+    if (req.method == "POST" && (req.path == "/v1/runners:run_crt" || req.path == "/v1/runners:sidplay")) {
+        if (req.body.empty()) return json(400, "{\"errors\":[\"empty file\"]}");
+        counters_.uploads++;
+        return json(200, "{\"errors\":[]}");
+    }
+
+    if (req.method == "POST" && req.path.rfind("/v1/drives/", 0) == 0 &&
+        req.path.size() > 6 && req.path.compare(req.path.size() - 6, 6, ":mount") == 0) {
+        if (req.body.empty() || queryParam(req.query, "type").empty())
+            return json(400, "{\"errors\":[\"missing image\"]}");
+        counters_.uploads++;
+        return json(200, "{\"errors\":[]}");
+    }
+
+    if (req.path == "/v1/machine:readmem" && req.method == "GET") {
+        std::string a = queryParam(req.query, "address");
+        std::string l = queryParam(req.query, "length");
+        if (a.empty()) return json(400, "{\"errors\":[\"missing address\"]}");
+        size_t address = std::stoul(a, nullptr, 16);
+        size_t length = l.empty() ? 1 : std::stoul(l);
+        if (address > 0xFFFF || address + length > 0x10000) return json(400, "{\"errors\":[\"range\"]}");
+        res.status = 200;
+        res.contentType = "application/octet-stream";
+        res.body.assign(memory_.begin() + address, memory_.begin() + address + length);
+        return res;
+    }
+
+    if (req.path == "/v1/machine:writemem" && req.method == "POST") {
+        std::string a = queryParam(req.query, "address");
+        if (a.empty()) return json(400, "{\"errors\":[\"missing address\"]}");
+        size_t address = std::stoul(a, nullptr, 16);
+        if (address > 0xFFFF || address + req.body.size() > 0x10000) return json(400, "{\"errors\":[\"range\"]}");
+        std::copy(req.body.begin(), req.body.end(), memory_.begin() + address);
+        return json(200, "{\"errors\":[]}");
+    }
+
+    return json(404, "{\"errors\":[\"Not found\"]}");
+}
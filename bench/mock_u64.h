@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// In-process stand-in for the Ultimate's REST server, for benchmarks and
+// offline runs. Serves the endpoints U64Server uses over HTTP/1.1 with
+// keep-alive, backed by a 64 KB memory array.
+class MockU64 {
+public:
+    struct Options {
+        uint16_t port = 0;        // 0 = pick a free port
+        double latencyMs = 0;     // added before every response
+        double jitterMs = 0;      // uniform extra delay in [0, jitterMs)
+        double slowRate = 0;      // fraction stalled by slowMs more, like a lost packet
+        double slowMs = 0;
+        double errorRate = 0;     // fraction answered with HTTP 500
+        double dropRate = 0;      // fraction answered by closing the socket
+        int capacity = 0;         // requests served at once, the rest queue; 0 = no limit
+        std::string password;     // required X-Password if non-empty
+        std::string version = "0.1";
+    };
+
+    struct Counters {
+        uint64_t connections = 0;
+        uint64_t requests = 0;
+        uint64_t errorsInjected = 0;
+        uint64_t drops = 0;
+        uint64_t prgRuns = 0;
+        uint64_t uploads = 0;     // cartridges, SIDs and disk images
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+    };
+
+    MockU64();
+    explicit MockU64(Options opts);
+    ~MockU64();
+
+    MockU64(const MockU64&) = delete;
+    MockU64& operator=(const MockU64&) = delete;
+
+    uint16_t port() const { return port_; }
+    std::string baseUrl() const { return "http://127.0.0.1:" + std::to_string(port_); }
+
+    // Latency and error injection can change while the server is running.
+    void setLatency(double latencyMs, double jitterMs);
+    void setErrorRates(double errorRate, double dropRate);
+
+    std::vector<uint8_t> readMemory(uint16_t address, size_t length);
+    void writeMemory(uint16_t address, const std::vector<uint8_t>& data);
+    std::vector<uint8_t> lastPrg();
+
+    Counters counters();
+
+    void stop();
+
+private:
+    struct Request {
+        std::string method;
+        std::string path;
+        std::string query;
+        std::string password;
+        std::vector<uint8_t> body;
+        bool keepAlive = true;
+    };
+
+    struct Response {
+        int status = 200;
+        std::string contentType = "application/json";
+        std::vector<uint8_t> body;
+    };
+
+    void acceptLoop();
+    void serveConnection(int fd);
+    Response handle(const Request& req);
+    void injectDelay();
+    void enterService();
+    void leaveService();
+
+    Options opts_;
+    int listenFd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread acceptor_;
+
+    std::mutex mu_; // guards everything below
+    std::vector<uint8_t> memory_;
+    std::vector<uint8_t> lastPrg_;
+    Counters counters_;
+    std::mt19937 rng_;
+    std::vector<std::thread> workers_;
+    std::vector<int> clientFds_;
+    std::condition_variable serviceCv_;
+    int inService_ = 0;
+};
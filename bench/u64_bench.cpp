@@ -0,0 +1,405 @@
+#include "alloc_counter.h"
+#include "async_client.h"
+#include "mock_u64.h"
+#include "request_stats.h"
+#include "routes.h"
+#include "u64_server.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static void usage() {
+    std::cout <<
+        "u64-bench [--address URL] [--password PW] [--latency MS] [--jitter MS]\n"
+        "          [--errors RATE] [--drops RATE] [--slow RATE,MS] [--capacity N]\n"
+        "          [--iterations N] [--sizes 1,256,4096] [--concurrency 1,4]\n"
+        "          [--ops peek,poke,prg,bulk,mixed,alloc,url,cancel] [--retries N]\n"
+        "          [--hedge PERCENTILE] [--max-inflight N] [--stats]\n"
+        "\n"
+        "Measures throughput and p50/p99 latency of U64Server operations.\n"
+        "Without --address an in-process mock device is started, with the\n"
+        "given latency, jitter, slow-request and error injection.\n"
+        "\n"
+        "The alloc op counts heap allocations per steady-state read for\n"
+        "peekMemory, peekMemoryInto and peekMemoryPooled, and exits 1 if the\n"
+        "allocation-free variants allocate at all.\n"
+        "\n"
+        "The url op times building a readmem URL the old way (std::map params,\n"
+        "ostringstream hex, string concatenation) against routes::UrlBuilder,\n"
+        "without touching the network, and exits 1 if the builder allocates.\n"
+        "\n"
+        "The cancel op checks U64AsyncClient::cancel against a mock of its own:\n"
+        "a read waiting for a governor slot and a read in flight are cancelled,\n"
+        "and it exits 1 unless both report cancelled and the client goes idle.\n"
+        "\n"
+        "The mixed op keeps --concurrency threads doing bulk reads of each size\n"
+        "while it times small interactive reads: p50/p99 are those of the\n"
+        "interactive reads, MB/s is the bulk throughput. --capacity makes the\n"
+        "mock serve only N requests at once, like the device, and --max-inflight\n"
+        "caps the client's concurrency governor (0 turns it off).\n"
+        "\n"
+        "--retries sets the retry budget of each call (default 2), --hedge enables\n"
+        "hedged reads at the given latency percentile (e.g. 0.9), and --stats\n"
+        "prints the per-endpoint request stats, including retries and hedges.\n";
+}
+
+// How U64Server::peekMemory built its URL before the route table.
+static std::string legacyReadmemUrl(const std::string& base, uint16_t address, uint32_t length) {
+    std::map<std::string, std::string> params;
+    std::ostringstream a;
+    a << std::hex << std::setw(4) << std::setfill('0') << address;
+    params["address"] = a.str();
+    params["length"] = std::to_string(length);
+
+    std::string url = base + "/v1/machine:readmem";
+    url += "?";
+    bool first = true;
+    for (const auto& kv : params) {
+        if (!first) url += "&";
+        first = false;
+        url += kv.first;
+        url += "=";
+        url += kv.second;
+    }
+    return url;
+}
+
+static std::vector<uint32_t> parseList(const std::string& s) {
+    std::vector<uint32_t> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(util::parseNumber(item));
+    }
+    return out;
+}
+
+static std::vector<std::string> parseWords(const std::string& s) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t k = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+struct RunResult {
+    std::vector<double> latMs;
+    size_t errors = 0;
+    double wallS = 0;
+};
+
+// Runs op `iterations` times spread over `threads` threads sharing one server.
+template <typename Op>
+static RunResult runConcurrent(size_t iterations, size_t threads, Op op) {
+    RunResult r;
+    std::vector<std::vector<double>> lat(threads);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> errors{0};
+
+    auto t0 = Clock::now();
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            for (;;) {
+                size_t i = next.fetch_add(1);
+                if (i >= iterations) return;
+                auto s = Clock::now();
+                try { op(i); }
+                catch (...) { errors++; continue; }
+                lat[t].push_back(std::chrono::duration<double, std::milli>(Clock::now() - s).count());
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+    r.wallS = std::chrono::duration<double>(Clock::now() - t0).count();
+    for (auto& l : lat) r.latMs.insert(r.latMs.end(), l.begin(), l.end());
+    r.errors = errors;
+    return r;
+}
+
+// Heap allocations per call of op, after a warm-up that fills the pools.
+template <typename Op>
+static double allocsPerCall(size_t iterations, Op op) {
+    for (int i = 0; i < 16; ++i) op();
+    alloc_counter::start();
+    for (size_t i = 0; i < iterations; ++i) op();
+    return static_cast<double>(alloc_counter::stop()) / static_cast<double>(iterations);
+}
+
+static void report(const std::string& op, uint32_t size, size_t conc, RunResult& r) {
+    size_t ok = r.latMs.size();
+    double opsPerS = r.wallS > 0 ? ok / r.wallS : 0;
+    double mbPerS = opsPerS * size / (1024.0 * 1024.0);
+    double p50 = percentile(r.latMs, 0.50);
+    double p99 = percentile(r.latMs, 0.99);
+    std::printf("%-6s %8u %5zu %8zu %10.1f %9.2f %9.3f %9.3f %7zu\n",
+                op.c_str(), size, conc, ok, opsPerS, mbPerS, p50, p99, r.errors);
+    std::fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::string address;
+        std::string password;
+        MockU64::Options mockOpts;
+        size_t iterations = 500;
+        std::vector<uint32_t> sizes = {1, 256, 4096, 32768};
+        std::vector<uint32_t> concurrency = {1, 4};
+        std::vector<std::string> ops = {"peek", "poke", "prg", "bulk"};
+        RetryPolicy retry;
+        ConcurrencyGovernor::Options governor;
+        bool printStats = false;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string a = argv[i];
+            bool hasNext = i + 1 < argc;
+            if (a == "--address" && hasNext) address = argv[++i];
+            else if (a == "--password" && hasNext) password = argv[++i];
+            else if (a == "--latency" && hasNext) mockOpts.latencyMs = std::stod(argv[++i]);
+            else if (a == "--jitter" && hasNext) mockOpts.jitterMs = std::stod(argv[++i]);
+            else if (a == "--errors" && hasNext) mockOpts.errorRate = std::stod(argv[++i]);
+            else if (a == "--drops" && hasNext) mockOpts.dropRate = std::stod(argv[++i]);
+            else if (a == "--slow" && hasNext) {
+                std::string v = argv[++i];
+                size_t comma = v.find(',');
+                if (comma == std::string::npos) throw std::runtime_error("--slow takes RATE,MS");
+                mockOpts.slowRate = std::stod(v.substr(0, comma));
+                mockOpts.slowMs = std::stod(v.substr(comma + 1));
+            }
+            else if (a == "--capacity" && hasNext) mockOpts.capacity = static_cast<int>(util::parseNumber(argv[++i]));
+            else if (a == "--max-inflight" && hasNext) governor.maxLimit = static_cast<int>(util::parseNumber(argv[++i]));
+            else if (a == "--iterations" && hasNext) iterations = util::parseNumber(argv[++i]);
+            else if (a == "--sizes" && hasNext) sizes = parseList(argv[++i]);
+            else if (a == "--concurrency" && hasNext) concurrency = parseList(argv[++i]);
+            else if (a == "--ops" && hasNext) ops = parseWords(argv[++i]);
+            else if (a == "--retries" && hasNext) retry.maxAttempts = 1 + static_cast<int>(util::parseNumber(argv[++i]));
+            else if (a == "--hedge" && hasNext) { retry.hedge = true; retry.hedgePercentile = std::stod(argv[++i]); }
+            else if (a == "--stats") printStats = true;
+            else if (a == "-h" || a == "--help") { usage(); return 0; }
+            else throw std::runtime_error("Unknown option: " + a);
+        }
+
+        std::unique_ptr<MockU64> mock;
+        if (address.empty()) {
+            mockOpts.password = password;
+            mock = std::make_unique<MockU64>(mockOpts);
+            address = mock->baseUrl();
+            std::cout << "mock device on " << address << " (latency " << mockOpts.latencyMs
+                      << " ms, jitter " << mockOpts.jitterMs << " ms, errors " << mockOpts.errorRate
+                      << ", drops " << mockOpts.dropRate << ")\n";
+        } else if (address.find("://") == std::string::npos) {
+            address = "http://" + address;
+        }
+
+        U64Server::Creds creds;
+        creds.address = address;
+        creds.password = password;
+        U64Server server(creds);
+        server.setRetryPolicy(retry);
+        server.setConcurrency(governor);
+        server.getVersion(); // warm the connection
+
+        bool allocOk = true;
+        if (std::find(ops.begin(), ops.end(), "alloc") != ops.end()) {
+            std::printf("%-18s %8s %12s\n", "read", "bytes", "allocs/call");
+            std::vector<uint8_t> span(0x10000);
+            for (uint32_t size : sizes) {
+                if (size == 0 || size > 0xF000) continue;
+                double vec = allocsPerCall(iterations, [&] { server.peekMemory(0x1000, size); });
+                double into = allocsPerCall(iterations, [&] { server.peekMemoryInto(0x1000, span.data(), size); });
+                double pooled = allocsPerCall(iterations, [&] { server.peekMemoryPooled(0x1000, size); });
+                std::printf("%-18s %8u %12.2f\n%-18s %8u %12.2f\n%-18s %8u %12.2f\n",
+                            "peekMemory", size, vec, "peekMemoryInto", size, into,
+                            "peekMemoryPooled", size, pooled);
+                if (into != 0 || pooled != 0) allocOk = false;
+            }
+            std::printf("\n");
+            ops.erase(std::remove(ops.begin(), ops.end(), "alloc"), ops.end());
+        }
+
+        if (std::find(ops.begin(), ops.end(), "url") != ops.end()) {
+            const size_t n = iterations * 1000;
+            volatile size_t sink = 0; // keeps the loops from being optimised away
+            auto time = [&](auto build) {
+                auto t0 = Clock::now();
+                for (size_t i = 0; i < n; ++i) sink = sink + build(static_cast<uint16_t>(i), static_cast<uint32_t>(i & 0xFFF));
+                return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / static_cast<double>(n);
+            };
+            auto legacy = [&](uint16_t a, uint32_t l) { return legacyReadmemUrl(address, a, l).size(); };
+            auto builder = [&](uint16_t a, uint32_t l) {
+                routes::UrlBuilder url(address, routes::kReadMem);
+                url.param(routes::kAddress, routes::Hex4{a}).param(routes::kLength, routes::Dec{l});
+                return static_cast<size_t>(url.c_str()[url.size() - 1]);
+            };
+
+            routes::UrlBuilder check(address, routes::kReadMem);
+            check.param(routes::kAddress, routes::Hex4{0xc0de}).param(routes::kLength, routes::Dec{4096});
+            if (check.view() != legacyReadmemUrl(address, 0xc0de, 4096))
+                throw std::runtime_error("UrlBuilder output differs: " + std::string(check.view()));
+
+            double legacyNs = time(legacy), builderNs = time(builder);
+            double legacyAllocs = allocsPerCall(iterations, [&] { sink = sink + legacy(0x1000, 256); });
+            double builderAllocs = allocsPerCall(iterations, [&] { sink = sink + builder(0x1000, 256); });
+            std::printf("%-18s %10s %12s\n", "readmem url", "ns/build", "allocs/build");
+            std::printf("%-18s %10.1f %12.2f\n%-18s %10.1f %12.2f\n\n",
+                        "map+ostringstream", legacyNs, legacyAllocs, "UrlBuilder", builderNs, builderAllocs);
+            if (builderAllocs != 0) allocOk = false;
+            ops.erase(std::remove(ops.begin(), ops.end(), "url"), ops.end());
+        }
+
+        bool cancelOk = true;
+        if (std::find(ops.begin(), ops.end(), "cancel") != ops.end()) {
+            // A limit of one and a slow device keep the first read in flight
+            // long enough for the second to wait for its slot.
+            MockU64::Options slowOpts;
+            slowOpts.latencyMs = 300;
+            MockU64 slow(slowOpts);
+            U64Server::Creds slowCreds;
+            slowCreds.address = slow.baseUrl();
+            U64Server single(slowCreds);
+            ConcurrencyGovernor::Options one;
+            one.initialLimit = one.minLimit = one.maxLimit = 1;
+            single.setConcurrency(one);
+
+            U64AsyncClient client;
+            std::mutex mu;
+            std::condition_variable cv;
+            int done = 0, cancelled = 0;
+            auto cb = [&](U64AsyncClient::Response& res) {
+                std::lock_guard<std::mutex> lk(mu);
+                done++;
+                if (res.cancelled) cancelled++;
+                cv.notify_all();
+            };
+            auto running = client.peekMemory(single, 0x1000, 16, cb);
+            auto queued = client.peekMemory(single, 0x1000, 16, cb);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            bool okQueued = client.cancel(queued);
+            bool okRunning = client.cancel(running);
+            {
+                std::unique_lock<std::mutex> lk(mu);
+                cv.wait_for(lk, std::chrono::seconds(5), [&] { return done == 2; });
+            }
+            bool ok = okQueued && okRunning && cancelled == 2 && client.pending() == 0;
+            std::printf("%-18s %s (%d of 2 cancelled)\n\n", "async cancel", ok ? "ok" : "FAILED", cancelled);
+            if (!ok) cancelOk = false;
+            ops.erase(std::remove(ops.begin(), ops.end(), "cancel"), ops.end());
+        }
+
+        if (!ops.empty())
+            std::printf("%-6s %8s %5s %8s %10s %9s %9s %9s %7s\n",
+                    "op", "bytes", "conc", "ok", "ops/s", "MB/s", "p50 ms", "p99 ms", "errors");
+
+        for (const auto& op : ops) {
+            for (uint32_t size : sizes) {
+                if (size == 0 || size > 0xF000) continue;
+                std::vector<uint8_t> payload(size);
+                for (uint32_t i = 0; i < size; ++i) payload[i] = static_cast<uint8_t>(i * 13 + 7);
+
+                // A PRG is a 2-byte load address followed by the program.
+                std::vector<uint8_t> prg(size + 2);
+                prg[0] = 0x01;
+                prg[1] = 0x08;
+                std::copy(payload.begin(), payload.end(), prg.begin() + 2);
+
+                for (uint32_t conc : concurrency) {
+                    if (conc == 0) continue;
+                    RunResult r;
+                    if (op == "peek") {
+                        r = runConcurrent(iterations, conc, [&](size_t) { server.peekMemory(0x1000, size); });
+                    } else if (op == "poke") {
+                        r = runConcurrent(iterations, conc, [&](size_t) { server.pokeMemory(0x1000, payload); });
+                    } else if (op == "prg") {
+                        r = runConcurrent(iterations, conc, [&](size_t) { server.runPRG(prg); });
+                    } else if (op == "bulk") {
+                        U64Server::BulkReadOptions bo;
+                        bo.chunkSize = std::max<uint32_t>(256, size / 8);
+                        bo.maxInFlight = static_cast<int>(conc);
+                        r = runConcurrent(std::max<size_t>(1, iterations / 10), 1,
+                                          [&](size_t) { server.peekMemoryBulk(0x1000, size, bo); });
+                    } else if (op == "mixed") {
+                        std::atomic<bool> stop{false};
+                        std::atomic<uint64_t> bulkBytes{0};
+                        std::vector<std::thread> bulk;
+                        for (uint32_t t = 0; t < conc; ++t) {
+                            bulk.emplace_back([&] {
+                                ConcurrencyGovernor::Scope scope(RequestPriority::Bulk);
+                                while (!stop.load()) {
+                                    try {
+                                        server.peekMemoryBulk(0x1000, size);
+                                        bulkBytes += size;
+                                    } catch (...) {}
+                                }
+                            });
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // let the limit settle
+                        uint64_t bytes0 = bulkBytes.load();
+                        r = runConcurrent(iterations, 1, [&](size_t) { server.peekMemory(0x0400, 16); });
+                        uint64_t bytes = bulkBytes.load() - bytes0;
+                        stop = true;
+                        for (auto& t : bulk) t.join();
+                        size_t ok = r.latMs.size();
+                        std::printf("%-6s %8u %5u %8zu %10.1f %9.2f %9.3f %9.3f %7zu\n",
+                                    op.c_str(), size, conc, ok, r.wallS > 0 ? ok / r.wallS : 0,
+                                    r.wallS > 0 ? bytes / r.wallS / (1024.0 * 1024.0) : 0,
+                                    percentile(r.latMs, 0.50), percentile(r.latMs, 0.99), r.errors);
+                        std::fflush(stdout);
+                        continue;
+                    } else {
+                        throw std::runtime_error("Unknown op: " + op);
+                    }
+                    report(op, size, conc, r);
+                }
+            }
+        }
+
+        if (mock) {
+            auto c = mock->counters();
+            std::cout << "mock: " << c.requests << " requests on " << c.connections << " connections, "
+                      << c.errorsInjected << " errors and " << c.drops << " drops injected\n";
+        }
+        if (printStats) {
+            server.stats().writeJson(std::cout);
+            std::cout << "\n";
+        }
+        if (!allocOk) {
+            std::cerr << "Error: allocation-free requests allocated\n";
+            return 1;
+        }
+        if (!cancelOk) {
+            std::cerr << "Error: async cancel failed\n";
+            return 1;
+        }
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
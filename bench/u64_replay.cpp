@@ -0,0 +1,210 @@
+#include "async_client.h"
+#include "mock_u64.h"
+#include "request_stats.h"
+#include "trace.h"
+#include "u64_server.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static void usage() {
+    std::cout <<
+        "u64-replay TRACE [--address URL] [--password PW] [--fast] [--speed X]\n"
+        "           [--concurrency N] [--deadline MS] [--latency MS] [--jitter MS]\n"
+        "           [--capacity N] [--ignore-content] [--verbose]\n"
+        "\n"
+        "Sends the requests of a trace recorded with u64-remote --capture again\n"
+        "and compares each answer's latency, status and body with the recorded\n"
+        "one. Without --address an in-process mock device is started, with the\n"
+        "given latency, jitter and capacity.\n"
+        "\n"
+        "Requests go out at their original times (--speed 2 halves the gaps),\n"
+        "so overlapping requests overlap again. --fast sends them back to back\n"
+        "in trace order instead, with up to --concurrency (default 1) in flight.\n"
+        "\n"
+        "Exits 1 if any answer differs in status or, unless --ignore-content,\n"
+        "in its body.\n";
+}
+
+namespace {
+
+struct Outcome {
+    long status = 0;
+    std::string error;
+    bool sameStatus = false;
+    bool sameBody = false;
+    double ms = 0;
+};
+
+struct EndpointReport {
+    size_t count = 0;
+    size_t statusDiffs = 0;
+    size_t bodyDiffs = 0;
+    LatencyHistogram recorded;
+    LatencyHistogram replayed;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        std::string tracePath;
+        std::string address;
+        std::string password;
+        MockU64::Options mockOpts;
+        bool fast = false;
+        double speed = 1.0;
+        size_t concurrency = 1;
+        int deadlineMs = 10000;
+        bool ignoreContent = false;
+        bool verbose = false;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string a = argv[i];
+            bool hasNext = i + 1 < argc;
+            if (a == "--address" && hasNext) address = argv[++i];
+            else if (a == "--password" && hasNext) password = argv[++i];
+            else if (a == "--fast") fast = true;
+            else if (a == "--speed" && hasNext) speed = std::stod(argv[++i]);
+            else if (a == "--concurrency" && hasNext) concurrency = std::max<size_t>(1, util::parseNumber(argv[++i]));
+            else if (a == "--deadline" && hasNext) deadlineMs = static_cast<int>(util::parseNumber(argv[++i]));
+            else if (a == "--latency" && hasNext) mockOpts.latencyMs = std::stod(argv[++i]);
+            else if (a == "--jitter" && hasNext) mockOpts.jitterMs = std::stod(argv[++i]);
+            else if (a == "--capacity" && hasNext) mockOpts.capacity = static_cast<int>(util::parseNumber(argv[++i]));
+            else if (a == "--ignore-content") ignoreContent = true;
+            else if (a == "--verbose") verbose = true;
+            else if (a == "-h" || a == "--help") { usage(); return 0; }
+            else if (!a.empty() && a[0] == '-') throw std::runtime_error("Unknown option: " + a);
+            else tracePath = a;
+        }
+        if (tracePath.empty()) { usage(); return 2; }
+        if (speed <= 0) throw std::runtime_error("--speed must be positive");
+
+        std::vector<trace::Record> records = trace::read(tracePath);
+        double traceS = 0;
+        for (const auto& r : records) traceS = std::max(traceS, (r.startUs + r.durationUs) / 1e6);
+        std::cout << "trace: " << records.size() << " requests over " << traceS << " s\n";
+
+        std::unique_ptr<MockU64> mock;
+        if (address.empty()) {
+            mockOpts.password = password;
+            mock = std::make_unique<MockU64>(mockOpts);
+            address = mock->baseUrl();
+            std::cout << "mock device on " << address << " (latency " << mockOpts.latencyMs
+                      << " ms, jitter " << mockOpts.jitterMs << " ms, capacity " << mockOpts.capacity << ")\n";
+        } else if (address.find("://") == std::string::npos) {
+            address = "http://" + address;
+        }
+
+        U64Server::Creds creds;
+        creds.address = address;
+        creds.password = password;
+        U64Server server(creds);
+
+        std::vector<Outcome> outcomes(records.size());
+        std::mutex mu;
+        std::condition_variable cv;
+        size_t inFlight = 0;
+        double maxLagMs = 0;
+        // Declared after the state its callbacks touch, so that on an early
+        // exit it is destroyed, and its loop stopped, first.
+        U64AsyncClient client;
+
+        auto send = [&](size_t i) {
+            const trace::Record& rec = records[i];
+            auto sent = Clock::now();
+            client.send(server, rec.method, rec.path, rec.query, rec.body, rec.octet,
+                        [&, i, sent](U64AsyncClient::Response& res) {
+                const trace::Record& r = records[i];
+                Outcome& o = outcomes[i];
+                o.ms = std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+                o.status = res.error.empty() ? res.httpCode : 0;
+                o.error = res.error;
+                o.sameStatus = o.status == r.status;
+                o.sameBody = res.body == r.response;
+                std::lock_guard<std::mutex> lk(mu);
+                inFlight--;
+                cv.notify_all();
+            }, deadlineMs);
+        };
+
+        auto t0 = Clock::now();
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (fast) {
+                std::unique_lock<std::mutex> lk(mu);
+                cv.wait(lk, [&] { return inFlight < concurrency; });
+            } else {
+                auto due = t0 + std::chrono::microseconds(static_cast<int64_t>(records[i].startUs / speed));
+                std::this_thread::sleep_until(due);
+                maxLagMs = std::max(maxLagMs, std::chrono::duration<double, std::milli>(Clock::now() - due).count());
+            }
+            {
+                std::lock_guard<std::mutex> lk(mu);
+                inFlight++;
+            }
+            send(i);
+        }
+        {
+            std::unique_lock<std::mutex> lk(mu);
+            cv.wait(lk, [&] { return inFlight == 0; });
+        }
+        double wallS = std::chrono::duration<double>(Clock::now() - t0).count();
+
+        if (fast) std::cout << "replayed back to back, " << concurrency << " in flight, in " << wallS << " s\n";
+        else std::cout << "replayed at x" << speed << " timing in " << wallS << " s, max lag " << maxLagMs << " ms\n";
+
+        std::map<std::string, EndpointReport> byEndpoint;
+        size_t failures = 0;
+        for (size_t i = 0; i < records.size(); ++i) {
+            const trace::Record& r = records[i];
+            const Outcome& o = outcomes[i];
+            EndpointReport& e = byEndpoint[r.method + " " + r.path];
+            e.count++;
+            e.recorded.record(r.durationUs);
+            e.replayed.record(static_cast<uint64_t>(o.ms * 1000));
+            bool bodyDiff = o.sameStatus && !o.sameBody;
+            if (!o.sameStatus) e.statusDiffs++;
+            if (bodyDiff) e.bodyDiffs++;
+            if (!o.sameStatus || (bodyDiff && !ignoreContent)) {
+                failures++;
+                if (verbose) {
+                    std::cout << "#" << i << " " << r.method << " " << r.path << (r.query.empty() ? "" : "?")
+                              << r.query << ": ";
+                    if (!o.sameStatus) std::cout << "status " << o.status << ", recorded " << r.status;
+                    else std::cout << "body differs";
+                    if (!o.error.empty()) std::cout << " (" << o.error << ")";
+                    std::cout << "\n";
+                }
+            }
+        }
+
+        std::printf("\n%-28s %6s %9s %9s %9s %9s %7s %7s\n", "endpoint", "count", "rec p50", "rec p99",
+                    "new p50", "new p99", "status", "body");
+        for (const auto& kv : byEndpoint) {
+            const EndpointReport& e = kv.second;
+            std::printf("%-28s %6zu %9.3f %9.3f %9.3f %9.3f %7zu %7zu\n", kv.first.c_str(), e.count,
+                        e.recorded.percentileMs(0.50), e.recorded.percentileMs(0.99),
+                        e.replayed.percentileMs(0.50), e.replayed.percentileMs(0.99),
+                        e.statusDiffs, e.bodyDiffs);
+        }
+        std::printf("(latencies in ms; status and body count answers that differ from the trace)\n");
+        return failures ? 1 : 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,371 @@
+#include "async_client.h"
+#include "curl_pool.h"
+#include "request_stats.h"
+#include "routes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+struct U64AsyncClient::Op {
+    RequestId id = 0;
+    U64Server* server = nullptr;
+    std::string_view method;   // into a route constant or owned
+    std::string_view endpoint; // stats key, "<method> <path>"
+    std::string owned;         // endpoint of a request made with send()
+    std::string url;
+    std::vector<uint8_t> body;
+    bool octet = false;
+    Clock::time_point deadline;
+    Callback cb;
+    RequestPriority priority = RequestPriority::Interactive;
+    bool queued = false;    // waiting for a governor slot
+    bool permitted = false; // holds one
+
+    CURL* curl = nullptr;
+    Clock::time_point started;
+    std::vector<uint8_t> response;
+};
+
+static size_t curlAppend(void* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t n = size * nmemb;
+    auto* v = reinterpret_cast<std::vector<uint8_t>*>(userdata);
+    auto* b = reinterpret_cast<uint8_t*>(ptr);
+    v->insert(v->end(), b, b + n);
+    return n;
+}
+
+// Turns a finished response into the same exception the blocking call throws.
+static void throwIfFailed(const U64AsyncClient::Response& res, const char* what) {
+    if (!res.error.empty()) throw std::runtime_error(std::string(what) + ": " + res.error);
+    if (!res.ok()) {
+        std::string bodyStr(res.body.begin(), res.body.end());
+        throw std::runtime_error(std::string(what) + " failed HTTP " + std::to_string(res.httpCode) +
+                                 " body: " + bodyStr);
+    }
+}
+
+U64AsyncClient::U64AsyncClient() {
+    ensureCurlGlobalInit();
+    multi_ = curl_multi_init();
+    if (!multi_) throw std::runtime_error("curl_multi_init failed");
+    thread_ = std::thread([this] { loop(); });
+}
+
+U64AsyncClient::~U64AsyncClient() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stopping_ = true;
+    }
+    curl_multi_wakeup(multi_);
+    if (thread_.joinable()) thread_.join();
+    curl_multi_cleanup(multi_);
+}
+
+// ---------------------
+// Submission
+// ---------------------
+U64AsyncClient::RequestId U64AsyncClient::submit(
+    U64Server& server, const routes::Route& route, const routes::UrlBuilder& url,
+    std::vector<uint8_t> body, bool octet, int deadlineMs, Callback cb) {
+    server.requireAddress();
+
+    auto op = std::make_unique<Op>();
+    op->server = &server;
+    op->method = route.method;
+    op->endpoint = route.endpoint;
+    op->url = url.view();
+    op->body = std::move(body);
+    op->octet = octet;
+    return submit(std::move(op), deadlineMs, std::move(cb));
+}
+
+U64AsyncClient::RequestId U64AsyncClient::send(U64Server& server, const std::string& method,
+                                               const std::string& path, const std::string& query,
+                                               std::vector<uint8_t> body, bool octet, Callback cb,
+                                               int deadlineMs) {
+    server.requireAddress();
+
+    auto op = std::make_unique<Op>();
+    op->server = &server;
+    op->owned = method + " " + path;
+    op->method = std::string_view(op->owned).substr(0, method.size());
+    op->endpoint = op->owned;
+    op->url = server.creds_.address + path;
+    if (!query.empty()) op->url += "?" + query;
+    op->body = std::move(body);
+    op->octet = octet;
+    return submit(std::move(op), deadlineMs, std::move(cb));
+}
+
+U64AsyncClient::RequestId U64AsyncClient::submit(std::unique_ptr<Op> op, int deadlineMs, Callback cb) {
+    op->deadline = Clock::now() + std::chrono::milliseconds(deadlineMs > 0 ? deadlineMs : kDefaultDeadlineMs);
+    op->cb = std::move(cb);
+    op->priority = ConcurrencyGovernor::current(); // of the submitting thread
+
+    RequestId id;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (stopping_) throw std::runtime_error("U64AsyncClient is shutting down");
+        id = op->id = nextId_++;
+        queued_.push_back(std::move(op));
+        live_.insert(id);
+    }
+    curl_multi_wakeup(multi_);
+    return id;
+}
+
+bool U64AsyncClient::cancel(RequestId id) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (!live_.count(id)) return false;
+        cancels_.push_back(id);
+    }
+    curl_multi_wakeup(multi_);
+    return true;
+}
+
+size_t U64AsyncClient::pending() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return live_.size();
+}
+
+// ---------------------
+// Event loop
+// ---------------------
+void U64AsyncClient::start(Op& op) {
+    U64Server& server = *op.server;
+    op.curl = server.pool_->acquire();
+    op.started = Clock::now();
+    CURL* curl = op.curl;
+
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(op.deadline - Clock::now()).count();
+    curl_easy_setopt(curl, CURLOPT_URL, op.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, op.octet ? server.headersOctet_.get() : server.headers_.get());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlAppend);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &op.response);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(std::max<long long>(1, remaining)));
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, reinterpret_cast<char*>(op.id));
+    if (op.method == "GET") {
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        if (op.method != "POST") curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, std::string(op.method).c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, op.body.data());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(op.body.size()));
+    }
+    curl_multi_add_handle(multi_, curl);
+}
+
+void U64AsyncClient::finish(std::unique_ptr<Op> op, Response& res) {
+    ConcurrencyGovernor& governor = *op->server->governor_;
+    if (op->queued) governor.dequeue(op->priority);
+    if (op->permitted) governor.release(0, ConcurrencyGovernor::Outcome::Ignored);
+    if (op->curl) {
+        curl_multi_remove_handle(multi_, op->curl);
+        op->server->pool_->release(op->curl);
+        op->curl = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        live_.erase(op->id);
+    }
+    if (!op->cb) return;
+    try { op->cb(res); } catch (...) {} // a throwing callback must not stop the loop
+}
+
+void U64AsyncClient::loop() {
+    for (;;) {
+        std::deque<std::unique_ptr<Op>> fresh;
+        std::vector<RequestId> cancels;
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            fresh.swap(queued_);
+            cancels.swap(cancels_);
+            stopping = stopping_;
+        }
+
+        // Cancellations first, so a request cancelled while queued never starts.
+        for (RequestId id : cancels) {
+            for (auto* list : {&fresh, &waiting_}) {
+                for (auto& op : *list) {
+                    if (!op || op->id != id) continue;
+                    Response res;
+                    res.cancelled = true;
+                    res.error = "cancelled";
+                    finish(std::move(op), res);
+                }
+            }
+            auto it = running_.find(id);
+            if (it == running_.end()) continue;
+            std::unique_ptr<Op> op = std::move(it->second);
+            running_.erase(it);
+            Response res;
+            res.cancelled = true;
+            res.error = "cancelled";
+            finish(std::move(op), res);
+        }
+
+        // Requests start once their device's governor has a slot for them;
+        // until then they wait in waiting_, in submission order within a
+        // priority. Earlier requests get the first chance at a slot.
+        auto admit = [&](std::unique_ptr<Op>& op) {
+            if (stopping || Clock::now() >= op->deadline) {
+                Response res;
+                res.cancelled = stopping;
+                res.error = stopping ? "cancelled" : "deadline exceeded";
+                finish(std::move(op), res);
+                return;
+            }
+            ConcurrencyGovernor& governor = *op->server->governor_;
+            if (!governor.tryAcquire(op->priority, op->queued)) {
+                if (!op->queued) governor.enqueue(op->priority);
+                op->queued = true;
+                return;
+            }
+            op->queued = false;
+            op->permitted = true;
+            RequestId id = op->id;
+            start(*op);
+            running_.emplace(id, std::move(op));
+        };
+        for (auto& op : waiting_) {
+            if (op) admit(op); // null once cancelled above
+        }
+        waiting_.erase(std::remove(waiting_.begin(), waiting_.end(), nullptr), waiting_.end());
+        for (auto& op : fresh) {
+            if (!op) continue;
+            admit(op);
+            if (op) waiting_.push_back(std::move(op));
+        }
+
+        if (stopping) {
+            while (!running_.empty()) {
+                std::unique_ptr<Op> op = std::move(running_.begin()->second);
+                running_.erase(running_.begin());
+                Response res;
+                res.cancelled = true;
+                res.error = "cancelled";
+                finish(std::move(op), res);
+            }
+            return;
+        }
+
+        int still = 0;
+        curl_multi_perform(multi_, &still);
+
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            char* priv = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+            auto it = running_.find(reinterpret_cast<RequestId>(priv));
+            if (it == running_.end()) continue;
+            std::unique_ptr<Op> op = std::move(it->second);
+            running_.erase(it);
+
+            CURLcode rc = msg->data.result;
+            Response res;
+            curl_easy_getinfo(op->curl, CURLINFO_RESPONSE_CODE, &res.httpCode);
+            recordCurlTransfer(op->server->stats(), op->curl, op->endpoint, rc, res.httpCode);
+            double rttMs;
+            ConcurrencyGovernor::Outcome outcome = transferOutcome(
+                op->curl, rc, res.httpCode, op->body.size() <= ConcurrencyGovernor::kMaxSampledBody, rttMs);
+            op->server->governor_->release(rttMs, outcome);
+            op->permitted = false;
+            if (rc == CURLE_OPERATION_TIMEDOUT) res.error = "deadline exceeded";
+            else if (rc != CURLE_OK) res.error = std::string("HTTP request failed: ") + curl_easy_strerror(rc);
+            op->server->capture(op->endpoint, op->url, op->octet, op->body.data(), op->body.size(),
+                                rc == CURLE_OK ? res.httpCode : 0, op->response.data(), op->response.size(),
+                                op->started);
+            res.body = std::move(op->response);
+            finish(std::move(op), res);
+        }
+
+        // Sleeps until a socket is ready, a transfer timer fires or
+        // submit()/cancel() wakes the loop. Slots freed by other threads
+        // do not wake it, so requests waiting for one are checked often.
+        curl_multi_poll(multi_, nullptr, 0, waiting_.empty() ? 1000 : 5, nullptr);
+    }
+}
+
+// ---------------------
+// Operations
+// ---------------------
+U64AsyncClient::RequestId U64AsyncClient::getVersion(U64Server& server, Callback cb, int deadlineMs) {
+    routes::UrlBuilder url(server.creds_.address, routes::kVersion);
+    return submit(server, routes::kVersion, url, {}, false, deadlineMs, std::move(cb));
+}
+
+U64AsyncClient::RequestId U64AsyncClient::runPRG(U64Server& server, std::vector<uint8_t> prgBytes,
+                                                 Callback cb, int deadlineMs) {
+    routes::UrlBuilder url(server.creds_.address, routes::kRunPrg);
+    return submit(server, routes::kRunPrg, url, std::move(prgBytes), true, deadlineMs, std::move(cb));
+}
+
+U64AsyncClient::RequestId U64AsyncClient::peekMemory(U64Server& server, uint16_t address, uint32_t length,
+                                                     Callback cb, int deadlineMs) {
+    routes::UrlBuilder url(server.creds_.address, routes::kReadMem);
+    url.param(routes::kAddress, routes::Hex4{address}).param(routes::kLength, routes::Dec{length});
+    return submit(server, routes::kReadMem, url, {}, false, deadlineMs, std::move(cb));
+}
+
+U64AsyncClient::RequestId U64AsyncClient::pokeMemory(U64Server& server, uint16_t address, std::vector<uint8_t> data,
+                                                     Callback cb, int deadlineMs) {
+    routes::UrlBuilder url(server.creds_.address, routes::kWriteMem);
+    url.param(routes::kAddress, routes::Hex4{address});
+    return submit(server, routes::kWriteMem, url, std::move(data), true, deadlineMs, std::move(cb));
+}
+
+U64AsyncClient::Call<std::vector<uint8_t>> U64AsyncClient::getVersion(U64Server& server, int deadlineMs) {
+    auto p = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    Call<std::vector<uint8_t>> call;
+    call.result = p->get_future();
+    call.id = getVersion(server, [p](Response& res) {
+        // Like the blocking call, any HTTP answer (even 401/403) counts.
+        if (!res.error.empty()) {
+            p->set_exception(std::make_exception_ptr(std::runtime_error("getVersion: " + res.error)));
+        } else {
+            p->set_value(std::move(res.body));
+        }
+    }, deadlineMs);
+    return call;
+}
+
+U64AsyncClient::Call<void> U64AsyncClient::runPRG(U64Server& server, std::vector<uint8_t> prgBytes, int deadlineMs) {
+    auto p = std::make_shared<std::promise<void>>();
+    Call<void> call;
+    call.result = p->get_future();
+    call.id = runPRG(server, std::move(prgBytes), [p](Response& res) {
+        try { throwIfFailed(res, "runPRG"); p->set_value(); }
+        catch (...) { p->set_exception(std::current_exception()); }
+    }, deadlineMs);
+    return call;
+}
+
+U64AsyncClient::Call<std::vector<uint8_t>> U64AsyncClient::peekMemory(U64Server& server, uint16_t address,
+                                                                      uint32_t length, int deadlineMs) {
+    auto p = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    Call<std::vector<uint8_t>> call;
+    call.result = p->get_future();
+    call.id = peekMemory(server, address, length, [p](Response& res) {
+        try { throwIfFailed(res, "peekMemory"); p->set_value(std::move(res.body)); }
+        catch (...) { p->set_exception(std::current_exception()); }
+    }, deadlineMs);
+    return call;
+}
+
+U64AsyncClient::Call<void> U64AsyncClient::pokeMemory(U64Server& server, uint16_t address,
+                                                      std::vector<uint8_t> data, int deadlineMs) {
+    auto p = std::make_shared<std::promise<void>>();
+    Call<void> call;
+    call.result = p->get_future();
+    call.id = pokeMemory(server, address, std::move(data), [p](Response& res) {
+        try { throwIfFailed(res, "pokeMemory"); p->set_value(); }
+        catch (...) { p->set_exception(std::current_exception()); }
+    }, deadlineMs);
+    return call;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "u64_server.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Non-blocking front end for U64Server. One event-loop thread drives every
+// submitted request on a single curl multi handle, so many requests, to one
+// device or to several, overlap without a thread per call.
+//
+// Requests use the target server's connection pool, headers, stats and
+// concurrency governor, at the priority of the thread that submits them.
+// The server must outlive its outstanding requests. Completion callbacks
+// run on the loop thread and should return quickly.
+class U64AsyncClient {
+public:
+    using RequestId = uint64_t;
+
+    struct Response {
+        long httpCode = 0;          // 0 = no HTTP answer (see error)
+        std::vector<uint8_t> body;
+        std::string error;          // transport error, deadline or cancellation
+        bool cancelled = false;
+        bool ok() const { return error.empty() && httpCode >= 200 && httpCode < 300; }
+    };
+
+    using Callback = std::function<void(Response&)>;
+
+    // A request's id, for cancel(), and the future of its result. Futures
+    // fail with std::runtime_error the same way the blocking calls throw.
+    template <typename T>
+    struct Call {
+        RequestId id = 0;
+        std::future<T> result;
+    };
+
+    // Deadlines count from submission and cover queueing and the transfer.
+    static constexpr int kDefaultDeadlineMs = 5000;
+
+    U64AsyncClient();
+    ~U64AsyncClient(); // cancels whatever is still outstanding
+
+    U64AsyncClient(const U64AsyncClient&) = delete;
+    U64AsyncClient& operator=(const U64AsyncClient&) = delete;
+
+    // Callback flavour.
+    RequestId getVersion(U64Server& server, Callback cb, int deadlineMs = kDefaultDeadlineMs);
+    RequestId runPRG(U64Server& server, std::vector<uint8_t> prgBytes, Callback cb,
+                     int deadlineMs = kDefaultDeadlineMs);
+    RequestId peekMemory(U64Server& server, uint16_t address, uint32_t length, Callback cb,
+                         int deadlineMs = kDefaultDeadlineMs);
+    RequestId pokeMemory(U64Server& server, uint16_t address, std::vector<uint8_t> data, Callback cb,
+                         int deadlineMs = kDefaultDeadlineMs);
+
+    // Future flavour.
+    Call<std::vector<uint8_t>> getVersion(U64Server& server, int deadlineMs = kDefaultDeadlineMs);
+    Call<void> runPRG(U64Server& server, std::vector<uint8_t> prgBytes, int deadlineMs = kDefaultDeadlineMs);
+    Call<std::vector<uint8_t>> peekMemory(U64Server& server, uint16_t address, uint32_t length,
+                                          int deadlineMs = kDefaultDeadlineMs);
+    Call<void> pokeMemory(U64Server& server, uint16_t address, std::vector<uint8_t> data,
+                          int deadlineMs = kDefaultDeadlineMs);
+
+    // Any request, for tools that re-send recorded traffic (u64-replay).
+    // path starts with '/'; query is appended after a '?' unless empty.
+    // octet sends the body as application/octet-stream.
+    RequestId send(U64Server& server, const std::string& method, const std::string& path,
+                   const std::string& query, std::vector<uint8_t> body, bool octet, Callback cb,
+                   int deadlineMs = kDefaultDeadlineMs);
+
+    // Cancels a queued or running request; its callback sees cancelled=true.
+    // Returns false if the request already finished.
+    bool cancel(RequestId id);
+
+    // Requests submitted and not yet completed.
+    size_t pending() const;
+
+private:
+    struct Op;
+
+    RequestId submit(U64Server& server, const routes::Route& route, const routes::UrlBuilder& url,
+                     std::vector<uint8_t> body, bool octet, int deadlineMs, Callback cb);
+    RequestId submit(std::unique_ptr<Op> op, int deadlineMs, Callback cb);
+    void loop();
+    void start(Op& op);
+    void finish(std::unique_ptr<Op> op, Response& res);
+
+    void* multi_ = nullptr; // CURLM*
+    std::thread thread_;
+
+    mutable std::mutex mu_; // guards everything below
+    bool stopping_ = false;
+    RequestId nextId_ = 1;
+    std::deque<std::unique_ptr<Op>> queued_;
+    std::vector<RequestId> cancels_;
+    std::set<RequestId> live_; // submitted and not yet completed
+
+    // Loop thread only.
+    std::deque<std::unique_ptr<Op>> waiting_; // for a governor slot
+    std::map<RequestId, std::unique_ptr<Op>> running_;
+};
@@ -0,0 +1,299 @@
+#include "batch.h"
+#include "async_client.h"
+#include "commands.h"
+#include "hex.h"
+#include "util.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+BatchRunner::BatchRunner(U64Server& server) : server_(server) {}
+
+BatchRunner::BatchRunner(U64Server& server, Options opts) : server_(server), opts_(opts) {}
+
+static std::string lineError(size_t line, const std::string& msg) {
+    return "batch line " + std::to_string(line) + ": " + msg;
+}
+
+BatchRunner::Op BatchRunner::parse(const std::string& text, size_t line) {
+    std::istringstream in(text);
+    std::vector<std::string> tok;
+    for (std::string t; in >> t;) tok.push_back(t);
+
+    Op op;
+    op.line = line;
+    const std::string& verb = tok[0];
+    auto address = [&]() -> uint16_t {
+        if (tok.size() < 2) throw std::runtime_error(lineError(line, verb + ": missing address"));
+        uint32_t v = util::parseNumber(tok[1]);
+        if (v > 0xFFFF) throw std::runtime_error(lineError(line, "address out of range: " + tok[1]));
+        return static_cast<uint16_t>(v);
+    };
+
+    try {
+        if (verb == "peek") {
+            op.kind = Op::Kind::Peek;
+            op.address = address();
+            op.length = tok.size() > 2 ? util::parseNumber(tok[2]) : 1;
+            if (tok.size() > 3) throw std::runtime_error("peek: too many arguments");
+            if (op.length == 0 || op.address + op.length > 0x10000) throw std::runtime_error("peek: bad length");
+        } else if (verb == "poke") {
+            op.kind = Op::Kind::Poke;
+            op.address = address();
+            std::string digits;
+            for (size_t i = 2; i < tok.size(); ++i) digits += tok[i];
+            op.data = hex::decode(digits);
+            op.length = static_cast<uint32_t>(op.data.size());
+            if (op.data.empty()) throw std::runtime_error("poke: missing bytes");
+            if (op.address + op.length > 0x10000) throw std::runtime_error("poke: runs past $FFFF");
+        } else if (verb == "run") {
+            op.kind = Op::Kind::Run;
+            if (tok.size() != 2) throw std::runtime_error("run: expected one PRG file");
+            op.args.assign(tok.begin() + 1, tok.end());
+        } else if (verb == "wait") {
+            op.kind = Op::Kind::Wait;
+            op.args.assign(tok.begin() + 1, tok.end());
+        } else {
+            throw std::runtime_error("unknown operation: " + verb);
+        }
+    } catch (const std::runtime_error& e) {
+        std::string msg = e.what();
+        if (msg.rfind("batch line ", 0) == 0) throw;
+        throw std::runtime_error(lineError(line, msg));
+    }
+    return op;
+}
+
+// ---------------------
+// Segment planning
+// ---------------------
+namespace {
+
+// The memory one peek or poke touches.
+struct Access {
+    bool write = false;
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    const std::vector<uint8_t>* data = nullptr; // poke bytes
+};
+
+// One readmem or writemem request covering [lo, hi).
+struct Group {
+    bool write = false;
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    std::vector<uint8_t> bytes;  // poke data, or the peek result
+    std::vector<size_t> blocks;  // groups that must wait for this one
+    size_t waitingOn = 0;
+    bool done = false;
+};
+
+bool overlaps(uint32_t lo, uint32_t hi, const Group& g) {
+    return lo < g.hi && g.lo < hi;
+}
+
+// Merges each peek and poke into an earlier request where that keeps every
+// peek's view of memory: a peek may move up to an earlier read only if no
+// write in between touches its bytes, and a poke may move up to an earlier
+// write only if nothing in between touches its bytes at all.
+std::vector<Group> plan(const std::vector<Access>& accesses, std::vector<size_t>& groupOf, uint32_t readGap) {
+    std::vector<Group> groups;
+    for (const auto& a : accesses) {
+        const bool write = a.write;
+        const uint32_t lo = a.lo, hi = a.hi;
+        size_t target = groups.size();
+        for (size_t k = groups.size(); k-- > 0;) {
+            Group& g = groups[k];
+            const uint32_t gap = write ? 0 : readGap;
+            if (g.write == write && lo <= g.hi + gap && g.lo <= hi + gap) { target = k; break; }
+            if (overlaps(lo, hi, g) && (write || g.write)) break;
+        }
+
+        if (target == groups.size()) {
+            Group g;
+            g.write = write;
+            g.lo = lo;
+            g.hi = hi;
+            if (write) g.bytes = *a.data;
+            groups.push_back(std::move(g));
+        } else {
+            Group& g = groups[target];
+            const uint32_t nlo = std::min(lo, g.lo), nhi = std::max(hi, g.hi);
+            if (write) {
+                std::vector<uint8_t> merged(nhi - nlo);
+                std::copy(g.bytes.begin(), g.bytes.end(), merged.begin() + (g.lo - nlo));
+                std::copy(a.data->begin(), a.data->end(), merged.begin() + (lo - nlo));
+                g.bytes = std::move(merged);
+            }
+            g.lo = nlo;
+            g.hi = nhi;
+        }
+        groupOf.push_back(target);
+    }
+
+    // Requests that touch the same bytes, at least one of them a write, keep
+    // their script order; everything else may overlap in flight.
+    for (size_t j = 0; j < groups.size(); ++j) {
+        for (size_t i = 0; i < j; ++i) {
+            if ((groups[i].write || groups[j].write) && overlaps(groups[j].lo, groups[j].hi, groups[i])) {
+                groups[i].blocks.push_back(j);
+                groups[j].waitingOn++;
+            }
+        }
+    }
+    return groups;
+}
+
+void printLine(std::ostream& out, uint16_t address, const uint8_t* data, size_t length) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string line = "$";
+    for (int shift = 12; shift >= 0; shift -= 4) line += kHex[(address >> shift) & 0xF];
+    line += ':';
+    for (size_t i = 0; i < length; ++i) {
+        line += ' ';
+        line += kHex[data[i] >> 4];
+        line += kHex[data[i] & 0xF];
+    }
+    line += '\n';
+    out << line;
+    out.flush();
+}
+
+} // namespace
+
+// ---------------------
+// Execution
+// ---------------------
+void BatchRunner::runSegment(U64AsyncClient& async, const std::vector<Op>& segment, std::ostream& out) {
+    if (segment.empty()) return;
+
+    std::vector<Access> accesses;
+    for (const auto& op : segment) {
+        accesses.push_back(Access{op.kind == Op::Kind::Poke, op.address, op.address + op.length, &op.data});
+    }
+    std::vector<size_t> groupOf;
+    std::vector<Group> groups = plan(accesses, groupOf, opts_.readGap);
+
+    struct Completion {
+        size_t group;
+        U64AsyncClient::Response res;
+    };
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<Completion> completions;
+
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (groups[i].waitingOn == 0) ready.push_back(i);
+    }
+    size_t inFlight = 0, finished = 0, emitted = 0;
+    std::string error;
+
+    while (finished < groups.size()) {
+        while (error.empty() && !ready.empty() && inFlight < opts_.maxInFlight) {
+            size_t gi = ready.front();
+            ready.erase(ready.begin());
+            Group& g = groups[gi];
+            auto cb = [&, gi](U64AsyncClient::Response& res) {
+                std::lock_guard<std::mutex> lk(mu);
+                completions.push_back(Completion{gi, std::move(res)});
+                cv.notify_one();
+            };
+            if (g.write) async.pokeMemory(server_, static_cast<uint16_t>(g.lo), g.bytes, cb);
+            else async.peekMemory(server_, static_cast<uint16_t>(g.lo), g.hi - g.lo, cb);
+            inFlight++;
+            stats_.requests++;
+        }
+        if (inFlight == 0) break; // an error stopped submission
+
+        std::vector<Completion> batch;
+        {
+            std::unique_lock<std::mutex> lk(mu);
+            cv.wait(lk, [&] { return !completions.empty(); });
+            batch.swap(completions);
+        }
+        for (auto& c : batch) {
+            inFlight--;
+            finished++;
+            Group& g = groups[c.group];
+            if (!c.res.ok()) {
+                if (error.empty()) {
+                    error = c.res.error.empty() ? "HTTP " + std::to_string(c.res.httpCode) : c.res.error;
+                    // Name the first script line this request served.
+                    for (size_t i = 0; i < segment.size(); ++i) {
+                        if (groupOf[i] == c.group) { error = lineError(segment[i].line, error); break; }
+                    }
+                }
+                continue;
+            }
+            if (!g.write) {
+                if (c.res.body.size() != g.hi - g.lo) {
+                    if (error.empty()) error = "short readmem reply (" + std::to_string(c.res.body.size()) + " bytes)";
+                    continue;
+                }
+                g.bytes = std::move(c.res.body);
+            }
+            g.done = true;
+            for (size_t next : g.blocks) {
+                if (--groups[next].waitingOn == 0) ready.push_back(next);
+            }
+        }
+
+        // Stream results in script order as far as they are known.
+        while (emitted < segment.size() && groups[groupOf[emitted]].done) {
+            const Op& op = segment[emitted];
+            const Group& g = groups[groupOf[emitted]];
+            if (op.kind == Op::Kind::Peek) printLine(out, op.address, g.bytes.data() + (op.address - g.lo), op.length);
+            emitted++;
+            stats_.ops++;
+        }
+    }
+    if (!error.empty()) throw std::runtime_error(error);
+}
+
+int BatchRunner::run(std::istream& script, std::ostream& out) {
+    U64AsyncClient async;
+    std::vector<Op> segment;
+    std::string text;
+    size_t line = 0;
+    while (std::getline(script, text)) {
+        ++line;
+        if (opts_.stop && opts_.stop->load()) throw std::runtime_error(lineError(line, "interrupted"));
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos || text[first] == '#') continue;
+
+        Op op = parse(text, line);
+        if (op.kind == Op::Kind::Peek || op.kind == Op::Kind::Poke) {
+            segment.push_back(std::move(op));
+            if (segment.size() >= opts_.maxSegmentOps) {
+                runSegment(async, segment, out);
+                segment.clear();
+            }
+            continue;
+        }
+
+        // Barrier: everything before it completes first.
+        runSegment(async, segment, out);
+        segment.clear();
+        try {
+            if (op.kind == Op::Kind::Run) {
+                server_.runPRGFile(op.args[0]);
+                stats_.requests++;
+            } else {
+                std::ostringstream waitOut;
+                int rc = cmdWait(server_, op.args, waitOut, opts_.stop);
+                out << waitOut.str();
+                out.flush();
+                if (rc != 0) return rc;
+            }
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(lineError(line, e.what()));
+        }
+        stats_.ops++;
+    }
+    runSegment(async, segment, out);
+    return 0;
+}
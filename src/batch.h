@@ -0,0 +1,68 @@
+#pragma once
+#include "u64_server.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class U64AsyncClient;
+
+// Runs a script of device operations over one connection pool, one per line:
+//
+//   peek <addr> [len]        prints "$addr: xx xx ..."
+//   poke <addr> <hex bytes>
+//   run <file.prg>
+//   wait <addr> <condition>  same arguments as the wait command
+//
+// Blank lines and lines starting with '#' are ignored. Peeks and pokes
+// between two run/wait lines form a segment: adjacent or overlapping
+// operations are merged into single readmem/writemem requests wherever that
+// cannot change what a peek observes, and requests that do not touch the
+// same memory are in flight at the same time. run and wait are barriers.
+// Results are written in script order as soon as they are known.
+class BatchRunner {
+public:
+    struct Options {
+        size_t maxInFlight = 8;     // concurrent requests within a segment
+        uint32_t readGap = 16;      // peeks this close share one readmem
+        size_t maxSegmentOps = 256; // flush a long segment without waiting for EOF
+        const std::atomic<bool>* stop = nullptr; // set: stop before the next line
+    };
+
+    struct Stats {
+        uint64_t ops = 0;       // script operations run
+        uint64_t requests = 0;  // device requests issued for them
+    };
+
+    explicit BatchRunner(U64Server& server);
+    BatchRunner(U64Server& server, Options opts);
+
+    // Runs the script and returns the exit code: 0, or 3 when a wait timed
+    // out (the rest of the script is skipped). Errors throw
+    // std::runtime_error naming the script line.
+    int run(std::istream& script, std::ostream& out);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Op {
+        enum class Kind { Peek, Poke, Run, Wait };
+        Kind kind = Kind::Peek;
+        size_t line = 0;
+        uint16_t address = 0;
+        uint32_t length = 0;
+        std::vector<uint8_t> data;
+        std::vector<std::string> args; // run path, wait arguments
+    };
+
+    static Op parse(const std::string& text, size_t line);
+    void runSegment(U64AsyncClient& async, const std::vector<Op>& segment, std::ostream& out);
+
+    U64Server& server_;
+    Options opts_;
+    Stats stats_;
+};
@@ -0,0 +1,66 @@
+#include "buffer_pool.h"
+
+BufferPool::BufferPool(size_t maxIdle) : shared_(std::make_shared<Shared>()) {
+    shared_->maxIdle = maxIdle;
+    // Reserve up front so returning a buffer never reallocates the list.
+    shared_->idle.reserve(maxIdle);
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t size) {
+    std::vector<uint8_t> bytes;
+    {
+        std::lock_guard<std::mutex> lk(shared_->mu);
+        auto& idle = shared_->idle;
+        // Prefer the smallest idle buffer that fits; otherwise grow the largest.
+        size_t best = idle.size();
+        for (size_t i = 0; i < idle.size(); ++i) {
+            if (idle[i].capacity() >= size &&
+                (best == idle.size() || idle[i].capacity() < idle[best].capacity())) {
+                best = i;
+            }
+        }
+        if (best == idle.size() && !idle.empty()) {
+            best = 0;
+            for (size_t i = 1; i < idle.size(); ++i) {
+                if (idle[i].capacity() > idle[best].capacity()) best = i;
+            }
+        }
+        if (best < idle.size()) {
+            bytes.swap(idle[best]);
+            idle[best].swap(idle.back());
+            idle.pop_back();
+        }
+    }
+    bytes.resize(size);
+    return Buffer(shared_, std::move(bytes));
+}
+
+size_t BufferPool::idleCount() const {
+    std::lock_guard<std::mutex> lk(shared_->mu);
+    return shared_->idle.size();
+}
+
+void BufferPool::Buffer::giveBack() {
+    if (!shared_) return;
+    {
+        std::lock_guard<std::mutex> lk(shared_->mu);
+        if (shared_->idle.size() < shared_->maxIdle && bytes_.capacity() > 0) {
+            shared_->idle.push_back(std::move(bytes_));
+        }
+    }
+    bytes_ = std::vector<uint8_t>();
+    shared_.reset();
+}
+
+BufferPool::Buffer::~Buffer() {
+    giveBack();
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& o) noexcept {
+    if (this != &o) {
+        giveBack();
+        shared_ = std::move(o.shared_);
+        bytes_ = std::move(o.bytes_);
+    }
+    return *this;
+}
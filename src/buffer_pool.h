@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Recycles byte buffers so steady-state reads reuse memory instead of
+// allocating a fresh vector per response. Buffers keep the pool's shared
+// state alive, so they may outlive the pool object itself.
+class BufferPool {
+    struct Shared {
+        std::mutex mu;
+        std::vector<std::vector<uint8_t>> idle;
+        size_t maxIdle = 0;
+    };
+
+public:
+    // Move-only handle to one buffer; returns it to the pool on destruction.
+    class Buffer {
+    public:
+        Buffer() = default;
+        ~Buffer();
+        Buffer(Buffer&& o) noexcept = default;
+        Buffer& operator=(Buffer&& o) noexcept;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        uint8_t* data() { return bytes_.data(); }
+        const uint8_t* data() const { return bytes_.data(); }
+        size_t size() const { return bytes_.size(); }
+        const std::vector<uint8_t>& bytes() const { return bytes_; }
+
+        // Shrinks the visible size (e.g. after a short read); keeps capacity.
+        void resize(size_t n) { bytes_.resize(n); }
+
+    private:
+        friend class BufferPool;
+        Buffer(std::shared_ptr<Shared> shared, std::vector<uint8_t> bytes)
+            : shared_(std::move(shared)), bytes_(std::move(bytes)) {}
+        void giveBack();
+
+        std::shared_ptr<Shared> shared_;
+        std::vector<uint8_t> bytes_;
+    };
+
+    explicit BufferPool(size_t maxIdle = 8);
+
+    // A buffer of exactly size bytes (contents unspecified). Reuses an idle
+    // buffer with enough capacity when there is one.
+    Buffer acquire(size_t size);
+
+    size_t idleCount() const;
+
+private:
+    std::shared_ptr<Shared> shared_;
+};
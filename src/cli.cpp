@@ -0,0 +1,567 @@
+#include "cli.h"
+#include "commands.h"
+#include "device_cache.h"
+#include "device_resolver.h"
+#include "prg_deploy.h"
+#include "request_stats.h"
+#include "trace.h"
+#include "util.h"
+#include "version_probe.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+// Discovery results younger than this are reused by a persistent session.
+static const std::chrono::seconds kDiscoveryTtl(30);
+
+// Cached devices probed in parallel by --list.
+static const size_t kMaxCacheProbes = 8;
+
+// --trust-cache without a value: skip the startup probe for a device
+// validated within the last five minutes.
+static const int kDefaultTrustTtlSec = 300;
+
+U64Server& cli::Session::server(const U64Server::Creds& creds) {
+    std::string key = creds.address + '\n' + creds.password;
+    auto it = servers_.find(key);
+    if (it == servers_.end()) {
+        it = servers_.emplace(key, std::make_unique<U64Server>(creds)).first;
+    }
+    return *it->second;
+}
+
+void cli::Session::forgetDevice() {
+    selectedAddress.clear();
+}
+
+void cli::Session::writeStats(std::ostream& out) const {
+    out << "{\n  \"devices\": {";
+    bool first = true;
+    for (const auto& kv : servers_) {
+        if (kv.second->stats().totalRequests() == 0) continue;
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    \"" << kv.second->creds().address << "\": ";
+        kv.second->stats().writeJson(out, 4);
+    }
+    out << (first ? "}\n}\n" : "\n  }\n}\n");
+}
+
+void cli::usage(std::ostream& out) {
+    out <<
+        "u64-remote [--creds /path/creds.json] [--address http://ip] [--password pw] "
+        "[--discover] [--list] [--verbose] [--stats[=FILE]] [--no-daemon]\n"
+        "           [--incremental] [--trust-cache[=SECONDS]] [--retries N] [--hedge[=PCT]]\n"
+        "           [--max-inflight N] [--capture FILE]\n"
+        "           (file.prg | <command> [args])\n"
+        "\n"
+        "Commands:\n"
+        "  wait <addr> [--equals HEX | --not-equals HEX | --changed [LEN] |\n"
+        "              --mask HEX --value HEX] [--timeout MS]\n"
+        "      Poll memory until the condition holds (exit 0) or the timeout\n"
+        "      expires (exit 3). Addresses take $C000, 0xC000 or decimal.\n"
+        "  peek <addr> [len] | peek <start-end> [--raw] [--out FILE]\n"
+        "      Print memory as a hexdump, or write the raw bytes with --raw.\n"
+        "  dump [start-end] [--raw] [--out FILE] [--count N] [--interval MS]\n"
+        "      Like peek for large ranges (default all 64 KB); --count repeats it\n"
+        "      (0 = forever) every --interval ms.\n"
+        "  poke <addr> (<hex bytes...> | --file FILE | --hex-file FILE)\n"
+        "      Write bytes given on the command line, from a binary file or from a\n"
+        "      hex text file (whitespace, commas and # comments are ignored).\n"
+        "  run-crt <file.crt>\n"
+        "      Start a cartridge image.\n"
+        "  sidplay <file.sid> [--song N]\n"
+        "      Play a SID tune.\n"
+        "  mount <drive> <image.d64|g64|d71|g71|d81> [--mode readwrite|readonly|unlinked]\n"
+        "      Mount a disk image on drive a or b.\n"
+        "  snapshot <store> [--name NAME] [--range START-END] | snapshot <store> --list\n"
+        "      Capture memory (default all 64 KB) into a deduplicated snapshot store.\n"
+        "  restore <store> [--name NAME]\n"
+        "      Write back a snapshot (default the newest), sending only what differs.\n"
+        "  batch [script | -]\n"
+        "      Run peek/poke/run/wait lines from a file or stdin over one connection,\n"
+        "      merging neighbouring memory operations into single requests.\n"
+        "  mirror [--fps N] [--frames N] [--no-border] [--no-status]\n"
+        "      Show the C64 text screen live in the terminal until Ctrl-C, redrawing\n"
+        "      only the cells that change.\n"
+        "  run-suite <file.prg...> [--suite LIST] --marker ADDR [--pass HEX] [--timeout MS]\n"
+        "            [--collect START-END] [--attempts N] [--report FILE | --report -]\n"
+        "      Run test PRGs across every cached or discovered device (or --address),\n"
+        "      each until its marker byte turns non-zero; write a JSON report.\n"
+        "  daemon (status | stats | stop)\n"
+        "      Query, dump request stats of, or stop a running u64-remoted.\n"
+        "\n"
+        "--incremental remembers the last PRG sent to each device and, when the\n"
+        "load address and size are unchanged, patches only the changed bytes into\n"
+        "memory instead of resetting and reloading; otherwise it runs the PRG.\n"
+        "\n"
+        "Failed requests are retried up to --retries times (default 2) with\n"
+        "exponential backoff and jitter; a program run is only retried when it\n"
+        "never reached the device. --hedge sends a second copy of a version or\n"
+        "memory read that is slower than the PCT latency percentile (default 0.95)\n"
+        "of recent reads, and uses whichever answer arrives first.\n"
+        "\n"
+        "Requests in flight to a device are limited adaptively: the limit shrinks\n"
+        "when latency shows the device queueing or requests fail, and grows back\n"
+        "otherwise. Bulk reads, mirrors and watchers get only part of it, so\n"
+        "commands typed meanwhile do not queue behind them. --max-inflight caps\n"
+        "the limit (default 16; 0 turns limiting off).\n"
+        "\n"
+        "--capture writes every request of the command, with its response and\n"
+        "timing, to a binary trace FILE that u64-replay can play back.\n"
+        "\n"
+        "--trust-cache uses the fastest cached device without probing it first when\n"
+        "it answered within SECONDS (default 300), and re-checks it in the background.\n"
+        "\n"
+        "When u64-remoted is running, commands are forwarded to it over its\n"
+        "Unix socket; --no-daemon runs them in this process instead.\n"
+        "--stats prints per-endpoint request timings (DNS, connect, first byte,\n"
+        "total), byte counts and status codes as JSON on stderr, or to FILE.\n";
+}
+
+static void printDevices(std::ostream& out, const std::vector<DiscoveredService>& devs) {
+    for (size_t i = 0; i < devs.size(); ++i) {
+        out << " [" << i << "] " << devs[i].hostname
+            << " (" << devs[i].address << ":" << devs[i].port << ")";
+        if (devs[i].rttMs > 0) out << " " << devs[i].rttMs << " ms";
+        if (!devs[i].firmware.empty()) out << ", firmware " << devs[i].firmware;
+        out << "\n";
+    }
+}
+
+static std::string getCachePath() {
+    const char* home = std::getenv("HOME");
+    if (!home) home = ".";
+    return std::string(home) + "/.config/u64-remote/cache.json";
+}
+
+// Devices for run-suite: an explicit --address alone; otherwise the cached
+// devices plus whatever mDNS finds (a subnet scan if neither knows any),
+// confirmed by one concurrent version probe.
+static std::vector<std::string> fleetAddresses(const util::Creds& c, bool explicitAddr,
+                                               const std::string& cachePath, bool verbose, cli::Io& io) {
+    if (explicitAddr) return {c.address};
+
+    std::vector<std::string> urls;
+    std::map<std::string, std::string> hostnames;
+    auto add = [&](const std::string& url, const std::string& hostname) {
+        if (hostnames.emplace(url, hostname).second) urls.push_back(url);
+    };
+    if (!c.address.empty()) add(c.address, "");
+    for (const auto& d : DeviceCache::load(cachePath).ranked()) add(d.address, d.hostname);
+
+    DiscoveryService disco;
+    DiscoveryOptions dopts;
+    dopts.timeoutMs = 800;
+    for (const auto& s : disco.discover(dopts)) add(serviceUrl(s), s.hostname);
+    if (urls.empty()) {
+        if (verbose) io.out << "Nothing cached or on mDNS; subnet scanning...\n";
+        for (const auto& s : util::discoverU64(150, 256)) add(serviceUrl(s), s.hostname);
+    }
+    if (urls.empty()) throw std::runtime_error("run-suite: no devices found");
+
+    auto probes = util::probeVersions(urls, 1500, c.password);
+    std::vector<std::string> fleet;
+    DeviceCache::update(cachePath, [&](DeviceCache& dc) {
+        for (const auto& p : probes) {
+            if (!p.isUltimate) { dc.recordFailure(p.baseUrl); continue; }
+            dc.recordSuccess(p.baseUrl, hostnames[p.baseUrl], p.rttMs, p.version);
+            fleet.push_back(p.baseUrl);
+        }
+    });
+    if (fleet.empty()) throw std::runtime_error("run-suite: no device answered");
+    if (verbose) {
+        io.out << "Running on " << fleet.size() << " device(s):\n";
+        for (const auto& u : fleet) io.out << "  " << u << "\n";
+    }
+    return fleet;
+}
+
+static bool isCommand(const std::string& a) {
+    return a == "wait" || a == "daemon" || a == "run-crt" || a == "sidplay" || a == "mount" ||
+           a == "snapshot" || a == "restore" || a == "batch" || a == "mirror" ||
+           a == "run-suite" || a == "peek" || a == "poke" || a == "dump";
+}
+
+// Global options followed by a value; run() parses the same set.
+static bool takesValue(const std::string& a) {
+    return a == "--creds" || a == "--address" || a == "--password" || a == "--retries" ||
+           a == "--max-inflight" || a == "--capture";
+}
+
+size_t cli::commandIndex(const std::vector<std::string>& args) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (takesValue(args[i])) ++i;
+        else if (isCommand(args[i])) return i;
+    }
+    return args.size();
+}
+
+static int cmdDaemon(cli::Session& session, const std::vector<std::string>& args, cli::Io& io) {
+    std::string sub = args.empty() ? "status" : args[0];
+    if (!session.persistent) {
+        io.out << "No daemon running.\n";
+        return sub == "status" ? 1 : 0;
+    }
+    if (sub == "status") {
+        io.out << "u64-remoted: " << session.commandsRun << " commands served\n";
+        io.out << "Selected device: " << (session.selectedAddress.empty() ? "(none)" : session.selectedAddress) << "\n";
+        io.out << "Discovered devices: " << session.discovered.size() << "\n";
+        return 0;
+    }
+    if (sub == "stats") {
+        session.writeStats(io.out);
+        return 0;
+    }
+    if (sub == "stop") {
+        session.stopRequested = true;
+        io.out << "Stopping.\n";
+        return 0;
+    }
+    throw std::runtime_error("daemon: unknown subcommand: " + sub);
+}
+
+int cli::run(const std::vector<std::string>& args, Session& session, Io& io) {
+    session.commandsRun++;
+    bool verbose = false;
+    bool stats = false;
+    std::string statsPath;
+
+    // Dumps the session's request stats once the command has finished.
+    struct StatsDump {
+        const Session& session;
+        Io& io;
+        const bool& enabled;
+        const std::string& path;
+        ~StatsDump() {
+            if (!enabled) return;
+            if (path.empty()) { session.writeStats(io.err); return; }
+            std::ofstream f(path);
+            if (f) session.writeStats(f);
+            else io.err << "Error: cannot write stats to " << path << "\n";
+        }
+    } statsDump{session, io, stats, statsPath};
+
+    try {
+        std::string credsPath;
+        std::string overrideAddr;
+        std::string overridePw;
+        bool discover = false;
+        bool listOnly = false;
+        bool incremental = false;
+        int trustTtlSec = 0;
+        RetryPolicy retry;
+        ConcurrencyGovernor::Options governor;
+        std::string capturePath;
+        std::string prgPath;
+        std::string command;
+        std::vector<std::string> commandArgs;
+
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string& a = args[i];
+            bool hasNext = i + 1 < args.size();
+            if (a == "--creds" && hasNext) credsPath = args[++i];
+            else if (a == "--address" && hasNext) overrideAddr = args[++i];
+            else if (a == "--password" && hasNext) overridePw = args[++i];
+            else if (a == "--discover") discover = true;
+            else if (a == "--list") listOnly = true;
+            else if (a == "--incremental") incremental = true;
+            else if (a == "--trust-cache") trustTtlSec = kDefaultTrustTtlSec;
+            else if (a.rfind("--trust-cache=", 0) == 0) trustTtlSec = std::stoi(a.substr(14));
+            else if (a == "--retries" && hasNext) retry.maxAttempts = 1 + static_cast<int>(util::parseNumber(args[++i]));
+            else if (a == "--hedge") retry.hedge = true;
+            else if (a.rfind("--hedge=", 0) == 0) { retry.hedge = true; retry.hedgePercentile = std::stod(a.substr(8)); }
+            else if (a == "--max-inflight" && hasNext) governor.maxLimit = static_cast<int>(util::parseNumber(args[++i]));
+            else if (a == "--capture" && hasNext) capturePath = args[++i];
+            else if (a == "--verbose") verbose = true;
+            else if (a == "--stats") stats = true;
+            else if (a.rfind("--stats=", 0) == 0) { stats = true; statsPath = a.substr(8); }
+            else if (a == "--no-daemon") continue;
+            else if (a == "-h" || a == "--help") { usage(io.out); return 0; }
+            else if (!a.empty() && a[0] == '-') { throw std::runtime_error("Unknown option: " + a); }
+            else if (isCommand(a)) {
+                // Everything after the command name belongs to the command.
+                command = a;
+                commandArgs.assign(args.begin() + i + 1, args.end());
+                break;
+            }
+            else { prgPath = a; }
+        }
+
+        if (command == "daemon") return cmdDaemon(session, commandArgs, io);
+
+        // --capture traces the command's requests; the session's servers
+        // stop capturing when it finishes.
+        struct Capture {
+            Io& io;
+            std::shared_ptr<trace::Writer> writer;
+            std::vector<U64Server*> servers;
+            void attach(U64Server& s) {
+                if (!writer) return;
+                s.setCapture(writer);
+                servers.push_back(&s);
+            }
+            ~Capture() {
+                for (U64Server* s : servers) s->setCapture(nullptr);
+                if (!writer) return;
+                try { writer->flush(); }
+                catch (const std::exception& e) { io.err << "Error: " << e.what() << "\n"; }
+            }
+        } capture{io, nullptr, {}};
+        if (!capturePath.empty()) capture.writer = std::make_shared<trace::Writer>(capturePath);
+
+        if (!listOnly && prgPath.empty() && command.empty()) {
+            usage(io.out);
+            return 2;
+        }
+
+        util::Creds c;
+        bool loaded = false;
+        auto tryLoad = [&](const std::string& p) -> bool {
+            try { c = util::loadCreds(p); loaded = true; return true; }
+            catch (...) { return false; }
+        };
+
+        if (!credsPath.empty()) {
+            if (!tryLoad(credsPath)) throw std::runtime_error("Failed to load creds from: " + credsPath);
+        } else {
+            (void)tryLoad("creds.json");
+            if (!loaded) (void)tryLoad("../json_examples/creds.json");
+            if (!loaded) (void)tryLoad("json_examples/creds.json");
+        }
+
+        if (!overrideAddr.empty()) {
+            c.address = overrideAddr;
+            if (c.address.find("http://") != 0 && c.address.find("https://") != 0)
+                c.address = "http://" + c.address;
+        }
+        if (!overridePw.empty()) c.password = overridePw;
+
+        std::vector<DiscoveredService> devs;
+        std::string cachePath = getCachePath();
+
+        if (command == "run-suite") {
+            std::vector<U64Server*> fleet;
+            for (const auto& address : fleetAddresses(c, !overrideAddr.empty(), cachePath, verbose, io)) {
+                U64Server::Creds sc;
+                sc.address = address;
+                sc.password = c.password;
+                U64Server& server = session.server(sc);
+                server.setRetryPolicy(retry);
+                server.setConcurrency(governor);
+                capture.attach(server);
+                fleet.push_back(&server);
+            }
+            return cmdRunSuite(fleet, commandArgs, io.out);
+        }
+
+        // A device this session already validated needs no new round trip.
+        bool haveDevice = false;
+        if (overrideAddr.empty() && !discover && !listOnly && !session.selectedAddress.empty()) {
+            c.address = session.selectedAddress;
+            haveDevice = true;
+            if (verbose) io.out << "Using session device: " << c.address << "\n";
+        }
+
+        // --list reports the healthy cached devices, all probed at once.
+        if (listOnly && !discover) {
+            std::vector<CachedDevice> ranked = DeviceCache::load(cachePath).ranked();
+            if (ranked.size() > kMaxCacheProbes) ranked.resize(kMaxCacheProbes);
+            if (!ranked.empty()) {
+                std::vector<std::string> urls;
+                for (const auto& d : ranked) urls.push_back(d.address);
+                if (verbose) io.out << "Checking " << urls.size() << " cached device(s)\n";
+
+                auto probes = util::probeVersions(urls, 1500, c.password);
+                DeviceCache cache = DeviceCache::update(cachePath, [&](DeviceCache& dc) {
+                    for (const auto& p : probes) {
+                        if (p.isUltimate) dc.recordSuccess(p.baseUrl, "", p.rttMs, p.version);
+                        else dc.recordFailure(p.baseUrl);
+                    }
+                });
+                bool any = false;
+                for (const auto& p : probes) {
+                    if (!p.isUltimate) continue;
+                    if (!any) io.out << "Cached devices:\n";
+                    any = true;
+                    const CachedDevice* d = cache.find(p.baseUrl);
+                    io.out << "  " << (d && !d->hostname.empty() ? d->hostname : "?") << " (" << p.baseUrl
+                           << ") " << p.rttMs << " ms" << (p.version.empty() ? "" : ", firmware " + p.version) << "\n";
+                }
+                if (any) return 0;
+            }
+        }
+
+        // An explicit --address always wins. Otherwise the cached devices, mDNS
+        // and a subnet scan race and the first confirmed device wins; with an
+        // address from the creds file only the cache takes part.
+        bool raced = false;
+        if (!haveDevice && overrideAddr.empty() && !discover && !listOnly) {
+            ResolveOptions ropts;
+            ropts.cachePath = cachePath;
+            ropts.password = c.password;
+            ropts.useDiscovery = c.address.empty();
+            ropts.trustTtlSec = trustTtlSec;
+            session.resolver = std::make_unique<DeviceResolver>(ropts);
+            auto outcome = session.resolver->resolve([&](const std::string& msg) {
+                if (verbose) io.out << msg << "\n";
+            });
+            if (outcome.found) {
+                c.address = outcome.device.address;
+            } else if (ropts.useDiscovery) {
+                raced = true;
+                devs = outcome.candidates;
+                session.discovered = devs;
+                session.discoveredAt = std::chrono::steady_clock::now();
+            }
+        }
+
+        if (!haveDevice && (discover || c.address.empty() || listOnly)) {
+            auto now = std::chrono::steady_clock::now();
+            if (raced) {
+                // The resolver already browsed and scanned; devs holds what it confirmed.
+            } else if (!discover && session.persistent && !session.discovered.empty() &&
+                now - session.discoveredAt < kDiscoveryTtl) {
+                devs = session.discovered;
+                if (verbose) io.out << "Using discovery results from " <<
+                    std::chrono::duration_cast<std::chrono::seconds>(now - session.discoveredAt).count() << " s ago\n";
+            } else {
+                if (verbose) io.out << "Discovering devices via mDNS...\n";
+
+                DiscoveryService disco;
+                DiscoveryOptions dopts;
+                dopts.timeoutMs = 800;
+                dopts.confirm = true;
+                dopts.probeTimeoutMs = 1500;
+                dopts.password = c.password;
+                devs = disco.discover(dopts, [&](const DiscoveredService& s) {
+                    if (verbose) io.out << "  found " << s.hostname << " (" << s.address << ")"
+                                        << (s.firmware.empty() ? "" : ", firmware " + s.firmware) << "\n";
+                });
+
+                if (devs.empty()) {
+                    if (verbose) io.out << "mDNS failed; subnet scanning...\n";
+                    devs = util::discoverU64(150, 256);
+                }
+                session.discovered = devs;
+                session.discoveredAt = now;
+            }
+
+            if (devs.empty()) {
+                if (listOnly) { io.out << "No devices found.\n"; return 0; }
+                throw std::runtime_error("No devices discovered on network.");
+            }
+
+            if (listOnly) {
+                io.out << "Discovered devices:\n";
+                printDevices(io.out, devs);
+                return 0;
+            }
+
+            // Several devices are only ambiguous when the cache has no healthy
+            // history for any of them; otherwise the fastest known one wins.
+            int idx = -1;
+            if (devs.size() == 1) idx = 0;
+            if (idx < 0) {
+                DeviceCache cache = DeviceCache::load(cachePath);
+                double bestRtt = 0;
+                for (size_t i = 0; i < devs.size(); ++i) {
+                    const CachedDevice* d = cache.find(serviceUrl(devs[i]));
+                    if (!d || d->failures >= DeviceCache::kMaxFailures || d->rttMs <= 0) continue;
+                    if (idx < 0 || d->rttMs < bestRtt) { idx = static_cast<int>(i); bestRtt = d->rttMs; }
+                }
+                if (idx >= 0 && verbose) io.out << "Preferring previously used device " << devs[idx].address << "\n";
+            }
+            if (idx < 0) {
+                if (!io.interactive) {
+                    printDevices(io.err, devs);
+                    throw std::runtime_error("Several devices found; pass --address to choose one.");
+                }
+                io.out << "Select device index:\n";
+                printDevices(io.out, devs);
+                io.out.flush();
+                if (!(io.in >> idx)) throw std::runtime_error("Invalid index selection");
+            }
+            if (idx < 0 || static_cast<size_t>(idx) >= devs.size())
+                throw std::runtime_error("Invalid index selection");
+
+            c.address = serviceUrl(devs[idx]);
+            // Discovery already confirmed it; only older results need a probe.
+            util::VersionProbe probe;
+            if (devs[idx].rttMs > 0) {
+                probe.isUltimate = true;
+                probe.rttMs = devs[idx].rttMs;
+                probe.version = devs[idx].firmware;
+            } else {
+                probe = util::probeVersions({c.address}, 1500, c.password).front();
+            }
+            const std::string hostname = devs[idx].hostname;
+            DeviceCache::update(cachePath, [&](DeviceCache& dc) {
+                if (probe.isUltimate) dc.recordSuccess(c.address, hostname, probe.rttMs, probe.version);
+                else dc.recordFailure(c.address);
+            });
+            if (verbose) io.out << "Cached device: " << c.address << "\n";
+        }
+
+        if (c.password.empty() && verbose) io.err << "Warning: password is empty.\n";
+
+        U64Server::Creds sc;
+        sc.address = c.address;
+        sc.password = c.password;
+        sc.enableMessageBox = c.enableMessageBox;
+        U64Server& server = session.server(sc);
+        server.setRetryPolicy(retry);
+        server.setConcurrency(governor);
+        capture.attach(server);
+
+        int rc = 0;
+        if (command == "wait") {
+            rc = cmdWait(server, commandArgs, io.out, &session.interrupted);
+        } else if (command == "run-crt") {
+            rc = cmdRunCrt(server, commandArgs, io.out);
+        } else if (command == "sidplay") {
+            rc = cmdSidPlay(server, commandArgs, io.out);
+        } else if (command == "mount") {
+            rc = cmdMount(server, commandArgs, io.out);
+        } else if (command == "snapshot") {
+            rc = cmdSnapshot(server, commandArgs, io.out);
+        } else if (command == "restore") {
+            rc = cmdRestore(server, commandArgs, io.out);
+        } else if (command == "batch") {
+            rc = cmdBatch(server, commandArgs, io.in, io.out, &session.interrupted);
+        } else if (command == "peek") {
+            rc = cmdPeek(server, commandArgs, io.out);
+        } else if (command == "dump") {
+            rc = cmdDump(server, commandArgs, io.out, &session.interrupted);
+        } else if (command == "poke") {
+            rc = cmdPoke(server, commandArgs, io.out);
+        } else if (command == "mirror") {
+            rc = cmdMirror(server, commandArgs, io.out, &session.interrupted);
+        } else if (incremental) {
+            std::string stateDir = std::filesystem::path(cachePath).parent_path().string() + "/deploy";
+            PrgDeployer deployer(server, stateDir);
+            PrgDeployer::Result r = deployer.deploy(util::readFileBytes(prgPath));
+            if (r.incremental) {
+                io.out << "Patched " << r.bytesSent << " bytes in " << r.ranges << " writes.\n";
+            } else {
+                if (verbose) io.out << "Full reload: " << r.reason << "\n";
+                io.out << "Done.\n";
+            }
+        } else {
+            if (verbose) io.out << "Uploading PRG " << prgPath << " to " << c.address << "\n";
+
+            server.runPRGFile(prgPath);
+            io.out << "Done.\n";
+        }
+
+        if (overrideAddr.empty()) session.selectedAddress = c.address;
+        return rc;
+    }
+    catch (const std::exception& e) {
+        session.forgetDevice();
+        io.err << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "device_resolver.h"
+#include "discovery.h"
+#include "u64_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cli {
+
+struct Io {
+    std::istream& in;
+    std::ostream& out;
+    std::ostream& err;
+    bool interactive = true; // false inside the daemon: never prompt
+};
+
+// State that outlives one command. The CLI uses a fresh Session per process;
+// u64-remoted keeps one for its whole lifetime, so device selection,
+// discovery results and keep-alive connections carry over between commands.
+class Session {
+public:
+    // Server for these creds, created on first use and reused afterwards.
+    U64Server& server(const U64Server::Creds& creds);
+
+    // Drops the selected device so the next command validates again.
+    void forgetDevice();
+
+    // Request stats of every device used by this session, as JSON.
+    void writeStats(std::ostream& out) const;
+
+    bool persistent = false;       // running inside u64-remoted
+    bool stopRequested = false;    // set by 'daemon stop'
+    // Set when u64-remoted shuts down; wait, dump, batch and mirror check
+    // it and return instead of keeping the daemon up.
+    std::atomic<bool> interrupted{false};
+
+    std::string selectedAddress;   // device validated by an earlier command
+    std::vector<DiscoveredService> discovered;
+    std::chrono::steady_clock::time_point discoveredAt;
+    size_t commandsRun = 0;
+
+    // The last command's resolver. Kept past the command so that a
+    // --trust-cache revalidation runs alongside it rather than before it.
+    std::unique_ptr<DeviceResolver> resolver;
+
+private:
+    std::map<std::string, std::unique_ptr<U64Server>> servers_;
+};
+
+void usage(std::ostream& out);
+
+// Position of the subcommand (batch, peek, ...) in a command line: the
+// first one after the global options, or args.size() if there is none.
+size_t commandIndex(const std::vector<std::string>& args);
+
+// Parses and runs one u64-remote command line (without argv[0]).
+// Returns the process exit code; errors are reported on io.err.
+int run(const std::vector<std::string>& args, Session& session, Io& io);
+
+} // namespace cli
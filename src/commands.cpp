@@ -0,0 +1,488 @@
+#include "commands.h"
+#include "batch.h"
+#include "hex.h"
+#include "memory_watch.h"
+#include "screen_mirror.h"
+#include "snapshot.h"
+#include "suite_runner.h"
+#include "util.h"
+
+#include <atomic>
+#include <csignal>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+static uint16_t parseAddress(const std::string& s) {
+    uint32_t v = util::parseNumber(s);
+    if (v > 0xFFFF) throw std::runtime_error("Address out of range: " + s);
+    return static_cast<uint16_t>(v);
+}
+
+// ---------------------
+// wait
+// ---------------------
+int cmdWait(U64Server& server, const std::vector<std::string>& args, std::ostream& out,
+            const std::atomic<bool>* stop) {
+    if (args.empty()) throw std::runtime_error("wait: missing address");
+
+    uint16_t address = parseAddress(args[0]);
+    int timeoutMs = -1;
+    std::vector<uint8_t> mask, value;
+    MemoryWatcher::Watch w = MemoryWatcher::changed(address, 1);
+    bool haveCond = false;
+
+    auto setCond = [&](MemoryWatcher::Watch nw) {
+        if (haveCond) throw std::runtime_error("wait: only one condition may be given");
+        haveCond = true;
+        w = std::move(nw);
+    };
+
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasNext = i + 1 < args.size();
+        if (a == "--equals" && hasNext) setCond(MemoryWatcher::equals(address, hex::decode(args[++i])));
+        else if (a == "--not-equals" && hasNext) setCond(MemoryWatcher::notEquals(address, hex::decode(args[++i])));
+        else if (a == "--changed") {
+            uint32_t len = 1;
+            if (hasNext && args[i + 1].rfind("--", 0) != 0) len = util::parseNumber(args[++i]);
+            setCond(MemoryWatcher::changed(address, len));
+        }
+        else if (a == "--mask" && hasNext) mask = hex::decode(args[++i]);
+        else if (a == "--value" && hasNext) value = hex::decode(args[++i]);
+        else if (a == "--timeout" && hasNext) timeoutMs = static_cast<int>(util::parseNumber(args[++i]));
+        else throw std::runtime_error("wait: unknown argument: " + a);
+    }
+
+    if (!mask.empty() || !value.empty()) {
+        if (mask.empty() || value.empty()) throw std::runtime_error("wait: --mask and --value go together");
+        setCond(MemoryWatcher::maskEquals(address, mask, value));
+    }
+
+    MemoryWatcher::Options wopts;
+    wopts.stop = stop;
+    MemoryWatcher watcher(server, wopts);
+    int id = watcher.add(w);
+    int hit = watcher.waitAny(timeoutMs);
+
+    if (hit < 0 && stop && stop->load()) throw std::runtime_error("wait: interrupted");
+    if (hit < 0) {
+        out << "timeout (" << hex::encodeSpaced(watcher.current(id)) << ")\n";
+        return 3;
+    }
+    out << "matched (" << hex::encodeSpaced(watcher.current(id)) << ") after " << watcher.polls() << " polls\n";
+    return 0;
+}
+
+// ---------------------
+// peek / dump / poke
+// ---------------------
+struct MemRange {
+    uint16_t address = 0;
+    uint32_t length = 0;
+};
+
+// "START-END" (inclusive) or a single address.
+static MemRange parseRange(const std::string& what, const std::string& s) {
+    MemRange r;
+    size_t dash = s.find('-');
+    r.address = parseAddress(s.substr(0, dash));
+    if (dash == std::string::npos) {
+        r.length = 1;
+        return r;
+    }
+    uint16_t end = parseAddress(s.substr(dash + 1));
+    if (end < r.address) throw std::runtime_error(what + ": empty range " + s);
+    r.length = static_cast<uint32_t>(end - r.address) + 1;
+    return r;
+}
+
+static void checkRange(const std::string& what, uint32_t address, uint32_t length) {
+    if (length == 0) throw std::runtime_error(what + ": length must be > 0");
+    if (address + length > 0x10000) throw std::runtime_error(what + ": range exceeds 64 KB address space");
+}
+
+// Options shared by peek and dump.
+struct ReadOutput {
+    bool raw = false;
+    std::string path;
+};
+
+static bool parseReadOutput(ReadOutput& o, const std::vector<std::string>& args, size_t& i) {
+    if (args[i] == "--raw") o.raw = true;
+    else if ((args[i] == "--out" || args[i] == "-o") && i + 1 < args.size()) o.path = args[++i];
+    else return false;
+    return true;
+}
+
+static std::vector<uint8_t> readRange(U64Server& server, const MemRange& r) {
+    // Larger reads go out as several pipelined requests.
+    const uint32_t single = U64Server::BulkReadOptions().chunkSize;
+    return r.length > single ? server.peekMemoryBulk(r.address, r.length) : server.peekMemory(r.address, r.length);
+}
+
+static void writeRange(std::ostream& out, const ReadOutput& o, const MemRange& r, const std::vector<uint8_t>& bytes) {
+    if (o.raw) out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    else hex::writeDump(out, bytes.data(), bytes.size(), r.address);
+}
+
+static int readCommand(U64Server& server, const std::string& what, const MemRange& r, const ReadOutput& o,
+                       uint64_t count, int intervalMs, std::ostream& out, const std::atomic<bool>* stop) {
+    checkRange(what, r.address, r.length);
+    std::ofstream file;
+    if (!o.path.empty()) {
+        file.open(o.path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error(what + ": cannot write " + o.path);
+    }
+    std::ostream& dst = o.path.empty() ? out : file;
+    for (uint64_t n = 0; count == 0 || n < count; ++n) {
+        if (n && intervalMs > 0) std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        if (stop && stop->load()) throw std::runtime_error(what + ": interrupted");
+        writeRange(dst, o, r, readRange(server, r));
+        dst.flush();
+        if (!dst) throw std::runtime_error(what + ": write failed");
+    }
+    if (!o.path.empty()) {
+        out << "Wrote " << r.length * (count ? count : 1) << " bytes to " << o.path << ".\n";
+    }
+    return 0;
+}
+
+int cmdPeek(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    std::vector<std::string> pos;
+    ReadOutput o;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (parseReadOutput(o, args, i)) continue;
+        if (args[i].rfind("--", 0) == 0) throw std::runtime_error("peek: unknown argument: " + args[i]);
+        pos.push_back(args[i]);
+    }
+    if (pos.empty() || pos.size() > 2) throw std::runtime_error("peek: expected <addr> [len] or <start-end>");
+    MemRange r = parseRange("peek", pos[0]);
+    if (pos.size() == 2) {
+        if (pos[0].find('-') != std::string::npos) throw std::runtime_error("peek: a range takes no length");
+        r.length = util::parseNumber(pos[1]);
+    }
+    return readCommand(server, "peek", r, o, 1, 0, out, nullptr);
+}
+
+int cmdDump(U64Server& server, const std::vector<std::string>& args, std::ostream& out,
+            const std::atomic<bool>* stop) {
+    MemRange r{0x0000, 0x10000};
+    ReadOutput o;
+    uint64_t count = 1;
+    int intervalMs = 0;
+    bool haveRange = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasNext = i + 1 < args.size();
+        if (parseReadOutput(o, args, i)) continue;
+        if (a == "--count" && hasNext) count = util::parseNumber(args[++i]);
+        else if (a == "--interval" && hasNext) intervalMs = static_cast<int>(util::parseNumber(args[++i]));
+        else if (!haveRange && a.rfind("--", 0) != 0) { r = parseRange("dump", a); haveRange = true; }
+        else throw std::runtime_error("dump: unknown argument: " + a);
+    }
+    return readCommand(server, "dump", r, o, count, intervalMs, out, stop);
+}
+
+int cmdPoke(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    if (args.empty()) throw std::runtime_error("poke: missing address");
+    uint16_t address = parseAddress(args[0]);
+    std::vector<uint8_t> data;
+    std::string text;
+    bool fromFile = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasNext = i + 1 < args.size();
+        if (a == "--file" && hasNext) {
+            data = util::readFileBytes(args[++i]);
+            fromFile = true;
+        } else if (a == "--hex-file" && hasNext) {
+            std::ifstream f(args[++i], std::ios::binary);
+            if (!f) throw std::runtime_error("poke: cannot open " + args[i]);
+            std::string file((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+            data = hex::decode(file);
+            fromFile = true;
+        } else if (a.rfind("--", 0) != 0) {
+            text += a;
+            text += ' ';
+        } else {
+            throw std::runtime_error("poke: unknown argument: " + a);
+        }
+    }
+    if (fromFile && !text.empty()) throw std::runtime_error("poke: give hex bytes or a file, not both");
+    if (!fromFile) data = hex::decode(text);
+    checkRange("poke", address, static_cast<uint32_t>(data.size()));
+
+    server.pokeMemory(address, data);
+    char where[8];
+    std::snprintf(where, sizeof(where), "$%04x", address);
+    out << "Wrote " << data.size() << " bytes at " << where << ".\n";
+    return 0;
+}
+
+// ---------------------
+// run-crt / sidplay / mount
+// ---------------------
+int cmdRunCrt(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    if (args.size() != 1) throw std::runtime_error("run-crt: expected one cartridge file");
+    server.runCRTFile(args[0]);
+    out << "Done.\n";
+    return 0;
+}
+
+int cmdSidPlay(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    std::string path;
+    int song = -1;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "--song" && i + 1 < args.size()) song = static_cast<int>(util::parseNumber(args[++i]));
+        else if (path.empty() && a.rfind("--", 0) != 0) path = a;
+        else throw std::runtime_error("sidplay: unknown argument: " + a);
+    }
+    if (path.empty()) throw std::runtime_error("sidplay: missing SID file");
+    server.playSIDFile(path, song);
+    out << "Done.\n";
+    return 0;
+}
+
+int cmdMount(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    std::vector<std::string> pos;
+    std::string mode = "readwrite";
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "--mode" && i + 1 < args.size()) mode = args[++i];
+        else if (a.rfind("--", 0) != 0) pos.push_back(a);
+        else throw std::runtime_error("mount: unknown argument: " + a);
+    }
+    if (pos.size() != 2) throw std::runtime_error("mount: expected <drive> <image>");
+    server.mountImageFile(pos[0], pos[1], mode);
+    out << "Mounted " << pos[1] << " on drive " << pos[0] << ".\n";
+    return 0;
+}
+
+// ---------------------
+// snapshot / restore
+// ---------------------
+int cmdSnapshot(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    std::string path, name;
+    uint32_t start = 0, end = 0xFFFF;
+    bool list = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasNext = i + 1 < args.size();
+        if (a == "--name" && hasNext) name = args[++i];
+        else if (a == "--list") list = true;
+        else if (a == "--range" && hasNext) {
+            const std::string& r = args[++i];
+            size_t dash = r.find('-');
+            if (dash == std::string::npos) throw std::runtime_error("snapshot: --range takes START-END");
+            start = parseAddress(r.substr(0, dash));
+            end = parseAddress(r.substr(dash + 1));
+            if (end < start) throw std::runtime_error("snapshot: empty range");
+        }
+        else if (path.empty() && a.rfind("--", 0) != 0) path = a;
+        else throw std::runtime_error("snapshot: unknown argument: " + a);
+    }
+    if (path.empty()) throw std::runtime_error("snapshot: missing store file");
+
+    SnapshotStore store = SnapshotStore::load(path);
+    if (list) {
+        for (const auto& s : store.snapshots()) {
+            out << s.name << "  $" << std::hex << std::setfill('0') << std::setw(4) << s.address()
+                << "-$" << std::setw(4) << (s.address() + s.length() - 1) << std::dec
+                << "  " << s.pages.size() << " pages  " << s.createdUnix << "\n";
+        }
+        out << store.snapshots().size() << " snapshots, " << store.uniquePages() << " unique pages\n";
+        return 0;
+    }
+
+    // Whole pages only: widen the range outward to page boundaries.
+    const uint32_t page = SnapshotStore::kPageSize;
+    start -= start % page;
+    end = end - end % page + page;
+    if (name.empty()) {
+        for (size_t n = store.snapshots().size() + 1; name.empty() || store.find(name); ++n) {
+            name = "snap" + std::to_string(n);
+        }
+    }
+
+    size_t before = store.uniquePages();
+    auto bytes = server.peekMemoryBulk(static_cast<uint16_t>(start), end - start);
+    const auto& s = store.add(name, static_cast<uint16_t>(start), bytes);
+    store.save(path);
+    out << "Saved " << s.name << ": " << s.pages.size() << " pages, "
+        << store.uniquePages() - before << " new; store holds "
+        << store.snapshots().size() << " snapshots in " << store.uniquePages() << " unique pages.\n";
+    return 0;
+}
+
+int cmdRestore(U64Server& server, const std::vector<std::string>& args, std::ostream& out) {
+    std::string path, name;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "--name" && i + 1 < args.size()) name = args[++i];
+        else if (path.empty() && a.rfind("--", 0) != 0) path = a;
+        else throw std::runtime_error("restore: unknown argument: " + a);
+    }
+    if (path.empty()) throw std::runtime_error("restore: missing store file");
+
+    SnapshotStore store = SnapshotStore::load(path);
+    const SnapshotStore::Snapshot* s = store.find(name);
+    if (!s) throw std::runtime_error("restore: no snapshot " + (name.empty() ? std::string("in ") + path : name));
+
+    RestoreResult r = restoreSnapshot(server, store, *s);
+    out << "Restored " << s->name << ": " << r.pagesDiffering << "/" << r.pagesCompared
+        << " pages differed, " << r.bytesSent << " bytes in " << r.requests << " requests.\n";
+    return 0;
+}
+
+// ---------------------
+// batch
+// ---------------------
+int cmdBatch(U64Server& server, const std::vector<std::string>& args, std::istream& in, std::ostream& out,
+             const std::atomic<bool>* stop) {
+    if (args.size() > 1) throw std::runtime_error("batch: expected at most one script file");
+    BatchRunner::Options opts;
+    opts.stop = stop;
+    BatchRunner runner(server, opts);
+    if (args.empty() || args[0] == "-") return runner.run(in, out);
+
+    std::ifstream script(args[0]);
+    if (!script) throw std::runtime_error("batch: cannot open " + args[0]);
+    return runner.run(script, out);
+}
+
+// ---------------------
+// mirror
+// ---------------------
+static std::atomic<bool>* mirrorStop = nullptr;
+
+static void onMirrorSignal(int) { if (mirrorStop) *mirrorStop = true; }
+
+int cmdMirror(U64Server& server, const std::vector<std::string>& args, std::ostream& out,
+              std::atomic<bool>* stop) {
+    ScreenMirror::Options opts;
+    uint64_t frames = 0;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasNext = i + 1 < args.size();
+        if (a == "--fps" && hasNext) {
+            uint32_t fps = util::parseNumber(args[++i]);
+            if (fps == 0) throw std::runtime_error("mirror: --fps must be > 0");
+            opts.minIntervalMs = static_cast<int>(1000 / fps);
+        }
+        else if (a == "--frames" && hasNext) frames = util::parseNumber(args[++i]);
+        else if (a == "--no-border") opts.border = false;
+        else if (a == "--no-status") opts.status = false;
+        else throw std::runtime_error("mirror: unknown argument: " + a);
+    }
+
+    ScreenMirror mirror(server, out, opts);
+    std::atomic<bool> local{false};
+    if (!stop) stop = &local;
+    // Ctrl-C ends the mirror, unless the process already handles SIGINT
+    // itself: u64-remoted stops its commands through stop.
+    struct sigaction current{};
+    sigaction(SIGINT, nullptr, &current);
+    const bool ownSigint = current.sa_handler == SIG_DFL;
+    void (*previous)(int) = SIG_DFL;
+    if (ownSigint) {
+        mirrorStop = stop;
+        previous = std::signal(SIGINT, onMirrorSignal);
+    }
+    auto restore = [&] {
+        if (!ownSigint) return;
+        std::signal(SIGINT, previous);
+        mirrorStop = nullptr;
+    };
+    mirror.begin();
+    try {
+        mirror.run(*stop, frames);
+    } catch (...) {
+        mirror.end();
+        restore();
+        throw;
+    }
+    mirror.end();
+    restore();
+    return 0;
+}
+
+// ---------------------
+// run-suite
+// ---------------------
+int cmdRunSuite(const std::vector<U64Server*>& devices, const std::vector<std::string>& args, std::ostream& out) {
+    SuiteRunner::Options opts;
+    std::vector<std::string> prgs;
+    std::string reportPath;
+    bool haveMarker = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasNext = i + 1 < args.size();
+        if (a == "--marker" && hasNext) { opts.marker = parseAddress(args[++i]); haveMarker = true; }
+        else if (a == "--pass" && hasNext) {
+            std::vector<uint8_t> v = hex::decode(args[++i]);
+            if (v.size() != 1) throw std::runtime_error("run-suite: --pass takes one hex byte");
+            opts.pass = v[0];
+        }
+        else if (a == "--timeout" && hasNext) opts.timeoutMs = static_cast<int>(util::parseNumber(args[++i]));
+        else if (a == "--attempts" && hasNext) opts.maxAttempts = static_cast<int>(util::parseNumber(args[++i]));
+        else if (a == "--report" && hasNext) reportPath = args[++i];
+        else if (a == "--collect" && hasNext) {
+            const std::string& r = args[++i];
+            size_t dash = r.find('-');
+            if (dash == std::string::npos) throw std::runtime_error("run-suite: --collect takes START-END");
+            uint16_t start = parseAddress(r.substr(0, dash));
+            uint16_t end = parseAddress(r.substr(dash + 1));
+            if (end < start) throw std::runtime_error("run-suite: empty collect range");
+            opts.collectAddress = start;
+            opts.collectLength = static_cast<uint32_t>(end - start) + 1;
+        }
+        else if (a == "--suite" && hasNext) {
+            // One PRG per line; blank lines and # comments are skipped.
+            std::ifstream list(args[++i]);
+            if (!list) throw std::runtime_error("run-suite: cannot open " + args[i]);
+            std::string line;
+            while (std::getline(list, line)) {
+                size_t b = line.find_first_not_of(" \t\r");
+                if (b == std::string::npos || line[b] == '#') continue;
+                size_t e = line.find_last_not_of(" \t\r");
+                prgs.push_back(line.substr(b, e - b + 1));
+            }
+        }
+        else if (a.rfind("--", 0) != 0) prgs.push_back(a);
+        else throw std::runtime_error("run-suite: unknown argument: " + a);
+    }
+    if (!haveMarker) throw std::runtime_error("run-suite: missing --marker");
+    if (prgs.empty()) throw std::runtime_error("run-suite: no PRGs given");
+
+    // With the report on stdout, progress lines would corrupt it.
+    bool reportToOut = reportPath == "-";
+    SuiteRunner runner(devices, opts);
+    SuiteRunner::Report report = runner.run(prgs, [&](const SuiteRunner::Result& r) {
+        if (reportToOut) return;
+        out << SuiteRunner::statusName(r.status) << "  " << r.prg << "  (" << r.device << ", "
+            << static_cast<long>(r.ms) << " ms";
+        if (r.status == SuiteRunner::Status::Fail) out << ", marker " << static_cast<int>(r.marker);
+        if (!r.error.empty()) out << ", " << r.error;
+        out << ")\n";
+        out.flush();
+    });
+
+    if (reportToOut) {
+        report.writeJson(out);
+    } else {
+        if (!reportPath.empty()) {
+            std::ofstream f(reportPath);
+            if (!f) throw std::runtime_error("run-suite: cannot write " + reportPath);
+            report.writeJson(f);
+        }
+        out << report.count(SuiteRunner::Status::Pass) << "/" << report.results.size() << " passed on "
+            << devices.size() << " device(s) in " << static_cast<long>(report.wallMs) << " ms\n";
+    }
+    return report.count(SuiteRunner::Status::Pass) == report.results.size() ? 0 : 1;
+}
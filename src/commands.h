@@ -0,0 +1,63 @@
+#pragma once
+#include "u64_server.h"
+#include <atomic>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Subcommands that run against an already selected device.
+// Each takes the arguments after the subcommand name and returns the exit code.
+
+// wait <addr> [--equals HEX | --not-equals HEX | --changed [LEN] |
+//              --mask HEX --value HEX] [--timeout MS]
+// Exit code 0 when the condition holds, 3 on timeout.
+//
+// wait, dump, batch and mirror can run indefinitely; they return early,
+// wait and dump with an error, once stop is set (u64-remoted shutting down).
+int cmdWait(U64Server& server, const std::vector<std::string>& args, std::ostream& out,
+            const std::atomic<bool>* stop = nullptr);
+
+// run-crt <file.crt>
+int cmdRunCrt(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
+
+// sidplay <file.sid> [--song N]
+int cmdSidPlay(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
+
+// mount <drive> <image.d64|g64|d71|g71|d81> [--mode readwrite|readonly|unlinked]
+int cmdMount(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
+
+// snapshot <store> [--name NAME] [--range START-END] | snapshot <store> --list
+int cmdSnapshot(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
+
+// restore <store> [--name NAME]
+int cmdRestore(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
+
+// batch [script | -]
+// Runs peek/poke/run/wait lines from a file or stdin (see batch.h).
+int cmdBatch(U64Server& server, const std::vector<std::string>& args, std::istream& in, std::ostream& out,
+             const std::atomic<bool>* stop = nullptr);
+
+// mirror [--fps N] [--frames N] [--no-border] [--no-status]
+// Shows the text screen live in the terminal until Ctrl-C (see screen_mirror.h).
+int cmdMirror(U64Server& server, const std::vector<std::string>& args, std::ostream& out,
+              std::atomic<bool>* stop = nullptr);
+
+// run-suite <file.prg...> [--suite LIST] --marker ADDR [--pass HEX] [--timeout MS]
+//           [--collect START-END] [--attempts N] [--report FILE | --report -]
+// Runs the PRGs across devices (see suite_runner.h). Exit code 0 when every
+// job passed, 1 otherwise.
+int cmdRunSuite(const std::vector<U64Server*>& devices, const std::vector<std::string>& args, std::ostream& out);
+
+// peek <addr> [len] | peek <start-end>  [--raw] [--out FILE]
+// Reads memory and prints a hexdump, or the raw bytes with --raw.
+int cmdPeek(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
+
+// dump [start-end] [--raw] [--out FILE] [--count N] [--interval MS]
+// Like peek, default all 64 KB, read with pipelined requests. --count
+// repeats the dump (0 = until interrupted) every --interval ms.
+int cmdDump(U64Server& server, const std::vector<std::string>& args, std::ostream& out,
+            const std::atomic<bool>* stop = nullptr);
+
+// poke <addr> (<hex bytes...> | --file FILE | --hex-file FILE)
+int cmdPoke(U64Server& server, const std::vector<std::string>& args, std::ostream& out);
@@ -0,0 +1,211 @@
+#include "concurrency_governor.h"
+#include "request_stats.h"
+
+#include <algorithm>
+
+namespace {
+
+thread_local RequestPriority tPriority = RequestPriority::Interactive;
+
+// Weights of a new sample in the recent RTT and in the baseline.
+constexpr double kRecentWeight = 0.3;
+constexpr double kBaselineWeight = 0.2;
+
+} // namespace
+
+const char* priorityName(RequestPriority p) {
+    switch (p) {
+    case RequestPriority::Interactive: return "interactive";
+    case RequestPriority::Bulk: return "bulk";
+    case RequestPriority::Background: return "background";
+    }
+    return "interactive";
+}
+
+ConcurrencyGovernor::ConcurrencyGovernor(RequestStats* stats)
+    : ConcurrencyGovernor(Options(), stats) {}
+
+ConcurrencyGovernor::ConcurrencyGovernor(Options opts, RequestStats* stats)
+    : stats_(stats), limit_(0) {
+    configure(opts);
+}
+
+void ConcurrencyGovernor::configure(const Options& opts) {
+    std::lock_guard<std::mutex> lk(mu_);
+    opts_ = opts;
+    opts_.minLimit = std::max(1, opts_.minLimit);
+    if (opts_.maxLimit > 0) opts_.maxLimit = std::max(opts_.minLimit, opts_.maxLimit);
+    if (limit_ == 0) limit_ = opts_.initialLimit;
+    limit_ = std::max<double>(limit_, opts_.minLimit);
+    if (opts_.maxLimit > 0) limit_ = std::min<double>(limit_, opts_.maxLimit);
+    publish();
+    cv_.notify_all();
+}
+
+// ---------------------
+// Admission
+// ---------------------
+int ConcurrencyGovernor::capFor(RequestPriority p) const {
+    int limit = static_cast<int>(limit_);
+    switch (p) {
+    case RequestPriority::Interactive: return limit;
+    case RequestPriority::Bulk: return std::max(1, static_cast<int>(limit * opts_.bulkShare));
+    case RequestPriority::Background: return std::max(1, static_cast<int>(limit * opts_.backgroundShare));
+    }
+    return limit;
+}
+
+// self: the request is one of the queued ones of its class, so it does not
+// wait for itself.
+bool ConcurrencyGovernor::canGrant(RequestPriority p, bool self) const {
+    const int cls = static_cast<int>(p);
+    for (int i = 0; i < cls; ++i) {
+        if (queued_[i] > 0) return false;
+    }
+    if (!self && queued_[cls] > 0) return false;
+    return opts_.maxLimit <= 0 || inFlight_ < capFor(p);
+}
+
+void ConcurrencyGovernor::grant() {
+    // Only a request that starts on an idle device and sees no other start
+    // before it ends ran alone.
+    alone_ = inFlight_ == 0;
+    inFlight_++;
+    granted_++;
+}
+
+void ConcurrencyGovernor::acquire(RequestPriority p) {
+    std::unique_lock<std::mutex> lk(mu_);
+    if (canGrant(p, false)) {
+        grant();
+        publish();
+        return;
+    }
+    queued_[static_cast<int>(p)]++;
+    peakQueued_ = std::max(peakQueued_, queued_[0] + queued_[1] + queued_[2]);
+    publish();
+    cv_.wait(lk, [&] { return canGrant(p, true); });
+    queued_[static_cast<int>(p)]--;
+    waited_++;
+    grant();
+    publish();
+    // A lower class may have been held back by this waiter only.
+    cv_.notify_all();
+}
+
+bool ConcurrencyGovernor::tryAcquire(RequestPriority p, bool queued) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!canGrant(p, queued)) return false;
+    if (queued) {
+        queued_[static_cast<int>(p)]--;
+        waited_++;
+        cv_.notify_all();
+    }
+    grant();
+    publish();
+    return true;
+}
+
+void ConcurrencyGovernor::enqueue(RequestPriority p) {
+    std::lock_guard<std::mutex> lk(mu_);
+    queued_[static_cast<int>(p)]++;
+    peakQueued_ = std::max(peakQueued_, queued_[0] + queued_[1] + queued_[2]);
+    publish();
+}
+
+void ConcurrencyGovernor::dequeue(RequestPriority p) {
+    std::lock_guard<std::mutex> lk(mu_);
+    queued_[static_cast<int>(p)]--;
+    publish();
+    cv_.notify_all();
+}
+
+void ConcurrencyGovernor::release(double rttMs, Outcome outcome) {
+    std::lock_guard<std::mutex> lk(mu_);
+    update(rttMs, outcome);
+    inFlight_--;
+    publish();
+    cv_.notify_all();
+}
+
+// ---------------------
+// Limit
+// ---------------------
+void ConcurrencyGovernor::update(double rttMs, Outcome outcome) {
+    if (outcome == Outcome::Ignored) return;
+    const double maxLimit = opts_.maxLimit > 0 ? opts_.maxLimit : 1e9;
+    Clock::time_point now = Clock::now();
+
+    if (outcome == Outcome::Failed) {
+        // One backoff per round trip: a burst of failures from the requests
+        // that were already in flight is one congestion event, not many.
+        auto sinceMs = std::chrono::duration<double, std::milli>(now - lastDecrease_).count();
+        if (sinceMs < std::max(rttMs_, 1.0)) return;
+        lastDecrease_ = now;
+        limit_ = std::max<double>(opts_.minLimit, limit_ * opts_.backoff);
+        decreases_++;
+        return;
+    }
+
+    if (rttMs <= 0) return;
+    rttMs_ = rttMs_ > 0 ? rttMs_ + kRecentWeight * (rttMs - rttMs_) : rttMs;
+
+    // The baseline is the RTT without queueing: learnt from requests that
+    // ran alone, and lowered by anything faster. Under sustained load it
+    // keeps its value instead of drifting up to the loaded RTT; if the
+    // device really got slower, the limit falls until requests run alone
+    // again and the baseline catches up.
+    bool alone = alone_ && inFlight_ == 1;
+    if (baselineMs_ <= 0) baselineMs_ = rttMs;
+    else if (alone) baselineMs_ += kBaselineWeight * (rttMs - baselineMs_);
+    baselineMs_ = std::min(baselineMs_, rttMs_);
+
+    // Too few requests to fill the limit say nothing about a larger one.
+    if (inFlight_ < limit_ / 2) return;
+
+    // One request over the gradient's estimate probes for more capacity.
+    double gradient = std::clamp(opts_.tolerance * baselineMs_ / rttMs_, 0.5, 1.0);
+    double target = limit_ * gradient + 1;
+    limit_ = (1 - opts_.smoothing) * limit_ + opts_.smoothing * target;
+    limit_ = std::clamp<double>(limit_, opts_.minLimit, maxLimit);
+}
+
+ConcurrencyGovernor::State ConcurrencyGovernor::snapshot() const {
+    State s;
+    s.limit = opts_.maxLimit > 0 ? static_cast<int>(limit_) : 0;
+    s.inFlight = inFlight_;
+    for (int i = 0; i < 3; ++i) s.queued[i] = queued_[i];
+    s.peakQueued = peakQueued_;
+    s.granted = granted_;
+    s.waited = waited_;
+    s.decreases = decreases_;
+    s.rttMs = rttMs_;
+    s.baselineRttMs = baselineMs_;
+    return s;
+}
+
+ConcurrencyGovernor::State ConcurrencyGovernor::state() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return snapshot();
+}
+
+// Called on every change so that stats output shows the current state;
+// stats never call back into the governor, so the lock order is fixed.
+void ConcurrencyGovernor::publish() {
+    if (stats_) stats_->recordConcurrency(snapshot());
+}
+
+// ---------------------
+// Thread priority
+// ---------------------
+RequestPriority ConcurrencyGovernor::current() {
+    return tPriority;
+}
+
+ConcurrencyGovernor::Scope::Scope(RequestPriority p) : prev_(tPriority) {
+    if (p > tPriority) tPriority = p;
+}
+
+ConcurrencyGovernor::Scope::~Scope() {
+    tPriority = prev_;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+class RequestStats;
+
+// Who is waiting for a request. Interactive commands go first; bulk reads
+// and background polling (mirrors, watchers) only get part of the limit,
+// so they back off before an interactive request has to queue.
+enum class RequestPriority { Interactive = 0, Bulk = 1, Background = 2 };
+
+const char* priorityName(RequestPriority p);
+
+// Adaptive limit on the requests in flight to one device.
+//
+// The Ultimate serves a handful of requests at a time; more than that just
+// queues on the device, where every request waits, interactive or not.
+// The governor keeps that queue on our side instead, ordered by priority.
+//
+// The limit follows the measured latency (time to first byte), after
+// Netflix's Gradient2: an average of recent samples is compared with the
+// baseline RTT of requests that did not queue, and the limit shrinks in
+// proportion when the recent RTT grows past `tolerance` times the baseline
+// and grows by one otherwise. Failures (timeouts, dropped connections,
+// 5xx) halve it, at most once per RTT.
+class ConcurrencyGovernor {
+public:
+    struct Options {
+        int initialLimit = 4;
+        int minLimit = 1;
+        int maxLimit = 16;           // 0: no limit; latency is still tracked
+        double tolerance = 1.5;      // RTT growth over the baseline that is not queueing
+        double smoothing = 0.2;      // weight of each new limit estimate
+        double backoff = 0.5;        // limit factor after a failure
+        double bulkShare = 0.75;     // of the limit usable by bulk work
+        double backgroundShare = 0.5;
+    };
+
+    enum class Outcome {
+        Ok,       // rttMs is a latency sample
+        Failed,   // timeout, dropped connection or 5xx: back off
+        Ignored,  // cancelled, or an upload whose time says nothing about queueing
+    };
+
+    // Requests sending a larger body are not sampled: their time to first
+    // byte is mostly the upload.
+    static constexpr size_t kMaxSampledBody = 4096;
+
+    // For stats output.
+    struct State {
+        int limit = 0;               // 0 = unlimited
+        int inFlight = 0;
+        int queued[3] = {0, 0, 0};   // waiting, by priority
+        int peakQueued = 0;
+        uint64_t granted = 0;
+        uint64_t waited = 0;         // grants that had to wait
+        uint64_t decreases = 0;      // backoffs after failures
+        double rttMs = 0;            // recent average
+        double baselineRttMs = 0;
+    };
+
+    explicit ConcurrencyGovernor(RequestStats* stats = nullptr);
+    ConcurrencyGovernor(Options opts, RequestStats* stats = nullptr);
+
+    ConcurrencyGovernor(const ConcurrencyGovernor&) = delete;
+    ConcurrencyGovernor& operator=(const ConcurrencyGovernor&) = delete;
+
+    // Changes the bounds; the learned limit is kept within them.
+    void configure(const Options& opts);
+
+    // Blocks until a request of priority p may start.
+    void acquire(RequestPriority p);
+
+    // Non-blocking acquire, for event loops. queued: the caller registered
+    // the request with enqueue() and it leaves the queue when granted.
+    bool tryAcquire(RequestPriority p, bool queued = false);
+    void enqueue(RequestPriority p);
+    void dequeue(RequestPriority p); // a queued request that gave up
+
+    // Ends a granted request.
+    void release(double rttMs, Outcome outcome);
+
+    State state() const;
+
+    // One blocking acquire, released as Ignored unless done() is called.
+    class Permit {
+    public:
+        Permit(ConcurrencyGovernor& gov, RequestPriority p) : gov_(&gov) { gov.acquire(p); }
+        ~Permit() { done(0, Outcome::Ignored); }
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+        void done(double rttMs, Outcome outcome) {
+            if (gov_) gov_->release(rttMs, outcome);
+            gov_ = nullptr;
+        }
+    private:
+        ConcurrencyGovernor* gov_;
+    };
+
+    // Priority of the requests the calling thread makes (Interactive
+    // unless a Scope says otherwise).
+    static RequestPriority current();
+
+    // Sets the calling thread's priority until destroyed. A scope never
+    // raises it: bulk work inside a background scope stays background.
+    class Scope {
+    public:
+        explicit Scope(RequestPriority p);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        RequestPriority prev_;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    int capFor(RequestPriority p) const;               // mu_ held
+    bool canGrant(RequestPriority p, bool self) const; // mu_ held
+    void grant();                                      // mu_ held
+    void update(double rttMs, Outcome outcome);        // mu_ held
+    State snapshot() const;                            // mu_ held
+    void publish();                                    // mu_ held
+
+    Options opts_;
+    RequestStats* stats_;
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    double limit_;
+    int inFlight_ = 0;
+    int queued_[3] = {0, 0, 0};
+    int peakQueued_ = 0;
+    uint64_t granted_ = 0;
+    uint64_t waited_ = 0;
+    uint64_t decreases_ = 0;
+    double rttMs_ = 0;
+    double baselineMs_ = 0;
+    bool alone_ = false;  // no other request started since the last one on an idle device
+    Clock::time_point lastDecrease_{};
+};
@@ -0,0 +1,109 @@
+#include "curl_pool.h"
+#include "request_stats.h"
+#include "retry_policy.h"
+#include <stdexcept>
+
+void ensureCurlGlobalInit() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+            throw std::runtime_error("curl_global_init failed");
+    });
+}
+
+CurlPool::CurlPool(size_t maxIdle) : maxIdle_(maxIdle) {
+    ensureCurlGlobalInit();
+
+    share_ = curl_share_init();
+    if (!share_) throw std::runtime_error("curl_share_init failed");
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &CurlPool::lockCb);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &CurlPool::unlockCb);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+CurlPool::~CurlPool() {
+    // Handles must be gone before the share can be released.
+    for (CURL* c : idle_) curl_easy_cleanup(c);
+    idle_.clear();
+    if (share_) curl_share_cleanup(share_);
+}
+
+void CurlPool::lockCb(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+    static_cast<CurlPool*>(userptr)->shareLocks_[data].lock();
+}
+
+void CurlPool::unlockCb(CURL*, curl_lock_data data, void* userptr) {
+    static_cast<CurlPool*>(userptr)->shareLocks_[data].unlock();
+}
+
+void CurlPool::applyBaseOptions(CURL* curl) {
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 5000L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 1500L);
+}
+
+CURL* CurlPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (!idle_.empty()) {
+            CURL* c = idle_.back();
+            idle_.pop_back();
+            return c;
+        }
+    }
+    CURL* c = curl_easy_init();
+    if (!c) throw std::runtime_error("curl_easy_init failed");
+    applyBaseOptions(c);
+    return c;
+}
+
+void CurlPool::release(CURL* curl) {
+    if (!curl) return;
+    // curl_easy_reset keeps live connections and caches, only options are cleared.
+    curl_easy_reset(curl);
+    applyBaseOptions(curl);
+
+    std::lock_guard<std::mutex> lk(mu_);
+    if (idle_.size() < maxIdle_) {
+        idle_.push_back(curl);
+        return;
+    }
+    curl_easy_cleanup(curl);
+}
+
+// Pulls curl's phase timings for the finished transfer into stats.
+void recordCurlTransfer(RequestStats& stats, CURL* curl, std::string_view endpoint,
+                        CURLcode rc, long httpCode) {
+    RequestStats::Sample s;
+    s.endpoint = endpoint;
+    s.httpCode = rc == CURLE_OK ? httpCode : 0;
+    s.ok = rc == CURLE_OK && httpCode >= 200 && httpCode < 300;
+
+    curl_off_t v = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &v) == CURLE_OK) s.nameLookupUs = static_cast<uint64_t>(v);
+    if (curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &v) == CURLE_OK) s.connectUs = static_cast<uint64_t>(v);
+    if (curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &v) == CURLE_OK) s.firstByteUs = static_cast<uint64_t>(v);
+    if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &v) == CURLE_OK) s.totalUs = static_cast<uint64_t>(v);
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &v) == CURLE_OK) s.bytesUp = static_cast<uint64_t>(v);
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &v) == CURLE_OK) s.bytesDown = static_cast<uint64_t>(v);
+    stats.record(s);
+}
+
+ConcurrencyGovernor::Outcome transferOutcome(CURL* curl, CURLcode rc, long httpCode, bool sample,
+                                             double& rttMs) {
+    rttMs = 0;
+    if (classifyFailure(rc, httpCode) != FailureKind::None) return ConcurrencyGovernor::Outcome::Failed;
+    if (!sample) return ConcurrencyGovernor::Outcome::Ignored;
+    curl_off_t sent = 0, first = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &sent) != CURLE_OK ||
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first) != CURLE_OK || first <= sent) {
+        return ConcurrencyGovernor::Outcome::Ignored;
+    }
+    rttMs = static_cast<double>(first - sent) / 1000.0;
+    return ConcurrencyGovernor::Outcome::Ok;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "concurrency_governor.h"
+
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <curl/curl.h>
+
+class RequestStats;
+
+// Process-wide curl_global_init; safe to call from any thread, runs once.
+void ensureCurlGlobalInit();
+
+// Pool of reusable curl easy handles for one device.
+// All handles share a DNS and connection cache, so back-to-back requests
+// reuse the same keep-alive socket instead of doing a new TCP handshake.
+class CurlPool {
+public:
+    explicit CurlPool(size_t maxIdle = 8);
+    ~CurlPool();
+
+    CurlPool(const CurlPool&) = delete;
+    CurlPool& operator=(const CurlPool&) = delete;
+
+    // Returns an idle handle (or a new one) with the base options applied.
+    CURL* acquire();
+
+    // Resets per-request options and returns the handle to the idle list.
+    void release(CURL* curl);
+
+    // RAII lease of one handle.
+    class Lease {
+    public:
+        explicit Lease(CurlPool& pool) : pool_(pool), curl_(pool.acquire()) {}
+        ~Lease() { pool_.release(curl_); }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        CURL* get() const { return curl_; }
+    private:
+        CurlPool& pool_;
+        CURL* curl_;
+    };
+
+private:
+    void applyBaseOptions(CURL* curl);
+
+    static void lockCb(CURL*, curl_lock_data data, curl_lock_access, void* userptr);
+    static void unlockCb(CURL*, curl_lock_data data, void* userptr);
+
+    CURLSH* share_ = nullptr;
+    std::mutex shareLocks_[CURL_LOCK_DATA_LAST];
+
+    std::mutex mu_;
+    std::vector<CURL*> idle_;
+    size_t maxIdle_;
+};
+
+// Pulls curl's phase timings, byte counts and status of a finished transfer
+// into stats under the given endpoint name.
+void recordCurlTransfer(RequestStats& stats, CURL* curl, std::string_view endpoint,
+                        CURLcode rc, long httpCode);
+
+// How a finished transfer counts for the concurrency governor: failures as
+// classifyFailure sees them, anything else as a sample of the time from
+// sending the request to the first byte of the answer. sample = false
+// reports success without a sample, for uploads that spend that time
+// sending the body.
+ConcurrencyGovernor::Outcome transferOutcome(CURL* curl, CURLcode rc, long httpCode, bool sample,
+                                             double& rttMs);
@@ -0,0 +1,334 @@
+#include "daemon.h"
+#include "cli.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <limits.h>
+
+// ---------------------
+// framing
+// ---------------------
+static bool writeAll(int fd, const void* data, size_t len) {
+    auto* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t len) {
+    auto* p = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool writeU32(int fd, uint32_t v) {
+    unsigned char b[4] = {
+        static_cast<unsigned char>(v >> 24), static_cast<unsigned char>(v >> 16),
+        static_cast<unsigned char>(v >> 8), static_cast<unsigned char>(v) };
+    return writeAll(fd, b, 4);
+}
+
+static bool readU32(int fd, uint32_t& v) {
+    unsigned char b[4];
+    if (!readAll(fd, b, 4)) return false;
+    v = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+    return true;
+}
+
+static bool writeString(int fd, const std::string& s) {
+    return writeU32(fd, static_cast<uint32_t>(s.size())) && writeAll(fd, s.data(), s.size());
+}
+
+static bool readString(int fd, std::string& s, uint32_t maxLen) {
+    uint32_t len = 0;
+    if (!readU32(fd, len) || len > maxLen) return false;
+    s.resize(len);
+    return len == 0 || readAll(fd, &s[0], len);
+}
+
+static bool writeFrame(int fd, char type, const char* data, size_t len) {
+    return writeAll(fd, &type, 1) && writeU32(fd, static_cast<uint32_t>(len)) && writeAll(fd, data, len);
+}
+
+// ostream buffer that ships its contents as frames of one type, so command
+// output reaches the client as it is produced rather than at exit.
+class FrameBuf : public std::streambuf {
+public:
+    FrameBuf(int fd, char type) : fd_(fd), type_(type) { setp(buf_, buf_ + sizeof(buf_)); }
+    ~FrameBuf() override { sync(); }
+
+protected:
+    int overflow(int ch) override {
+        if (sync() != 0) return traits_type::eof();
+        if (ch != traits_type::eof()) { *pptr() = static_cast<char>(ch); pbump(1); }
+        return ch == traits_type::eof() ? 0 : ch;
+    }
+    int sync() override {
+        size_t n = static_cast<size_t>(pptr() - pbase());
+        if (n == 0) return 0;
+        bool ok = writeFrame(fd_, type_, pbase(), n);
+        setp(buf_, buf_ + sizeof(buf_));
+        return ok ? 0 : -1;
+    }
+
+private:
+    int fd_;
+    char type_;
+    char buf_[4096];
+};
+
+// ---------------------
+// socketPath
+// ---------------------
+std::string remoted::socketPath() {
+    if (const char* p = std::getenv("U64_REMOTE_SOCKET")) {
+        if (*p) return p;
+    }
+    if (const char* run = std::getenv("XDG_RUNTIME_DIR")) {
+        if (*run) return std::string(run) + "/u64-remote.sock";
+    }
+    const char* home = std::getenv("HOME");
+    if (!home) home = ".";
+    return std::string(home) + "/.config/u64-remote/daemon.sock";
+}
+
+static int connectTo(const std::string& path) {
+    sockaddr_un sa{};
+    if (path.size() >= sizeof(sa.sun_path)) return -1;
+    sa.sun_family = AF_UNIX;
+    std::memcpy(sa.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ---------------------
+// forward (client side)
+// ---------------------
+bool remoted::forward(const std::vector<std::string>& args, int& exitCode, bool runLocallyIfBusy) {
+    int fd = connectTo(socketPath());
+    if (fd < 0) return false;
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+
+    bool ok = writeU32(fd, static_cast<uint32_t>(args.size()));
+    for (const auto& a : args) ok = ok && writeString(fd, a);
+    ok = ok && writeString(fd, cwd);
+    if (!ok) {
+        close(fd);
+        throw std::runtime_error("Lost connection to u64-remoted while sending request");
+    }
+
+    for (;;) {
+        char type = 0;
+        std::string payload;
+        if (!readAll(fd, &type, 1) || !readString(fd, payload, 64u << 20)) {
+            close(fd);
+            throw std::runtime_error("Lost connection to u64-remoted");
+        }
+        if (type == 'o') {
+            std::fwrite(payload.data(), 1, payload.size(), stdout);
+            std::fflush(stdout);
+        } else if (type == 'e') {
+            std::fwrite(payload.data(), 1, payload.size(), stderr);
+        } else if (type == 'x' && payload.size() == 4) {
+            auto* b = reinterpret_cast<const unsigned char*>(payload.data());
+            exitCode = static_cast<int>((uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) |
+                                        (uint32_t(b[2]) << 8) | uint32_t(b[3]));
+            close(fd);
+            return true;
+        } else if (type == 'b') {
+            close(fd);
+            if (!runLocallyIfBusy) throw std::runtime_error("u64-remoted is busy running '" + payload + "'");
+            std::fprintf(stderr, "u64-remoted is busy running '%s'; running in-process.\n", payload.c_str());
+            return false;
+        }
+    }
+}
+
+// ---------------------
+// serve (daemon side)
+// ---------------------
+static volatile sig_atomic_t g_stop = 0;
+static std::atomic<bool>* g_interrupt = nullptr; // the session's, for the running command
+
+static void onSignal(int) {
+    g_stop = 1;
+    if (g_interrupt) *g_interrupt = true;
+}
+
+// A client gets this long to send its request; the accept loop waits on it.
+static constexpr int kRequestTimeoutMs = 2000;
+
+static bool readRequest(int fd, std::vector<std::string>& args, std::string& cwd) {
+    uint32_t argc = 0;
+    if (!readU32(fd, argc) || argc > 4096) return false;
+    args.resize(argc);
+    for (auto& a : args) {
+        if (!readString(fd, a, 1u << 20)) return false;
+    }
+    return readString(fd, cwd, PATH_MAX);
+}
+
+int remoted::serve(const std::string& path, bool verbose) {
+    sockaddr_un sa{};
+    if (path.size() >= sizeof(sa.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+
+    int probe = connectTo(path);
+    if (probe >= 0) {
+        close(probe);
+        throw std::runtime_error("u64-remoted is already running on " + path);
+    }
+    unlink(path.c_str()); // stale socket from a daemon that died
+
+    std::string dir = path.substr(0, path.find_last_of('/'));
+    if (!dir.empty() && dir != path) mkdir(dir.c_str(), 0700);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0) throw std::runtime_error("socket() failed");
+    sa.sun_family = AF_UNIX;
+    std::memcpy(sa.sun_path, path.c_str(), path.size() + 1);
+
+    mode_t old = umask(0077); // socket is only for this user
+    int rc = bind(lfd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa));
+    umask(old);
+    if (rc != 0 || listen(lfd, 16) != 0) {
+        close(lfd);
+        throw std::runtime_error("Cannot listen on " + path + ": " + std::strerror(errno));
+    }
+
+    struct sigaction act{};
+    act.sa_handler = onSignal;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGINT, &act, nullptr);   // no SA_RESTART: accept() returns EINTR
+    sigaction(SIGTERM, &act, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (verbose) std::cerr << "u64-remoted listening on " << path << "\n";
+
+    cli::Session session;
+    session.persistent = true;
+    g_interrupt = &session.interrupted;
+
+    // Commands share the Session and the working directory, so one runs at
+    // a time, on a worker thread. The accept loop stays free to tell other
+    // clients that the daemon is busy instead of leaving them waiting.
+    std::mutex mu;
+    bool busy = false;
+    std::string running; // subcommand being run, without its arguments
+    std::thread worker;
+
+    auto handle = [&](int cfd, std::vector<std::string> args, std::string cwd) {
+        // Relative paths in the command are relative to the client.
+        if (!cwd.empty() && chdir(cwd.c_str()) != 0 && verbose) {
+            std::cerr << "chdir(" << cwd << ") failed\n";
+        }
+
+        int exitCode = 1;
+        {
+            FrameBuf outBuf(cfd, 'o');
+            FrameBuf errBuf(cfd, 'e');
+            std::ostream out(&outBuf);
+            std::ostream err(&errBuf);
+            std::istringstream in;
+            cli::Io io{in, out, err, false};
+            exitCode = cli::run(args, session, io);
+            out.flush();
+            err.flush();
+        }
+        unsigned char code[4] = {
+            static_cast<unsigned char>(uint32_t(exitCode) >> 24), static_cast<unsigned char>(uint32_t(exitCode) >> 16),
+            static_cast<unsigned char>(uint32_t(exitCode) >> 8), static_cast<unsigned char>(uint32_t(exitCode)) };
+        writeFrame(cfd, 'x', reinterpret_cast<const char*>(code), 4);
+        close(cfd);
+
+        std::lock_guard<std::mutex> lk(mu);
+        busy = false;
+        // 'daemon stop': wake the accept loop.
+        if (session.stopRequested) shutdown(lfd, SHUT_RDWR);
+    };
+
+    while (!g_stop) {
+        int cfd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        timeval tv{kRequestTimeoutMs / 1000, (kRequestTimeoutMs % 1000) * 1000};
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        std::vector<std::string> args;
+        std::string cwd;
+        if (!readRequest(cfd, args, cwd)) {
+            close(cfd);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            if (busy) {
+                writeFrame(cfd, 'b', running.data(), running.size());
+                close(cfd);
+                continue;
+            }
+            busy = true;
+            // Only the subcommand: option values such as --password stay private.
+            size_t cmd = cli::commandIndex(args);
+            running = cmd < args.size() ? args[cmd] : "";
+        }
+        if (worker.joinable()) worker.join(); // finished: busy was cleared
+
+        // Signals stay with this thread, so they interrupt accept().
+        sigset_t block, prev;
+        sigemptyset(&block);
+        sigaddset(&block, SIGINT);
+        sigaddset(&block, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &block, &prev);
+        worker = std::thread(handle, cfd, std::move(args), std::move(cwd));
+        pthread_sigmask(SIG_SETMASK, &prev, nullptr);
+    }
+    // A running wait or dump would otherwise keep the daemon up.
+    session.interrupted = true;
+    if (worker.joinable()) worker.join();
+    g_interrupt = nullptr;
+
+    close(lfd);
+    unlink(path.c_str());
+    if (verbose) std::cerr << "u64-remoted stopped\n";
+    return 0;
+}
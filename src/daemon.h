@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Local Unix-socket protocol between u64-remote and u64-remoted.
+//
+// Request:  u32 argc, argc x (u32 len, bytes), u32 len, cwd bytes
+// Response: frames of (u8 type, u32 len, bytes) where type is
+//           'o' stdout, 'e' stderr, 'x' exit code (4 bytes, big endian),
+//           or a lone 'b' (the subcommand being run, without arguments)
+//           when the daemon is busy with another client's command.
+// All integers are big endian.
+namespace remoted {
+
+// $U64_REMOTE_SOCKET, else $XDG_RUNTIME_DIR/u64-remote.sock,
+// else ~/.config/u64-remote/daemon.sock.
+std::string socketPath();
+
+// Sends the command to a running daemon and relays its output to this
+// process's stdout/stderr. Returns false, without side effects, when no
+// daemon is listening. When it is busy with another command, returns false
+// after a note on stderr if runLocallyIfBusy, and throws otherwise.
+bool forward(const std::vector<std::string>& args, int& exitCode, bool runLocallyIfBusy = true);
+
+// Serves requests on socketPath() until 'daemon stop' or SIGINT/SIGTERM.
+int serve(const std::string& path, bool verbose);
+
+} // namespace remoted
@@ -0,0 +1,35 @@
+#include "daemon.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static void usage() {
+    std::cout <<
+        "u64-remoted [--socket PATH] [--verbose]\n"
+        "\n"
+        "Keeps device selection, discovery results and keep-alive connections\n"
+        "in memory and runs u64-remote commands sent over a Unix socket.\n"
+        "Default socket: " << remoted::socketPath() << "\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::string path = remoted::socketPath();
+        bool verbose = false;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string a = argv[i];
+            if (a == "--socket" && i + 1 < argc) path = argv[++i];
+            else if (a == "--verbose") verbose = true;
+            else if (a == "-h" || a == "--help") { usage(); return 0; }
+            else throw std::runtime_error("Unknown option: " + a);
+        }
+
+        return remoted::serve(path, verbose);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,267 @@
+#include "device_cache.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// ---------------------
+// Parser
+// ---------------------
+// A single pass over the text that understands exactly the JSON the cache
+// uses: objects, arrays, strings, numbers, true/false/null. Unknown keys are
+// skipped, so newer files still load.
+namespace {
+
+struct CacheParser {
+    const std::string& s;
+    size_t i = 0;
+
+    [[noreturn]] void fail() const { throw std::runtime_error("cache: malformed JSON"); }
+
+    void ws() {
+        while (i < s.size() && (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t')) ++i;
+    }
+    bool eat(char c) {
+        ws();
+        if (i < s.size() && s[i] == c) { ++i; return true; }
+        return false;
+    }
+    void expect(char c) { if (!eat(c)) fail(); }
+
+    std::string str() {
+        expect('"');
+        std::string out;
+        while (i < s.size() && s[i] != '"') {
+            char c = s[i++];
+            if (c == '\\') {
+                if (i >= s.size()) fail();
+                char e = s[i++];
+                switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'u': // cache strings are ASCII; keep anything else as '?'
+                    if (s.size() - i < 4) fail();
+                    i += 4;
+                    out += '?';
+                    break;
+                default: out += e; break;
+                }
+            } else {
+                out += c;
+            }
+        }
+        if (i >= s.size()) fail();
+        ++i;
+        return out;
+    }
+
+    double num() {
+        ws();
+        const char* start = s.c_str() + i;
+        char* end = nullptr;
+        double v = std::strtod(start, &end);
+        if (end == start) fail();
+        i += static_cast<size_t>(end - start);
+        return v;
+    }
+
+    void skipValue() {
+        ws();
+        if (i >= s.size()) fail();
+        char c = s[i];
+        if (c == '"') { str(); return; }
+        if (c == '{') { object([&](const std::string&) { skipValue(); }); return; }
+        if (c == '[') { array([&] { skipValue(); }); return; }
+        if (s.compare(i, 4, "true") == 0 || s.compare(i, 4, "null") == 0) { i += 4; return; }
+        if (s.compare(i, 5, "false") == 0) { i += 5; return; }
+        num();
+    }
+
+    template <typename F>
+    void object(F onKey) {
+        expect('{');
+        if (eat('}')) return;
+        do {
+            std::string key = str();
+            expect(':');
+            onKey(key);
+        } while (eat(','));
+        expect('}');
+    }
+
+    template <typename F>
+    void array(F onItem) {
+        expect('[');
+        if (eat(']')) return;
+        do { onItem(); } while (eat(','));
+        expect(']');
+    }
+
+    void device(CachedDevice& d) {
+        object([&](const std::string& key) {
+            if (key == "address") d.address = str();
+            else if (key == "hostname") d.hostname = str();
+            else if (key == "firmware") d.firmware = str();
+            else if (key == "last_seen") d.lastSeen = static_cast<int64_t>(num());
+            else if (key == "rtt_ms") d.rttMs = num();
+            else if (key == "failures") d.failures = static_cast<uint32_t>(num());
+            else skipValue();
+        });
+    }
+};
+
+} // namespace
+
+static int64_t nowUnix() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ---------------------
+// DeviceCache
+// ---------------------
+DeviceCache DeviceCache::load(const std::string& path) {
+    DeviceCache cache;
+    std::ifstream f(path);
+    if (!f) return cache;
+    std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    try {
+        CacheParser p{text};
+        CachedDevice legacy; // old single-device files keep these at top level
+        p.object([&](const std::string& key) {
+            if (key == "devices") {
+                p.array([&] {
+                    CachedDevice d;
+                    p.device(d);
+                    if (!d.address.empty()) cache.devices_.push_back(std::move(d));
+                });
+            }
+            else if (key == "address") legacy.address = p.str();
+            else if (key == "hostname") legacy.hostname = p.str();
+            else p.skipValue();
+        });
+        if (cache.devices_.empty() && !legacy.address.empty()) cache.devices_.push_back(std::move(legacy));
+    } catch (const std::exception&) {
+        // A damaged cache is only a lost optimisation; start over.
+        cache.devices_.clear();
+    }
+    return cache;
+}
+
+void DeviceCache::save(const std::string& path) const {
+    std::filesystem::path p(path);
+    if (p.has_parent_path()) std::filesystem::create_directories(p.parent_path());
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"version\": 2,\n  \"devices\": [";
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        const CachedDevice& d = devices_[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"address\": \"" << util::escapeJson(d.address)
+            << "\", \"hostname\": \"" << util::escapeJson(d.hostname)
+            << "\", \"firmware\": \"" << util::escapeJson(d.firmware)
+            << "\", \"last_seen\": " << d.lastSeen
+            << ", \"rtt_ms\": " << d.rttMs
+            << ", \"failures\": " << d.failures << "}";
+    }
+    out << (devices_.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    std::string text = out.str();
+
+    // Unique temporary name per process, then an atomic rename: readers see
+    // either the old or the new file, never a partial one.
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream f(tmp, std::ios::trunc);
+        if (!f) throw std::runtime_error("Cannot write cache: " + tmp);
+        f << text;
+        f.flush();
+        if (!f) { std::remove(tmp.c_str()); throw std::runtime_error("Cannot write cache: " + tmp); }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot replace cache " + path + ": " + std::strerror(errno));
+    }
+}
+
+DeviceCache DeviceCache::update(const std::string& path, const std::function<void(DeviceCache&)>& fn) {
+    std::filesystem::path p(path);
+    if (p.has_parent_path()) std::filesystem::create_directories(p.parent_path());
+
+    std::string lockPath = path + ".lock";
+    int fd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+    struct Unlock {
+        int fd;
+        ~Unlock() { if (fd >= 0) close(fd); } // closing drops the flock
+    } unlock{fd};
+
+    DeviceCache cache = load(path);
+    fn(cache);
+    cache.save(path);
+    return cache;
+}
+
+CachedDevice& DeviceCache::entry(const std::string& address) {
+    for (auto& d : devices_) {
+        if (d.address == address) return d;
+    }
+    devices_.emplace_back();
+    devices_.back().address = address;
+    return devices_.back();
+}
+
+void DeviceCache::recordSuccess(const std::string& address, const std::string& hostname,
+                                double rttMs, const std::string& firmware) {
+    CachedDevice& d = entry(address);
+    if (!hostname.empty()) d.hostname = hostname;
+    if (!firmware.empty()) d.firmware = firmware;
+    // Smooth the RTT so one slow answer does not reorder the ranking.
+    d.rttMs = (d.lastSeen == 0 || d.rttMs <= 0) ? rttMs : d.rttMs * 0.7 + rttMs * 0.3;
+    d.lastSeen = nowUnix();
+    d.failures = 0;
+}
+
+void DeviceCache::recordFailure(const std::string& address) {
+    for (auto& d : devices_) {
+        if (d.address == address) { d.failures++; return; }
+    }
+}
+
+const CachedDevice* DeviceCache::find(const std::string& address) const {
+    for (const auto& d : devices_) {
+        if (d.address == address) return &d;
+    }
+    return nullptr;
+}
+
+std::vector<CachedDevice> DeviceCache::ranked() const {
+    std::vector<CachedDevice> out;
+    for (const auto& d : devices_) {
+        if (d.failures < kMaxFailures) out.push_back(d);
+    }
+    std::stable_sort(out.begin(), out.end(), [](const CachedDevice& a, const CachedDevice& b) {
+        if (a.failures != b.failures) return a.failures < b.failures;
+        // Devices never timed sort after measured ones.
+        if ((a.rttMs > 0) != (b.rttMs > 0)) return a.rttMs > 0;
+        return a.rttMs < b.rttMs;
+    });
+    return out;
+}
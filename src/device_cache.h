@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Devices seen on earlier runs, with how well they answered.
+struct CachedDevice {
+    std::string address;   // base URL, e.g. http://10.0.0.183
+    std::string hostname;
+    std::string firmware;  // "version" from /v1/version
+    int64_t lastSeen = 0;  // unix seconds of the last successful contact
+    double rttMs = 0;      // smoothed /v1/version round trip
+    uint32_t failures = 0; // consecutive failed contacts
+};
+
+// The discovery cache in ~/.config/u64-remote/cache.json:
+//   {"version": 2, "devices": [{"address": ..., "hostname": ...,
+//     "firmware": ..., "last_seen": ..., "rtt_ms": ..., "failures": ...}]}
+// Files in the old single-device format ({"address", "hostname"}) load as
+// one device. Saves replace the file atomically, and update() serialises
+// read-modify-write cycles of concurrent processes with a lock file.
+class DeviceCache {
+public:
+    // Devices with this many consecutive failures are no longer preferred.
+    static constexpr uint32_t kMaxFailures = 3;
+
+    // Missing or unreadable files yield an empty cache.
+    static DeviceCache load(const std::string& path);
+    void save(const std::string& path) const;
+
+    // Loads, applies fn and saves while holding path + ".lock".
+    static DeviceCache update(const std::string& path, const std::function<void(DeviceCache&)>& fn);
+
+    void recordSuccess(const std::string& address, const std::string& hostname,
+                       double rttMs, const std::string& firmware);
+    void recordFailure(const std::string& address);
+
+    const CachedDevice* find(const std::string& address) const;
+    const std::vector<CachedDevice>& devices() const { return devices_; }
+
+    // Healthy devices, fastest first.
+    std::vector<CachedDevice> ranked() const;
+
+private:
+    CachedDevice& entry(const std::string& address);
+
+    std::vector<CachedDevice> devices_;
+};
@@ -0,0 +1,233 @@
+#include "device_resolver.h"
+#include "subnet_scan.h"
+#include "version_probe.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// Cached devices probed at once.
+static const size_t kMaxCacheProbes = 8;
+
+// State shared by the racing strategies.
+struct Race {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::atomic<bool> cancel{false};
+    bool won = false;
+    ResolvedDevice winner;
+    int running = 0;
+    std::vector<DiscoveredService> candidates;
+    const DeviceResolver::Log* log = nullptr;
+
+    void say(const std::string& msg) {
+        if (!log || !*log) return;
+        std::lock_guard<std::mutex> lk(mu);
+        (*log)(msg);
+    }
+
+    // First offer wins and cancels everyone else.
+    void offer(ResolvedDevice d) {
+        std::lock_guard<std::mutex> lk(mu);
+        if (won) return;
+        won = true;
+        winner = std::move(d);
+        cancel = true;
+        cv.notify_all();
+    }
+
+    void addCandidates(const std::vector<DiscoveredService>& found) {
+        std::lock_guard<std::mutex> lk(mu);
+        for (const auto& s : found) {
+            bool dup = false;
+            for (const auto& c : candidates) dup = dup || (c.address == s.address && c.port == s.port);
+            if (!dup) candidates.push_back(s);
+        }
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> lk(mu);
+        running--;
+        cv.notify_all();
+    }
+};
+
+DeviceResolver::DeviceResolver(ResolveOptions opts) : opts_(std::move(opts)) {}
+
+DeviceResolver::~DeviceResolver() {
+    if (revalidate_.joinable()) revalidate_.join();
+}
+
+// ---------------------
+// Strategies
+// ---------------------
+static void raceCache(Race& race, const ResolveOptions& opts) {
+    std::vector<CachedDevice> ranked = DeviceCache::load(opts.cachePath).ranked();
+    if (ranked.size() > kMaxCacheProbes) ranked.resize(kMaxCacheProbes);
+    if (ranked.empty()) return;
+
+    std::vector<std::string> urls;
+    for (const auto& d : ranked) urls.push_back(d.address);
+    race.say("Checking " + std::to_string(urls.size()) + " cached device(s)");
+
+    std::vector<util::VersionProbe> finished;
+    util::probeVersions(urls, opts.cacheProbeTimeoutMs, opts.password,
+        [&](const util::VersionProbe& p) {
+            finished.push_back(p);
+            if (!p.isUltimate) return true;
+            ResolvedDevice d;
+            d.address = p.baseUrl;
+            d.firmware = p.version;
+            d.rttMs = p.rttMs;
+            d.source = "cache";
+            for (const auto& c : ranked) {
+                if (c.address == p.baseUrl) d.hostname = c.hostname;
+            }
+            race.offer(std::move(d));
+            return false;
+        }, &race.cancel);
+
+    // Only probes that actually finished say anything about a device.
+    if (finished.empty()) return;
+    DeviceCache::update(opts.cachePath, [&](DeviceCache& dc) {
+        for (const auto& p : finished) {
+            if (p.isUltimate) dc.recordSuccess(p.baseUrl, "", p.rttMs, p.version);
+            else dc.recordFailure(p.baseUrl);
+        }
+    });
+}
+
+static void raceMdns(Race& race, const ResolveOptions& opts) {
+    race.say("Discovering devices via mDNS...");
+    DiscoveryService disco;
+    DiscoveryOptions dopts;
+    dopts.timeoutMs = opts.mdnsTimeoutMs;
+    dopts.cancel = &race.cancel;
+    // Only confirmed Ultimates count; printers and routers announce HTTP too.
+    dopts.confirm = true;
+    dopts.probeTimeoutMs = opts.cacheProbeTimeoutMs;
+    dopts.password = opts.password;
+    auto confirmed = disco.discover(dopts, [&](const DiscoveredService& s) {
+        race.say("  found " + s.hostname + " (" + s.address + ")" +
+                 (s.firmware.empty() ? "" : ", firmware " + s.firmware));
+    });
+    if (confirmed.empty() || race.cancel) return;
+
+    if (confirmed.size() == 1) {
+        const DiscoveredService& s = confirmed.front();
+        ResolvedDevice d;
+        d.address = serviceUrl(s);
+        d.hostname = s.hostname;
+        d.firmware = s.firmware;
+        d.rttMs = s.rttMs;
+        d.source = "mdns";
+        race.offer(std::move(d));
+    } else {
+        race.addCandidates(confirmed);
+    }
+}
+
+static void raceScan(Race& race, const ResolveOptions& opts) {
+    {
+        // Happy-eyeballs stagger: the scan is the most expensive strategy.
+        std::unique_lock<std::mutex> lk(race.mu);
+        race.cv.wait_for(lk, std::chrono::milliseconds(opts.scanDelayMs), [&] { return race.won; });
+        if (race.won) return;
+    }
+    race.say("Scanning local subnets...");
+    ScanOptions sopts;
+    sopts.connectTimeoutMs = opts.scanConnectTimeoutMs;
+    sopts.cancel = &race.cancel;
+    SubnetScanner scanner(sopts);
+    auto found = scanner.scan(opts.maxHostsPerIface > 0 ? static_cast<size_t>(opts.maxHostsPerIface) : 0);
+    if (race.cancel) return;
+    if (found.size() == 1) {
+        ResolvedDevice d;
+        d.address = serviceUrl(found.front());
+        d.hostname = found.front().hostname;
+        d.firmware = found.front().firmware;
+        d.rttMs = found.front().rttMs;
+        d.source = "scan";
+        race.offer(std::move(d));
+    } else {
+        race.addCandidates(found);
+    }
+}
+
+// ---------------------
+// resolve
+// ---------------------
+DeviceResolver::Outcome DeviceResolver::resolve(const Log& log) {
+    Outcome out;
+
+    // A device validated within the trust window is used straight away and
+    // checked again in the background; a failure there demotes it for the
+    // next run.
+    if (opts_.useCache && opts_.trustTtlSec > 0) {
+        auto ranked = DeviceCache::load(opts_.cachePath).ranked();
+        auto now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (!ranked.empty() && ranked.front().failures == 0 &&
+            now - ranked.front().lastSeen <= opts_.trustTtlSec) {
+            const CachedDevice& c = ranked.front();
+            out.found = true;
+            out.device.address = c.address;
+            out.device.hostname = c.hostname;
+            out.device.firmware = c.firmware;
+            out.device.rttMs = c.rttMs;
+            out.device.source = "cache";
+            if (log) log("Trusting cached device " + c.address + " (validated " + std::to_string(now - c.lastSeen) + " s ago)");
+
+            ResolveOptions opts = opts_;
+            std::string address = c.address;
+            revalidate_ = std::thread([opts, address] {
+                auto p = util::probeVersions({address}, opts.cacheProbeTimeoutMs, opts.password);
+                DeviceCache::update(opts.cachePath, [&](DeviceCache& dc) {
+                    if (p.front().isUltimate) dc.recordSuccess(address, "", p.front().rttMs, p.front().version);
+                    else dc.recordFailure(address);
+                });
+            });
+            return out;
+        }
+    }
+
+    Race race;
+    race.log = &log;
+    std::vector<std::thread> threads;
+    auto launch = [&](void (*strategy)(Race&, const ResolveOptions&)) {
+        {
+            std::lock_guard<std::mutex> lk(race.mu);
+            race.running++;
+        }
+        threads.emplace_back([&race, this, strategy] {
+            try { strategy(race, opts_); } catch (const std::exception& e) { race.say(std::string("  ") + e.what()); }
+            race.done();
+        });
+    };
+    if (opts_.useCache) launch(raceCache);
+    if (opts_.useDiscovery) {
+        launch(raceMdns);
+        launch(raceScan);
+    }
+
+    {
+        std::unique_lock<std::mutex> lk(race.mu);
+        race.cv.wait(lk, [&] { return race.won || race.running == 0; });
+    }
+    race.cancel = true;
+    for (auto& t : threads) t.join();
+
+    out.found = race.won;
+    out.device = race.winner;
+    out.candidates = race.candidates;
+    if (out.found) {
+        if (log) log("Using " + out.device.address + " (" + out.device.source + ")");
+        if (out.device.source != "cache") {
+            DeviceCache::update(opts_.cachePath, [&](DeviceCache& dc) {
+                dc.recordSuccess(out.device.address, out.device.hostname, out.device.rttMs, out.device.firmware);
+            });
+        }
+    }
+    return out;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "device_cache.h"
+#include "discovery.h"
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ResolvedDevice {
+    std::string address;   // base URL, e.g. http://10.0.0.183
+    std::string hostname;
+    std::string firmware;
+    double rttMs = 0;
+    std::string source;    // "cache", "mdns" or "scan"
+};
+
+struct ResolveOptions {
+    std::string cachePath;
+    std::string password;
+    bool useCache = true;
+    bool useDiscovery = true;     // mDNS and the subnet scan
+    int cacheProbeTimeoutMs = 1500;
+    int mdnsTimeoutMs = 800;
+    int scanDelayMs = 250;        // head start for cache and mDNS before scanning
+    int scanConnectTimeoutMs = 150;
+    int maxHostsPerIface = 256;
+    int trustTtlSec = 0;          // > 0: use a cache entry validated this recently
+                                  // without waiting, and revalidate it in the background
+};
+
+// Finds a device by racing the strategies happy-eyeballs style: cached
+// devices are probed, mDNS is browsed and, after a short head start, the
+// local subnets are scanned, all at once. The first confirmed device wins
+// and the other strategies are cancelled, so startup takes as long as the
+// fastest strategy rather than the sum of all of them.
+//
+// A healthy cached device is the user's earlier choice and wins outright.
+// Discovery wins only when it confirms exactly one device; several are
+// ambiguous and returned as candidates for the caller to choose from.
+class DeviceResolver {
+public:
+    struct Outcome {
+        bool found = false;
+        ResolvedDevice device;
+        std::vector<DiscoveredService> candidates; // when discovery was ambiguous
+    };
+
+    using Log = std::function<void(const std::string&)>;
+
+    explicit DeviceResolver(ResolveOptions opts);
+    ~DeviceResolver(); // waits for a background revalidation
+
+    DeviceResolver(const DeviceResolver&) = delete;
+    DeviceResolver& operator=(const DeviceResolver&) = delete;
+
+    Outcome resolve(const Log& log = nullptr);
+
+private:
+    ResolveOptions opts_;
+    std::thread revalidate_;
+};
@@ -1,29 +1,138 @@
 #include "discovery.h"
+#include "version_probe.h"
 #include <avahi-client/client.h>
 #include <avahi-client/lookup.h>
 #include <avahi-common/error.h>
+#include <avahi-common/malloc.h>
 #include <avahi-common/simple-watch.h>
-#include <thread>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
 
-static AvahiSimplePoll* simplePoll = nullptr;
+namespace {
+
+// Per-call browse state; all Avahi callbacks run on the thread that
+// iterates the poll, so no locking is needed. The prober has its own.
+struct BrowseState {
+    const DiscoveryOptions* opts = nullptr;
+    const DiscoveryService::Callback* onFound = nullptr;
+    std::vector<DiscoveredService> results;
+
+    std::set<std::string> claimedNames;  // service names resolved or being resolved
+    std::set<std::string> seenEndpoints; // address:port already reported
+    int pendingResolvers = 0;
+    bool allForNow = false;
+    bool failed = false;
+
+    // With opts->confirm: services waiting for their probe, by base URL.
+    util::VersionProber* prober = nullptr;
+    std::map<std::string, DiscoveredService> probing;
+
+    bool full() const { return opts->maxResults && results.size() >= opts->maxResults; }
+
+    bool done() const {
+        if (failed || full()) return true;
+        return opts->stopWhenIdle && allForNow && pendingResolvers == 0;
+    }
+
+    void report(DiscoveredService svc) {
+        if (full()) return;
+        results.push_back(std::move(svc));
+        if (*onFound) (*onFound)(results.back());
+    }
+};
+
+std::string serviceKey(const char* name, const char* type, const char* domain) {
+    std::string k = name ? name : "";
+    k += '\x1f';
+    k += type ? type : "";
+    k += '\x1f';
+    k += domain ? domain : "";
+    return k;
+}
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+// Most devices announce nothing useful with _http._tcp, so only TXT records
+// that positively describe something else rule a service out: a product or
+// model key naming another device, or keys only printers send.
+bool txtRulesOut(AvahiStringList* txt) {
+    static const char* const kProductKeys[] = {"product", "model", "md", "ty", "usb_mdl", "manufacturer", "vendor"};
+    static const char* const kPrinterKeys[] = {"pdl", "rp", "urf"};
+    static const char* const kUltimateWords[] = {"ultimate", "u64", "c64", "commodore", "1541"};
+
+    bool otherProduct = false;
+    for (AvahiStringList* l = txt; l; l = avahi_string_list_get_next(l)) {
+        char* key = nullptr;
+        char* value = nullptr;
+        if (avahi_string_list_get_pair(l, &key, &value, nullptr) != 0) continue;
+        std::string k = lower(key ? key : "");
+        std::string v = lower(value ? value : "");
+        avahi_free(key);
+        avahi_free(value);
+
+        for (const char* pk : kPrinterKeys) {
+            if (k == pk) otherProduct = true;
+        }
+        bool productKey = false;
+        for (const char* pk : kProductKeys) productKey = productKey || k == pk;
+        if (!productKey || v.empty()) continue;
+        for (const char* w : kUltimateWords) {
+            if (v.find(w) != std::string::npos) return false;
+        }
+        otherProduct = true;
+    }
+    return otherProduct;
+}
+
+// Hands finished probes' services to the caller, confirmed ones only.
+void collectProbes(BrowseState& st) {
+    for (auto& p : st.prober->take()) {
+        auto it = st.probing.find(p.baseUrl);
+        if (it == st.probing.end()) continue;
+        DiscoveredService svc = std::move(it->second);
+        st.probing.erase(it);
+        if (!p.isUltimate) continue;
+        svc.firmware = p.version;
+        svc.rttMs = p.rttMs;
+        st.report(std::move(svc));
+    }
+}
+
+} // namespace
+
+std::string serviceUrl(const DiscoveredService& s) {
+    std::string url = "http://" + s.address;
+    if (s.port != 0 && s.port != 80) url += ":" + std::to_string(s.port);
+    return url;
+}
 
 static void resolve_callback(
     AvahiServiceResolver* r,
     AvahiIfIndex /*interface*/,
     AvahiProtocol /*protocol*/,
     AvahiResolverEvent event,
-    const char* /*name*/,
-    const char* /*type*/,
-    const char* /*domain*/,
+    const char* name,
+    const char* type,
+    const char* domain,
     const char* host_name,
     const AvahiAddress* address,
     uint16_t port,
-    AvahiStringList* /*txt*/,
+    AvahiStringList* txt,
     AvahiLookupResultFlags /*flags*/,
     void* userdata)
 {
-    auto* out = static_cast<std::vector<DiscoveredService>*>(userdata);
+    auto* st = static_cast<BrowseState*>(userdata);
+    st->pendingResolvers--;
+
     if (event == AVAHI_RESOLVER_FOUND) {
         char addrBuf[AVAHI_ADDRESS_STR_MAX];
         avahi_address_snprint(addrBuf, sizeof(addrBuf), address);
@@ -31,7 +140,21 @@ static void resolve_callback(
         svc.hostname = host_name ? host_name : "";
         svc.address = addrBuf;
         svc.port = port;
-        out->push_back(svc);
+
+        std::string endpoint = svc.address + ":" + std::to_string(port);
+        if (st->seenEndpoints.insert(endpoint).second && !st->full()) {
+            if (!st->prober) {
+                st->report(std::move(svc));
+            } else if (!txtRulesOut(txt)) {
+                // Probed right away, while the browse goes on.
+                std::string url = serviceUrl(svc);
+                st->prober->add(url, st->opts->probeTimeoutMs);
+                st->probing.emplace(url, std::move(svc));
+            }
+        }
+    } else {
+        // Let the same service on another interface try again.
+        st->claimedNames.erase(serviceKey(name, type, domain));
     }
     avahi_service_resolver_free(r);
 }
@@ -47,65 +170,119 @@ static void browse_callback(
     AvahiLookupResultFlags /*flags*/,
     void* userdata)
 {
-    auto* services = static_cast<std::vector<DiscoveredService>*>(userdata);
+    auto* st = static_cast<BrowseState*>(userdata);
     AvahiClient* client = avahi_service_browser_get_client(b);
 
-    if (event == AVAHI_BROWSER_NEW) {
-        avahi_service_resolver_new(
-            client, interface, protocol,
-            name, type, domain,
-            AVAHI_PROTO_UNSPEC, AvahiLookupFlags(0),
-            resolve_callback, services);
+    switch (event) {
+    case AVAHI_BROWSER_NEW:
+        // One resolver per service, whatever interface/protocol announced it.
+        if (!st->claimedNames.insert(serviceKey(name, type, domain)).second) break;
+        // Resolve to IPv4 only; callers build http://<address> URLs from it.
+        if (avahi_service_resolver_new(
+                client, interface, protocol,
+                name, type, domain,
+                AVAHI_PROTO_INET, AvahiLookupFlags(0),
+                resolve_callback, st)) {
+            st->pendingResolvers++;
+        } else {
+            st->claimedNames.erase(serviceKey(name, type, domain));
+        }
+        break;
+    case AVAHI_BROWSER_ALL_FOR_NOW:
+        st->allForNow = true;
+        break;
+    case AVAHI_BROWSER_FAILURE:
+        st->failed = true;
+        break;
+    default:
+        break;
     }
 }
 
+static void client_callback(AvahiClient* /*c*/, AvahiClientState state, void* userdata) {
+    if (state == AVAHI_CLIENT_FAILURE) static_cast<BrowseState*>(userdata)->failed = true;
+}
+
 DiscoveryService::DiscoveryService() = default;
 DiscoveryService::~DiscoveryService() = default;
 
-std::vector<DiscoveredService> DiscoveryService::discoverMDNS(int timeoutMs) {
-    results_.clear();
+std::vector<DiscoveredService> DiscoveryService::discover(const DiscoveryOptions& opts, const Callback& onFound) {
+    BrowseState st;
+    st.opts = &opts;
+    st.onFound = &onFound;
 
-    simplePoll = avahi_simple_poll_new();
-    if (!simplePoll) {
+    AvahiSimplePoll* poll = avahi_simple_poll_new();
+    if (!poll) {
         std::cerr << "Failed to create Avahi simple poll\n";
-        return results_;
+        return st.results;
     }
 
     int error;
     AvahiClient* client = avahi_client_new(
-        avahi_simple_poll_get(simplePoll),
-        AvahiClientFlags(0), nullptr, nullptr, &error);
+        avahi_simple_poll_get(poll),
+        AvahiClientFlags(0), client_callback, &st, &error);
 
     if (!client) {
         std::cerr << "Avahi client error: " << avahi_strerror(error) << "\n";
-        avahi_simple_poll_free(simplePoll);
-        return results_;
+        avahi_simple_poll_free(poll);
+        return st.results;
     }
 
     const char* serviceType = "_http._tcp";
     AvahiServiceBrowser* browser = avahi_service_browser_new(
         client, AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC,
         serviceType, nullptr, AvahiLookupFlags(0),
-        browse_callback, &results_);
+        browse_callback, &st);
 
     if (!browser) {
         std::cerr << "Failed to create Avahi browser\n";
         avahi_client_free(client);
-        avahi_simple_poll_free(simplePoll);
-        return results_;
+        avahi_simple_poll_free(poll);
+        return st.results;
     }
 
-    std::thread pollThread([timeoutMs]() {
-        avahi_simple_poll_loop(simplePoll);
-    });
+    // Finished probes wake the poll, so they are reported without delay.
+    std::unique_ptr<util::VersionProber> prober;
+    if (opts.confirm) {
+        prober = std::make_unique<util::VersionProber>(opts.password, [poll] { avahi_simple_poll_wakeup(poll); });
+        st.prober = prober.get();
+    }
+    auto cancelled = [&] { return opts.cancel && opts.cancel->load(); };
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
-    avahi_simple_poll_quit(simplePoll);
-    pollThread.join();
+    // Drive the poll on this thread until done or the deadline passes.
+    using Clock = std::chrono::steady_clock;
+    auto deadline = Clock::now() + std::chrono::milliseconds(opts.timeoutMs);
+    while (!st.done() && !cancelled()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0) break;
+        // With a cancel flag, wake up often enough to notice it.
+        if (opts.cancel) left = std::min<decltype(left)>(left, 20);
+        if (avahi_simple_poll_iterate(poll, static_cast<int>(left)) != 0) break;
+        if (prober) collectProbes(st);
+    }
 
+    // Freeing the client also frees any resolvers still in flight.
     avahi_service_browser_free(browser);
     avahi_client_free(client);
-    avahi_simple_poll_free(simplePoll);
 
-    return results_;
+    // Probes still running end at their own deadlines, so this waits for the
+    // slowest of them at most.
+    if (prober) {
+        while (prober->pending() > 0 && !st.full() && !cancelled()) {
+            prober->wait(opts.cancel ? 20 : 100);
+            collectProbes(st);
+        }
+        prober.reset(); // before the poll it wakes
+    }
+    avahi_simple_poll_free(poll);
+
+    return st.results;
+}
+
+std::vector<DiscoveredService> DiscoveryService::discoverMDNS(int timeoutMs, int probeTimeoutMs) {
+    DiscoveryOptions opts;
+    opts.timeoutMs = timeoutMs;
+    opts.confirm = true;
+    opts.probeTimeoutMs = probeTimeoutMs;
+    return discover(opts);
 }
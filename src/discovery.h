@@ -1,23 +1,54 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
+#include <cstddef>
 #include <cstdint>   // for uint16_t
+#include <functional>
 
 struct DiscoveredService {
     std::string hostname; // e.g., "C64U-01.local"
     std::string address;  // e.g., "10.0.0.183"
     uint16_t port = 0;
+    std::string firmware; // "version" from /v1/version, once confirmed
+    double rttMs = 0;     // of that probe; 0 = not probed
+};
+
+// Base URL of a discovered service ("http://addr" plus a non-default port).
+std::string serviceUrl(const DiscoveredService& s);
+
+struct DiscoveryOptions {
+    int timeoutMs = 800;      // hard upper bound for the browse
+    size_t maxResults = 0;    // stop after this many unique services (0 = no limit)
+    bool stopWhenIdle = true; // stop once Avahi has reported everything it knows
+    const std::atomic<bool>* cancel = nullptr; // stop early once set
+
+    // Report only confirmed Ultimates. Each service is checked as soon as
+    // it resolves: TXT records that name another product rule it out, the
+    // rest get a GET /v1/version with its own deadline. The probes run
+    // concurrently with the browse and each other, so confirmation adds at
+    // most one probe deadline after the last service resolved.
+    bool confirm = false;
+    int probeTimeoutMs = 1000;
+    std::string password;     // for the probe; protected devices answer 403 without it
 };
 
 class DiscoveryService {
 public:
+    using Callback = std::function<void(const DiscoveredService&)>;
+
     DiscoveryService();
     ~DiscoveryService();
 
-    // Returns a list of discovered services via mDNS 
-    std::vector<DiscoveredService> discoverMDNS(int timeoutMs = 800);
+    // Browses _http._tcp and calls onFound for each unique service as soon as
+    // it resolves (or, with opts.confirm, is confirmed), on the calling
+    // thread. Services seen on several interfaces or over IPv4 and IPv6 are
+    // reported once. Each call owns its own Avahi poll and client, so
+    // several discoveries may run concurrently on different threads.
+    std::vector<DiscoveredService> discover(const DiscoveryOptions& opts, const Callback& onFound = nullptr);
 
-private:
-    std::vector<DiscoveredService> results_;
+    // The Ultimates announced via mDNS, with firmware and probe RTT;
+    // printers, NAS boxes and routers announcing HTTP are left out.
+    std::vector<DiscoveredService> discoverMDNS(int timeoutMs = 800, int probeTimeoutMs = 1000);
 };
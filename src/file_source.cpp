@@ -0,0 +1,60 @@
+#include "file_source.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileSource::FileSource(const std::string& path) : path_(path) {
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) throw std::runtime_error("Failed to open file: " + path);
+
+    struct stat st{};
+    if (fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd_);
+        throw std::runtime_error("Not a regular file: " + path);
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+
+    if (size_ > 0) {
+        void* m = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (m != MAP_FAILED) {
+            map_ = static_cast<const uint8_t*>(m);
+            madvise(m, size_, MADV_SEQUENTIAL);
+        }
+    }
+}
+
+FileSource::~FileSource() {
+    if (map_) munmap(const_cast<uint8_t*>(map_), size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+size_t FileSource::read(uint64_t offset, uint8_t* dst, size_t len) const {
+    if (offset >= size_) return 0;
+    len = static_cast<size_t>(std::min<uint64_t>(len, size_ - offset));
+    if (map_) {
+        std::memcpy(dst, map_ + offset, len);
+        return len;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd_, dst + done, len - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw std::runtime_error("Failed to read file: " + path_);
+        if (n == 0) break;
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+std::vector<uint8_t> FileSource::head(size_t n) const {
+    std::vector<uint8_t> out(static_cast<size_t>(std::min<uint64_t>(n, size_)));
+    out.resize(read(0, out.data(), out.size()));
+    return out;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only file used as a streaming upload body. The file is memory-mapped
+// when possible and read incrementally with pread() otherwise, so uploads
+// never hold a copy of the whole image in memory.
+class FileSource {
+public:
+    explicit FileSource(const std::string& path);
+    ~FileSource();
+
+    FileSource(const FileSource&) = delete;
+    FileSource& operator=(const FileSource&) = delete;
+
+    const std::string& path() const { return path_; }
+    uint64_t size() const { return size_; }
+    bool mapped() const { return map_ != nullptr; }
+
+    // Copies up to len bytes at offset into dst; returns the count copied.
+    size_t read(uint64_t offset, uint8_t* dst, size_t len) const;
+
+    // First n bytes (fewer if the file is shorter).
+    std::vector<uint8_t> head(size_t n) const;
+
+    // Sequential cursor used by the HTTP read callback.
+    uint64_t pos = 0;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    const uint8_t* map_ = nullptr;
+    uint64_t size_ = 0;
+};
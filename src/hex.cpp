@@ -0,0 +1,168 @@
+#include "hex.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// "000102...feff": the two digits of every byte value.
+struct DigitPairs {
+    char c[512];
+};
+
+constexpr DigitPairs makePairs() {
+    const char digits[] = "0123456789abcdef";
+    DigitPairs p{};
+    for (int i = 0; i < 256; ++i) {
+        p.c[2 * i] = digits[i >> 4];
+        p.c[2 * i + 1] = digits[i & 0x0F];
+    }
+    return p;
+}
+
+constexpr DigitPairs kPairs = makePairs();
+
+// Digit values; kSkip for separators, kBad for anything else.
+constexpr int8_t kSkip = -1;
+constexpr int8_t kBad = -2;
+
+struct DigitValues {
+    int8_t v[256];
+};
+
+constexpr DigitValues makeValues() {
+    DigitValues t{};
+    for (int i = 0; i < 256; ++i) t.v[i] = kBad;
+    for (int i = 0; i < 10; ++i) t.v['0' + i] = static_cast<int8_t>(i);
+    for (int i = 0; i < 6; ++i) {
+        t.v['a' + i] = static_cast<int8_t>(10 + i);
+        t.v['A' + i] = static_cast<int8_t>(10 + i);
+    }
+    for (char c : {' ', '\t', '\r', '\n', ',', ':'}) t.v[static_cast<unsigned char>(c)] = kSkip;
+    return t;
+}
+
+constexpr DigitValues kValues = makeValues();
+
+inline char printable(uint8_t b) {
+    return b >= 0x20 && b < 0x7F ? static_cast<char>(b) : '.';
+}
+
+#if defined(__SSE2__)
+// 16 bytes to 32 digits: split nibbles, map 0-9 and 10-15 to their ASCII
+// ranges with a compare mask, and interleave high and low digits.
+inline void encode16(const uint8_t* src, char* dst) {
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    auto ascii = [](__m128i x) {
+        __m128i letter = _mm_cmpgt_epi8(x, _mm_set1_epi8(9));
+        return _mm_add_epi8(_mm_add_epi8(x, _mm_set1_epi8('0')),
+                            _mm_and_si128(letter, _mm_set1_epi8('a' - '0' - 10)));
+    };
+    hi = ascii(hi);
+    lo = ascii(lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(hi, lo));
+}
+#endif
+
+} // namespace
+
+char* hex::encode(const uint8_t* src, size_t n, char* dst) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16, dst += 32) encode16(src + i, dst);
+#endif
+    for (; i < n; ++i, dst += 2) std::memcpy(dst, kPairs.c + 2 * src[i], 2);
+    return dst;
+}
+
+std::string hex::encode(const std::vector<uint8_t>& bytes) {
+    std::string s(bytes.size() * 2, '\0');
+    encode(bytes.data(), bytes.size(), &s[0]);
+    return s;
+}
+
+std::string hex::encodeSpaced(const std::vector<uint8_t>& bytes) {
+    if (bytes.empty()) return std::string();
+    std::string s(bytes.size() * 3 - 1, ' ');
+    for (size_t i = 0; i < bytes.size(); ++i) std::memcpy(&s[3 * i], kPairs.c + 2 * bytes[i], 2);
+    return s;
+}
+
+std::vector<uint8_t> hex::decode(std::string_view text) {
+    std::vector<uint8_t> out;
+    out.reserve(text.size() / 2);
+    int hi = -1;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        int8_t v = kValues.v[c];
+        if (v >= 0) {
+            if (hi < 0) { hi = v; continue; }
+            out.push_back(static_cast<uint8_t>((hi << 4) | v));
+            hi = -1;
+            continue;
+        }
+        if (v == kBad && c != '#') {
+            throw std::runtime_error("Invalid character in hex data at offset " + std::to_string(i));
+        }
+        if (hi >= 0) throw std::runtime_error("Odd hex digit at offset " + std::to_string(i));
+        if (c == '#') {
+            size_t eol = text.find('\n', i);
+            if (eol == std::string_view::npos) break;
+            i = eol;
+        }
+    }
+    if (hi >= 0) throw std::runtime_error("Odd number of hex digits");
+    return out;
+}
+
+char* hex::dumpLine(const uint8_t* src, size_t n, uint16_t address, char* dst) {
+    if (n > kBytesPerLine) n = kBytesPerLine;
+    uint8_t a[2] = {static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address)};
+    dst = encode(a, 2, dst);
+    *dst++ = ' ';
+
+    char digits[2 * kBytesPerLine];
+    encode(src, n, digits);
+    for (size_t i = 0; i < kBytesPerLine; ++i) {
+        *dst++ = ' ';
+        if (i == 8) *dst++ = ' ';
+        if (i < n) {
+            dst[0] = digits[2 * i];
+            dst[1] = digits[2 * i + 1];
+        } else {
+            dst[0] = dst[1] = ' ';
+        }
+        dst += 2;
+    }
+    *dst++ = ' ';
+    *dst++ = ' ';
+    *dst++ = '|';
+    for (size_t i = 0; i < n; ++i) *dst++ = printable(src[i]);
+    *dst++ = '|';
+    *dst++ = '\n';
+    return dst;
+}
+
+void hex::writeDump(std::ostream& out, const uint8_t* src, size_t n, uint16_t address) {
+    // 256 lines (4 KB of memory) per write.
+    constexpr size_t kLinesPerBlock = 256;
+    std::string block(kLinesPerBlock * kMaxLineChars, '\0');
+    size_t off = 0;
+    while (off < n) {
+        char* p = &block[0];
+        for (size_t line = 0; line < kLinesPerBlock && off < n; ++line) {
+            size_t len = n - off < kBytesPerLine ? n - off : kBytesPerLine;
+            p = dumpLine(src + off, len, static_cast<uint16_t>(address + off), p);
+            off += len;
+        }
+        out.write(block.data(), p - block.data());
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Hex encoding, decoding and hexdump formatting for memory contents. These
+// run over whole 64 KB images and are written to keep that well below the
+// cost of reading the memory over the network: table lookups (and SSE2
+// where available) instead of per-byte stream formatting, and output
+// assembled in large blocks.
+namespace hex {
+
+// Two lowercase digits per byte; dst needs 2 * n chars. Returns dst + 2 * n.
+char* encode(const uint8_t* src, size_t n, char* dst);
+std::string encode(const std::vector<uint8_t>& bytes);
+
+// The same with a space between bytes, "a9 ff", for short values on the
+// command line.
+std::string encodeSpaced(const std::vector<uint8_t>& bytes);
+
+// Hex digit pairs, skipping whitespace, commas, colons and '#' comments
+// that run to the end of the line. Throws on other characters and on a
+// byte split by a separator or cut short.
+std::vector<uint8_t> decode(std::string_view text);
+
+// hexdump -C style, 16 bytes per line:
+//   c000  a9 00 8d 20 d0 60 00 00  00 00 00 00 00 00 00 00  |... .`..........|
+// address is that of src[0].
+constexpr size_t kBytesPerLine = 16;
+constexpr size_t kMaxLineChars = 80;
+
+// One line of at most kBytesPerLine bytes, ending in '\n'. Returns the end.
+char* dumpLine(const uint8_t* src, size_t n, uint16_t address, char* dst);
+
+// All of src as dump lines, written in large blocks.
+void writeDump(std::ostream& out, const uint8_t* src, size_t n, uint16_t address);
+
+} // namespace hex
@@ -0,0 +1,165 @@
+#include "memory_mirror.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct Run {
+    uint32_t begin;
+    uint32_t end;
+};
+
+// True when block [i, i+16) or [i, i+8) has no dirty byte. A byte is dirty
+// when it is selected and either differs from the shadow or is unknown.
+#if defined(__SSE2__)
+constexpr uint32_t kBlock = 16;
+
+inline bool blockClean(const uint8_t* a, const uint8_t* b, const uint8_t* known, const uint8_t* sel, uint32_t i) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    __m128i vk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(known + i));
+    __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel + i));
+    __m128i diff = _mm_or_si128(_mm_xor_si128(va, vb), _mm_andnot_si128(vk, _mm_set1_epi8(-1)));
+    __m128i dirty = _mm_and_si128(diff, vs);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(dirty, _mm_setzero_si128())) == 0xFFFF;
+}
+#else
+constexpr uint32_t kBlock = 8;
+
+inline uint64_t load64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline bool blockClean(const uint8_t* a, const uint8_t* b, const uint8_t* known, const uint8_t* sel, uint32_t i) {
+    uint64_t diff = (load64(a + i) ^ load64(b + i)) | ~load64(known + i);
+    return (diff & load64(sel + i)) == 0;
+}
+#endif
+
+inline bool byteDirty(const uint8_t* a, const uint8_t* b, const uint8_t* known, const uint8_t* sel, uint32_t i) {
+    return sel[i] && (a[i] != b[i] || !known[i]);
+}
+
+// Maximal runs of dirty bytes in [lo, hi). Clean blocks are skipped whole.
+std::vector<Run> dirtyRuns(const uint8_t* a, const uint8_t* b, const uint8_t* known, const uint8_t* sel,
+                           uint32_t lo, uint32_t hi) {
+    std::vector<Run> runs;
+    bool inRun = false;
+    uint32_t runStart = 0;
+
+    uint32_t i = lo;
+    while (i < hi) {
+        if (!inRun && i + kBlock <= hi && blockClean(a, b, known, sel, i)) {
+            i += kBlock;
+            continue;
+        }
+        bool d = byteDirty(a, b, known, sel, i);
+        if (d && !inRun) { inRun = true; runStart = i; }
+        else if (!d && inRun) { inRun = false; runs.push_back({runStart, i}); }
+        ++i;
+    }
+    if (inRun) runs.push_back({runStart, hi});
+    return runs;
+}
+
+} // namespace
+
+MemoryMirror::MemoryMirror(U64Server& server) : MemoryMirror(server, Options()) {}
+
+MemoryMirror::MemoryMirror(U64Server& server, Options opts)
+    : server_(server), opts_(opts),
+      shadow_(0x10000, 0), known_(0x10000, 0), target_(0x10000, 0), staged_(0x10000, 0) {}
+
+void MemoryMirror::sync(uint16_t address, uint32_t length) {
+    if (static_cast<uint32_t>(address) + length > 0x10000) {
+        throw std::runtime_error("MemoryMirror::sync: range exceeds 64 KB address space");
+    }
+    auto bytes = server_.peekMemoryBulk(address, length);
+    std::memcpy(shadow_.data() + address, bytes.data(), length);
+    std::memset(known_.data() + address, 0xFF, length);
+    for (uint32_t i = address; i < address + length; ++i) {
+        if (!staged_[i]) target_[i] = shadow_[i];
+    }
+}
+
+void MemoryMirror::invalidate(uint16_t address, uint32_t length) {
+    uint32_t end = std::min<uint32_t>(0x10000, static_cast<uint32_t>(address) + length);
+    std::memset(known_.data() + address, 0, end - address);
+}
+
+void MemoryMirror::stage(uint16_t address, const uint8_t* data, size_t length) {
+    if (static_cast<size_t>(address) + length > 0x10000) {
+        throw std::runtime_error("MemoryMirror::stage: range exceeds 64 KB address space");
+    }
+    if (length == 0) return;
+    std::memcpy(target_.data() + address, data, length);
+    std::memset(staged_.data() + address, 0xFF, length);
+    dirtyLo_ = std::min<uint32_t>(dirtyLo_, address);
+    dirtyHi_ = std::max<uint32_t>(dirtyHi_, static_cast<uint32_t>(address + length));
+    stats_.bytesStaged += length;
+}
+
+std::vector<MemoryMirror::Span> MemoryMirror::pendingSpans() const {
+    std::vector<Span> spans;
+    if (dirtyLo_ >= dirtyHi_) return spans;
+
+    auto runs = dirtyRuns(target_.data(), shadow_.data(), known_.data(), staged_.data(), dirtyLo_, dirtyHi_);
+
+    // A gap may be bridged only if every byte in it has a trustworthy value
+    // to send: either staged by the caller or known from the shadow.
+    auto bridgeable = [&](uint32_t from, uint32_t to) {
+        if (to - from > opts_.gapThreshold) return false;
+        for (uint32_t i = from; i < to; ++i) {
+            if (!staged_[i] && !known_[i]) return false;
+        }
+        return true;
+    };
+
+    for (const Run& r : runs) {
+        if (!spans.empty()) {
+            Span& last = spans.back();
+            uint32_t lastEnd = last.address + last.length;
+            if (bridgeable(lastEnd, r.begin)) {
+                last.length = r.end - last.address;
+                continue;
+            }
+        }
+        spans.push_back({static_cast<uint16_t>(r.begin), r.end - r.begin});
+    }
+    return spans;
+}
+
+size_t MemoryMirror::flush() {
+    auto spans = pendingSpans();
+
+    for (const Span& s : spans) {
+        std::vector<uint8_t> payload(target_.begin() + s.address, target_.begin() + s.address + s.length);
+        server_.pokeMemory(s.address, payload);
+
+        std::memcpy(shadow_.data() + s.address, payload.data(), s.length);
+        std::memset(known_.data() + s.address, 0xFF, s.length);
+        stats_.requests++;
+        stats_.bytesSent += s.length;
+    }
+
+    if (dirtyLo_ < dirtyHi_) {
+        std::memset(staged_.data() + dirtyLo_, 0, dirtyHi_ - dirtyLo_);
+        // Everything staged is on the device now; target_ falls back to the shadow.
+        for (uint32_t i = dirtyLo_; i < dirtyHi_; ++i) target_[i] = shadow_[i];
+    }
+    dirtyLo_ = 0x10000;
+    dirtyHi_ = 0;
+    return spans.size();
+}
+
+size_t MemoryMirror::write(uint16_t address, const std::vector<uint8_t>& data) {
+    stage(address, data);
+    return flush();
+}
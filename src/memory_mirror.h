@@ -0,0 +1,70 @@
+#pragma once
+#include "u64_server.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Local shadow of the C64's 64 KB address space layered on U64Server.
+// Writes are diffed against the shadow and only the changed bytes are sent,
+// with nearby changes merged into as few machine:writemem requests as
+// possible. The shadow assumes nothing else writes the same memory; call
+// sync() or invalidate() when the program on the device may have.
+class MemoryMirror {
+public:
+    struct Options {
+        // Runs of unchanged bytes up to this long are sent anyway to merge
+        // two changed spans into one request (0 = never merge).
+        uint32_t gapThreshold = 16;
+    };
+
+    struct Span {
+        uint16_t address = 0;
+        uint32_t length = 0;
+    };
+
+    struct Stats {
+        uint64_t requests = 0;   // writemem requests issued
+        uint64_t bytesSent = 0;  // payload bytes, including merged gaps
+        uint64_t bytesStaged = 0;
+    };
+
+    explicit MemoryMirror(U64Server& server);
+    MemoryMirror(U64Server& server, Options opts);
+
+    // Reads [address, address+length) from the device into the shadow.
+    void sync(uint16_t address, uint32_t length);
+    void syncAll() { sync(0, 0x10000); }
+
+    // Forgets the shadow for a range; those bytes are always sent next time.
+    void invalidate(uint16_t address, uint32_t length);
+
+    // Queues bytes for the next flush(); later stages overwrite earlier ones.
+    void stage(uint16_t address, const uint8_t* data, size_t length);
+    void stage(uint16_t address, const std::vector<uint8_t>& data) { stage(address, data.data(), data.size()); }
+
+    // Sends everything staged that differs from the shadow. Returns the
+    // number of writemem requests issued.
+    size_t flush();
+
+    // stage() + flush().
+    size_t write(uint16_t address, const std::vector<uint8_t>& data);
+
+    // The spans flush() would send right now.
+    std::vector<Span> pendingSpans() const;
+
+    bool known(uint16_t address) const { return known_[address] != 0; }
+    uint8_t shadow(uint16_t address) const { return shadow_[address]; }
+    const Stats& stats() const { return stats_; }
+
+private:
+    U64Server& server_;
+    Options opts_;
+    Stats stats_;
+
+    std::vector<uint8_t> shadow_; // last known device contents
+    std::vector<uint8_t> known_;  // 0xFF where shadow_ is valid
+    std::vector<uint8_t> target_; // shadow_ plus staged bytes
+    std::vector<uint8_t> staged_; // 0xFF where target_ holds a staged byte
+    uint32_t dirtyLo_ = 0x10000;  // staged window [dirtyLo_, dirtyHi_)
+    uint32_t dirtyHi_ = 0;
+};
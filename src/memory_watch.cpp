@@ -0,0 +1,177 @@
+#include "memory_watch.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+MemoryWatcher::Watch MemoryWatcher::equals(uint16_t address, std::vector<uint8_t> value) {
+    Watch w;
+    w.address = address;
+    w.length = static_cast<uint32_t>(value.size());
+    w.cond = Condition::Equals;
+    w.value = std::move(value);
+    return w;
+}
+
+MemoryWatcher::Watch MemoryWatcher::notEquals(uint16_t address, std::vector<uint8_t> value) {
+    Watch w = equals(address, std::move(value));
+    w.cond = Condition::NotEquals;
+    return w;
+}
+
+MemoryWatcher::Watch MemoryWatcher::changed(uint16_t address, uint32_t length) {
+    Watch w;
+    w.address = address;
+    w.length = length;
+    w.cond = Condition::Changed;
+    return w;
+}
+
+MemoryWatcher::Watch MemoryWatcher::maskEquals(uint16_t address, std::vector<uint8_t> mask, std::vector<uint8_t> value) {
+    if (mask.size() != value.size()) throw std::runtime_error("maskEquals: mask and value differ in length");
+    Watch w = equals(address, std::move(value));
+    w.cond = Condition::MaskEquals;
+    w.mask = std::move(mask);
+    return w;
+}
+
+MemoryWatcher::MemoryWatcher(U64Server& server) : MemoryWatcher(server, Options()) {}
+
+MemoryWatcher::MemoryWatcher(U64Server& server, Options opts)
+    : server_(server), opts_(opts), intervalMs_(opts.minIntervalMs) {}
+
+int MemoryWatcher::add(Watch w) {
+    if (w.length == 0) throw std::runtime_error("watch length must be > 0");
+    if (static_cast<uint32_t>(w.address) + w.length > 0x10000) {
+        throw std::runtime_error("watch range exceeds 64 KB address space");
+    }
+    if (w.cond != Condition::Changed && w.value.size() != w.length) {
+        throw std::runtime_error("watch value length does not match range");
+    }
+    Entry e;
+    e.watch = std::move(w);
+    entries_.push_back(std::move(e));
+    batchesDirty_ = true;
+    return static_cast<int>(entries_.size() - 1);
+}
+
+void MemoryWatcher::rebuildBatches() {
+    batches_.clear();
+    std::vector<size_t> order(entries_.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return entries_[a].watch.address < entries_[b].watch.address;
+    });
+
+    for (size_t i : order) {
+        const Watch& w = entries_[i].watch;
+        uint32_t end = w.address + w.length;
+        if (!batches_.empty()) {
+            Batch& b = batches_.back();
+            uint32_t bEnd = b.address + b.length;
+            if (w.address <= bEnd + opts_.mergeGap) {
+                b.length = std::max(bEnd, end) - b.address;
+                b.entries.push_back(i);
+                continue;
+            }
+        }
+        Batch b;
+        b.address = w.address;
+        b.length = w.length;
+        b.entries.push_back(i);
+        batches_.push_back(std::move(b));
+    }
+    batchesDirty_ = false;
+}
+
+bool MemoryWatcher::satisfied(const Entry& e) const {
+    const Watch& w = e.watch;
+    switch (w.cond) {
+    case Condition::Equals:    return e.current == w.value;
+    case Condition::NotEquals: return e.current != w.value;
+    case Condition::Changed:   return e.haveBaseline && e.current != e.baseline;
+    case Condition::MaskEquals:
+        for (size_t i = 0; i < e.current.size(); ++i) {
+            if ((e.current[i] & w.mask[i]) != w.value[i]) return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+std::vector<int> MemoryWatcher::pollOnce() {
+    if (batchesDirty_) rebuildBatches();
+
+    bool anyChange = false;
+    for (const Batch& b : batches_) {
+        auto t0 = Clock::now();
+        // Read into reused scratch space so steady-state polls do not allocate.
+        scratch_.resize(b.length);
+        server_.peekMemoryInto(b.address, scratch_.data(), b.length);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        // Seeded by the first batch only; a poll may read several.
+        latencyMs_ = haveLatency_ ? latencyMs_ * 0.8 + ms * 0.2 : ms;
+        haveLatency_ = true;
+
+        for (size_t i : b.entries) {
+            Entry& e = entries_[i];
+            const uint8_t* now = scratch_.data() + (e.watch.address - b.address);
+            if (!e.haveBaseline) {
+                e.baseline.assign(now, now + e.watch.length);
+                e.current = e.baseline;
+                e.haveBaseline = true;
+            } else if (!std::equal(now, now + e.watch.length, e.current.begin())) {
+                anyChange = true;
+                std::copy(now, now + e.watch.length, e.current.begin());
+            }
+        }
+    }
+    polls_++;
+
+    // Memory that moves is likely to reach the condition soon: poll at wire
+    // speed. Idle memory backs off geometrically. Never sleep less than one
+    // round trip, so at most half the device's time goes to this watcher.
+    double floor = std::max<double>(opts_.minIntervalMs, latencyMs_);
+    if (anyChange) intervalMs_ = floor;
+    else intervalMs_ = std::min<double>(opts_.maxIntervalMs, intervalMs_ * 1.5 + 1.0);
+    intervalMs_ = std::max(intervalMs_, floor);
+
+    std::vector<int> hits;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (satisfied(entries_[i])) hits.push_back(static_cast<int>(i));
+    }
+    return hits;
+}
+
+bool MemoryWatcher::waitUntil(int timeoutMs, bool all, int& hit) {
+    if (entries_.empty()) throw std::runtime_error("no watches registered");
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    ConcurrencyGovernor::Scope scope(RequestPriority::Background);
+
+    for (;;) {
+        auto hits = pollOnce();
+        if (!all && !hits.empty()) { hit = hits.front(); return true; }
+        if (all && hits.size() == entries_.size()) return true;
+
+        if (opts_.stop && opts_.stop->load()) return false;
+        auto sleep = std::chrono::duration<double, std::milli>(intervalMs_);
+        if (timeoutMs >= 0) {
+            auto now = Clock::now();
+            if (now >= deadline) return false;
+            sleep = std::min<std::chrono::duration<double, std::milli>>(sleep, deadline - now);
+        }
+        std::this_thread::sleep_for(sleep);
+    }
+}
+
+int MemoryWatcher::waitAny(int timeoutMs) {
+    int hit = -1;
+    return waitUntil(timeoutMs, false, hit) ? hit : -1;
+}
+
+bool MemoryWatcher::waitAll(int timeoutMs) {
+    int hit = -1;
+    return waitUntil(timeoutMs, true, hit);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "u64_server.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Polls watched memory ranges and evaluates predicates on them.
+// Nearby ranges are read together in one readmem request per poll, and the
+// poll interval follows the measured request latency and how often the
+// watched bytes change: fast while memory is moving, backing off while idle.
+class MemoryWatcher {
+public:
+    enum class Condition {
+        Equals,      // bytes == value
+        NotEquals,   // bytes != value
+        Changed,     // bytes differ from the first value observed
+        MaskEquals,  // (bytes & mask) == value
+    };
+
+    struct Watch {
+        uint16_t address = 0;
+        uint32_t length = 1;
+        Condition cond = Condition::Changed;
+        std::vector<uint8_t> value;
+        std::vector<uint8_t> mask;
+    };
+
+    struct Options {
+        int minIntervalMs = 2;
+        int maxIntervalMs = 100;
+        uint32_t mergeGap = 64; // ranges closer than this share one read
+        const std::atomic<bool>* stop = nullptr; // ends a wait early, as a timeout
+    };
+
+    static Watch equals(uint16_t address, std::vector<uint8_t> value);
+    static Watch notEquals(uint16_t address, std::vector<uint8_t> value);
+    static Watch changed(uint16_t address, uint32_t length);
+    static Watch maskEquals(uint16_t address, std::vector<uint8_t> mask, std::vector<uint8_t> value);
+
+    explicit MemoryWatcher(U64Server& server);
+    MemoryWatcher(U64Server& server, Options opts);
+
+    // Registers a watch and returns its id.
+    int add(Watch w);
+
+    // One round: reads every batch once and returns the ids now satisfied.
+    std::vector<int> pollOnce();
+
+    // Polls until any watch is satisfied (returns its id) or until
+    // timeoutMs elapses or Options::stop is set (returns -1). timeoutMs < 0
+    // waits forever.
+    int waitAny(int timeoutMs);
+
+    // Polls until every watch is satisfied at the same time.
+    bool waitAll(int timeoutMs);
+
+    // Current bytes of a watch as of the last poll.
+    const std::vector<uint8_t>& current(int id) const { return entries_.at(static_cast<size_t>(id)).current; }
+
+    double latencyMs() const { return latencyMs_; }
+    double intervalMs() const { return intervalMs_; }
+    size_t polls() const { return polls_; }
+
+private:
+    struct Entry {
+        Watch watch;
+        std::vector<uint8_t> baseline;
+        std::vector<uint8_t> current;
+        bool haveBaseline = false;
+    };
+
+    struct Batch {
+        uint16_t address = 0;
+        uint32_t length = 0;
+        std::vector<size_t> entries;
+    };
+
+    void rebuildBatches();
+    bool satisfied(const Entry& e) const;
+    bool waitUntil(int timeoutMs, bool all, int& hit);
+
+    U64Server& server_;
+    Options opts_;
+    std::vector<Entry> entries_;
+    std::vector<Batch> batches_;
+    bool batchesDirty_ = true;
+    std::vector<uint8_t> scratch_; // readmem target, reused across polls
+
+    double latencyMs_ = 0;   // EWMA of readmem round trips
+    bool haveLatency_ = false; // latencyMs_ holds at least one sample
+    double intervalMs_ = 0;  // current sleep between polls
+    size_t polls_ = 0;
+};
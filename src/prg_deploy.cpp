@@ -0,0 +1,129 @@
+#include "prg_deploy.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+PrgDeployer::PrgDeployer(U64Server& server, std::string stateDir)
+    : PrgDeployer(server, std::move(stateDir), Options()) {}
+
+PrgDeployer::PrgDeployer(U64Server& server, std::string stateDir, Options opts)
+    : server_(server), stateDir_(std::move(stateDir)), opts_(opts) {}
+
+std::string PrgDeployer::statePath() const {
+    // One file per device address, e.g. http___10_0_0_183.prg
+    std::string key = server_.creds().address;
+    for (auto& c : key) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-') c = '_';
+    }
+    return stateDir_ + "/" + key + ".prg";
+}
+
+void PrgDeployer::remember(const std::vector<uint8_t>& prg) const {
+    std::filesystem::create_directories(stateDir_);
+    std::string path = statePath();
+    // Unique per process, so concurrent deploys to one device cannot write
+    // into each other's temporary file.
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f) { std::remove(tmp.c_str()); throw std::runtime_error("Cannot write deploy state: " + tmp); }
+        f.write(reinterpret_cast<const char*>(prg.data()), static_cast<std::streamsize>(prg.size()));
+        f.flush();
+        if (!f) { std::remove(tmp.c_str()); throw std::runtime_error("Cannot write deploy state: " + tmp); }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot replace deploy state " + path + ": " + std::strerror(errno));
+    }
+}
+
+std::vector<PrgDeployer::Range> PrgDeployer::diff(const std::vector<uint8_t>& oldPrg,
+                                                  const std::vector<uint8_t>& newPrg) const {
+    std::vector<Range> out;
+    const uint32_t n = static_cast<uint32_t>(newPrg.size());
+    uint32_t i = 2; // skip the load address
+    while (i < n) {
+        if (oldPrg[i] == newPrg[i]) { ++i; continue; }
+        uint32_t start = i;
+        uint32_t end = i + 1; // one past the last changed byte
+        for (uint32_t j = end; j < n; ++j) {
+            if (oldPrg[j] != newPrg[j]) end = j + 1;
+            else if (j - end >= opts_.gapThreshold) break;
+        }
+        out.push_back(Range{start - 2, end - start});
+        i = end;
+    }
+    return out;
+}
+
+PrgDeployer::Result PrgDeployer::fullReload(const std::vector<uint8_t>& prg, std::string reason) {
+    server_.runPRG(prg);
+    remember(prg);
+    Result r;
+    r.reason = std::move(reason);
+    r.ranges = 1;
+    r.bytesSent = prg.size();
+    return r;
+}
+
+PrgDeployer::Result PrgDeployer::deploy(const std::vector<uint8_t>& prg) {
+    if (prg.size() < 2) throw std::runtime_error("PRG too short");
+
+    std::vector<uint8_t> old;
+    {
+        std::ifstream f(statePath(), std::ios::binary);
+        if (!f) return fullReload(prg, "no previous build for this device");
+        old.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+    if (old.size() != prg.size() || old[0] != prg[0] || old[1] != prg[1]) {
+        return fullReload(prg, "load address or size changed");
+    }
+
+    const uint32_t load = prg[0] | (prg[1] << 8);
+    if (load + prg.size() - 2 > 0x10000) return fullReload(prg, "program wraps past $FFFF");
+
+    std::vector<Range> ranges = diff(old, prg);
+    if (ranges.empty()) {
+        Result r;
+        r.incremental = true;
+        return r;
+    }
+    size_t changed = 0;
+    for (const Range& rg : ranges) changed += rg.length;
+    if (ranges.size() > opts_.maxRanges || changed > opts_.maxChangedRatio * (prg.size() - 2)) {
+        return fullReload(prg, "too much changed");
+    }
+
+    // The patch is only valid if the device still holds the previous build
+    // where it goes; a reset, another program or self-modifying code all
+    // show up here. One bulk read spans all the ranges instead of a round
+    // trip per range.
+    const uint32_t spanStart = ranges.front().offset;
+    const uint32_t spanLength = ranges.back().offset + ranges.back().length - spanStart;
+    auto now = server_.peekMemoryBulk(static_cast<uint16_t>(load + spanStart), spanLength);
+    for (const Range& rg : ranges) {
+        auto at = now.begin() + (rg.offset - spanStart);
+        if (!std::equal(at, at + rg.length, old.begin() + 2 + rg.offset)) {
+            return fullReload(prg, "device memory no longer matches the previous build");
+        }
+    }
+
+    Result r;
+    r.incremental = true;
+    for (const Range& rg : ranges) {
+        auto first = prg.begin() + 2 + rg.offset;
+        server_.pokeMemory(static_cast<uint16_t>(load + rg.offset), std::vector<uint8_t>(first, first + rg.length));
+        r.ranges++;
+        r.bytesSent += rg.length;
+    }
+    remember(prg);
+    return r;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "u64_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Incremental PRG deployment for the edit-build-run loop. The last PRG sent
+// to each device is remembered in stateDir; when the next build has the
+// same load address and size, only the changed byte ranges are written
+// with machine:writemem, patching the program in place without a reset.
+// A full runPRG is used instead when there is no previous build, the
+// layout changed, most of the program changed, or the device's memory no
+// longer holds the previous build where the patch would go.
+class PrgDeployer {
+public:
+    struct Options {
+        uint32_t gapThreshold = 16;    // unchanged bytes merged into one write
+        size_t maxRanges = 64;         // more ranges than this: full reload
+        double maxChangedRatio = 0.5;  // more changed than this: full reload
+    };
+
+    struct Result {
+        bool incremental = false;
+        std::string reason;      // why a full reload was used
+        size_t ranges = 0;       // writemem requests issued
+        size_t bytesSent = 0;
+    };
+
+    PrgDeployer(U64Server& server, std::string stateDir);
+    PrgDeployer(U64Server& server, std::string stateDir, Options opts);
+
+    Result deploy(const std::vector<uint8_t>& prg);
+
+    // Where the previous build for this device is kept.
+    std::string statePath() const;
+
+private:
+    struct Range {
+        uint32_t offset = 0; // into the program image, after the load address
+        uint32_t length = 0;
+    };
+
+    std::vector<Range> diff(const std::vector<uint8_t>& oldPrg, const std::vector<uint8_t>& newPrg) const;
+    Result fullReload(const std::vector<uint8_t>& prg, std::string reason);
+    void remember(const std::vector<uint8_t>& prg) const;
+
+    U64Server& server_;
+    std::string stateDir_;
+    Options opts_;
+};
@@ -0,0 +1,196 @@
+#include "request_stats.h"
+#include "util.h"
+#include <algorithm>
+#include <iomanip>
+
+// ---------------------
+// LatencyHistogram
+// ---------------------
+size_t LatencyHistogram::bucketOf(uint64_t us) {
+    if (us < kSub) return static_cast<size_t>(us);
+    int msb = 63 - __builtin_clzll(us);          // us >= 8, so msb >= 3
+    int shift = msb - 3;                          // keep the top 4 bits
+    size_t sub = static_cast<size_t>((us >> shift) & (kSub - 1));
+    size_t b = static_cast<size_t>(msb - 2) * kSub + sub;
+    return std::min<size_t>(b, kBuckets - 1);
+}
+
+uint64_t LatencyHistogram::bucketUpper(size_t b) {
+    if (b < kSub) return b;
+    size_t msb = b / kSub + 2;
+    uint64_t sub = b % kSub;
+    uint64_t base = (uint64_t(kSub) | sub) << (msb - 3);
+    return base + ((uint64_t(1) << (msb - 3)) - 1);
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    buckets_[bucketOf(us)]++;
+    count_++;
+    sumUs_ += us;
+    minUs_ = std::min(minUs_, us);
+    maxUs_ = std::max(maxUs_, us);
+}
+
+double LatencyHistogram::percentileMs(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets_.size(); ++b) {
+        seen += buckets_[b];
+        if (seen >= rank) return std::min(bucketUpper(b), maxUs_) / 1000.0;
+    }
+    return maxMs();
+}
+
+void LatencyHistogram::writeJson(std::ostream& out) const {
+    out << "{\"count\": " << count_
+        << ", \"mean\": " << meanMs()
+        << ", \"min\": " << minMs()
+        << ", \"p50\": " << percentileMs(0.50)
+        << ", \"p90\": " << percentileMs(0.90)
+        << ", \"p99\": " << percentileMs(0.99)
+        << ", \"max\": " << maxMs() << "}";
+}
+
+// ---------------------
+// RequestStats
+// ---------------------
+RequestStats::Endpoint& RequestStats::endpoint(std::string_view name) {
+    auto it = endpoints_.find(name);
+    if (it == endpoints_.end()) it = endpoints_.emplace(std::string(name), Endpoint()).first;
+    return it->second;
+}
+
+void RequestStats::record(const Sample& s) {
+    std::lock_guard<std::mutex> lk(mu_);
+    Endpoint& e = endpoint(s.endpoint);
+    e.requests++;
+    if (!s.ok) e.failures++;
+    e.status[s.httpCode]++;
+    e.bytesUp += s.bytesUp;
+    e.bytesDown += s.bytesDown;
+    if (s.httpCode == 0) return; // no timings for transport failures
+    e.nameLookup.record(s.nameLookupUs);
+    e.connect.record(s.connectUs);
+    e.firstByte.record(s.firstByteUs);
+    e.total.record(s.totalUs);
+}
+
+void RequestStats::recordRetry(std::string_view name, std::string_view reason) {
+    std::lock_guard<std::mutex> lk(mu_);
+    Endpoint& e = endpoint(name);
+    e.retries++;
+    if (reason.empty()) return;
+    auto it = e.retryReasons.find(reason);
+    if (it == e.retryReasons.end()) it = e.retryReasons.emplace(std::string(reason), 0).first;
+    it->second++;
+}
+
+void RequestStats::recordHedge(std::string_view name, bool won) {
+    std::lock_guard<std::mutex> lk(mu_);
+    Endpoint& e = endpoint(name);
+    e.hedges++;
+    if (won) e.hedgeWins++;
+}
+
+void RequestStats::recordConcurrency(const ConcurrencyGovernor::State& s) {
+    std::lock_guard<std::mutex> lk(mu_);
+    concurrencyRaw_ = s;
+    // The governor's counters are cumulative; report them since the reset.
+    // Every change is published, so the peak can be followed here.
+    int peak = std::max(concurrency_.peakQueued, s.queued[0] + s.queued[1] + s.queued[2]);
+    concurrency_ = s;
+    concurrency_.granted = s.granted - concurrencyBase_.granted;
+    concurrency_.waited = s.waited - concurrencyBase_.waited;
+    concurrency_.decreases = s.decreases - concurrencyBase_.decreases;
+    concurrency_.peakQueued = peak;
+}
+
+double RequestStats::percentileMs(std::string_view name, double p, uint64_t minSamples) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = endpoints_.find(name);
+    if (it == endpoints_.end() || it->second.total.count() < minSamples || it->second.total.count() == 0) return -1;
+    return it->second.total.percentileMs(p);
+}
+
+uint64_t RequestStats::totalRequests() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    uint64_t n = 0;
+    for (const auto& kv : endpoints_) n += kv.second.requests;
+    return n;
+}
+
+void RequestStats::reset() {
+    std::lock_guard<std::mutex> lk(mu_);
+    endpoints_.clear();
+    concurrencyBase_ = concurrencyRaw_;
+    concurrency_ = ConcurrencyGovernor::State();
+}
+
+void RequestStats::writeJson(std::ostream& out, int indent) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    std::string pad(static_cast<size_t>(indent), ' ');
+    std::ios::fmtflags f = out.flags();
+    std::streamsize prec = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+    out << "{\n" << pad << "  \"endpoints\": {";
+    bool first = true;
+    for (const auto& kv : endpoints_) {
+        const Endpoint& e = kv.second;
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << pad << "    \"" << util::escapeJson(kv.first) << "\": {\n";
+        out << pad << "      \"requests\": " << e.requests
+            << ", \"failures\": " << e.failures
+            << ", \"retries\": " << e.retries
+            << ", \"hedges\": " << e.hedges
+            << ", \"hedge_wins\": " << e.hedgeWins
+            << ", \"bytes_up\": " << e.bytesUp
+            << ", \"bytes_down\": " << e.bytesDown << ",\n";
+        out << pad << "      \"status\": {";
+        bool firstStatus = true;
+        for (const auto& st : e.status) {
+            out << (firstStatus ? "" : ", ") << "\"" << st.first << "\": " << st.second;
+            firstStatus = false;
+        }
+        out << "},\n";
+        if (!e.retryReasons.empty()) {
+            out << pad << "      \"retry_reasons\": {";
+            bool firstReason = true;
+            for (const auto& r : e.retryReasons) {
+                out << (firstReason ? "" : ", ") << "\"" << util::escapeJson(r.first) << "\": " << r.second;
+                firstReason = false;
+            }
+            out << "},\n";
+        }
+        out << pad << "      \"latency_ms\": {\n";
+        out << pad << "        \"name_lookup\": "; e.nameLookup.writeJson(out); out << ",\n";
+        out << pad << "        \"connect\": "; e.connect.writeJson(out); out << ",\n";
+        out << pad << "        \"first_byte\": "; e.firstByte.writeJson(out); out << ",\n";
+        out << pad << "        \"total\": "; e.total.writeJson(out); out << "\n";
+        out << pad << "      }\n";
+        out << pad << "    }";
+    }
+    out << (first ? "}" : "\n" + pad + "  }");
+
+    const ConcurrencyGovernor::State& c = concurrency_;
+    if (c.granted > 0) {
+        out << ",\n" << pad << "  \"concurrency\": {\"limit\": " << c.limit
+            << ", \"in_flight\": " << c.inFlight
+            << ", \"queued\": {";
+        for (int i = 0; i < 3; ++i) {
+            out << (i ? ", \"" : "\"") << priorityName(static_cast<RequestPriority>(i)) << "\": " << c.queued[i];
+        }
+        out << "}, \"peak_queued\": " << c.peakQueued
+            << ", \"granted\": " << c.granted
+            << ", \"waited\": " << c.waited
+            << ", \"decreases\": " << c.decreases
+            << ", \"rtt_ms\": " << c.rttMs
+            << ", \"baseline_rtt_ms\": " << c.baselineRttMs << "}";
+    }
+    out << "\n" << pad << "}";
+
+    out.flags(f);
+    out.precision(prec);
+}
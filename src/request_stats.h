@@ -0,0 +1,100 @@
+#pragma once
+#include "concurrency_governor.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Fixed-size log-linear histogram of durations in microseconds:
+// 8 linear sub-buckets per power of two, so percentiles are within ~12%.
+// Recording is a couple of integer ops; no allocation.
+class LatencyHistogram {
+public:
+    void record(uint64_t us);
+    uint64_t count() const { return count_; }
+    double percentileMs(double p) const;
+    double meanMs() const { return count_ ? static_cast<double>(sumUs_) / count_ / 1000.0 : 0; }
+    double minMs() const { return count_ ? minUs_ / 1000.0 : 0; }
+    double maxMs() const { return maxUs_ / 1000.0; }
+    void writeJson(std::ostream& out) const;
+
+private:
+    static constexpr int kSub = 8;
+    static constexpr int kBuckets = 40 * kSub;
+    static size_t bucketOf(uint64_t us);
+    static uint64_t bucketUpper(size_t b);
+
+    std::array<uint64_t, kBuckets> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t sumUs_ = 0;
+    uint64_t minUs_ = UINT64_MAX;
+    uint64_t maxUs_ = 0;
+};
+
+// Per-endpoint request metrics of one device: curl phase timings,
+// byte counts, HTTP status codes, retries and hedged requests, plus the
+// device's current concurrency limit and queue.
+class RequestStats {
+public:
+    struct Sample {
+        std::string_view endpoint; // "GET /v1/machine:readmem", copied on first use
+        long httpCode = 0;       // 0 = transport failure
+        bool ok = false;
+        uint64_t nameLookupUs = 0;
+        uint64_t connectUs = 0;
+        uint64_t firstByteUs = 0;
+        uint64_t totalUs = 0;
+        uint64_t bytesUp = 0;
+        uint64_t bytesDown = 0;
+    };
+
+    void record(const Sample& s);
+    // reason is the failure class that caused the retry ("timeout", ...).
+    void recordRetry(std::string_view endpoint, std::string_view reason = "");
+    // A hedge copy was sent; won = it answered before the original.
+    void recordHedge(std::string_view endpoint, bool won);
+    // Latest state of the device's ConcurrencyGovernor.
+    void recordConcurrency(const ConcurrencyGovernor::State& s);
+
+    // Total-latency percentile of an endpoint, or -1 with fewer than
+    // minSamples successful requests on record.
+    double percentileMs(std::string_view endpoint, double p, uint64_t minSamples) const;
+
+    uint64_t totalRequests() const;
+    // Forgets everything recorded so far; concurrency counters (granted,
+    // waited, backoffs, peak queue) restart from zero as well.
+    void reset();
+
+    // {"endpoints": {"GET /v1/version": {...}, ...}, "concurrency": {...}}
+    void writeJson(std::ostream& out, int indent = 0) const;
+
+private:
+    struct Endpoint {
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+        uint64_t retries = 0;
+        std::map<std::string, uint64_t, std::less<>> retryReasons;
+        uint64_t hedges = 0;
+        uint64_t hedgeWins = 0;
+        uint64_t bytesUp = 0;
+        uint64_t bytesDown = 0;
+        std::map<long, uint64_t> status;
+        LatencyHistogram nameLookup;
+        LatencyHistogram connect;
+        LatencyHistogram firstByte;
+        LatencyHistogram total;
+    };
+
+    Endpoint& endpoint(std::string_view name); // mu_ held
+
+    mutable std::mutex mu_;
+    // Transparent comparator: recording to a known endpoint does not allocate.
+    std::map<std::string, Endpoint, std::less<>> endpoints_;
+    ConcurrencyGovernor::State concurrency_;      // as reported, since the last reset
+    ConcurrencyGovernor::State concurrencyRaw_;   // as published by the governor
+    ConcurrencyGovernor::State concurrencyBase_;  // raw counters at the last reset
+};
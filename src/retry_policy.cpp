@@ -0,0 +1,55 @@
+#include "retry_policy.h"
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <random>
+
+FailureKind classifyFailure(int curlCode, long httpCode) {
+    switch (static_cast<CURLcode>(curlCode)) {
+    case CURLE_OK:
+        return httpCode >= 500 ? FailureKind::ServerError : FailureKind::None;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+        return FailureKind::Connect;
+    case CURLE_OPERATION_TIMEDOUT:
+        return FailureKind::Timeout;
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+        return FailureKind::Dropped;
+    default:
+        return FailureKind::Other;
+    }
+}
+
+const char* failureName(FailureKind k) {
+    switch (k) {
+    case FailureKind::None: return "none";
+    case FailureKind::Connect: return "connect";
+    case FailureKind::Timeout: return "timeout";
+    case FailureKind::Dropped: return "dropped";
+    case FailureKind::ServerError: return "server_error";
+    case FailureKind::Other: return "other";
+    }
+    return "other";
+}
+
+bool RetryPolicy::shouldRetry(FailureKind k, bool idempotent) const {
+    switch (k) {
+    case FailureKind::Connect: return retryConnect;
+    case FailureKind::Timeout: return retryTimeout && idempotent;
+    case FailureKind::Dropped: return idempotent;
+    case FailureKind::ServerError: return retryServerError && idempotent;
+    default: return false;
+    }
+}
+
+int RetryPolicy::backoffMs(int attempt) const {
+    if (attempt < 2 || baseDelayMs <= 0) return 0;
+    long step = std::min<long>(maxDelayMs, static_cast<long>(baseDelayMs) << std::min(attempt - 2, 20));
+    thread_local std::mt19937 rng(std::random_device{}());
+    std::uniform_int_distribution<long> jitter(0, step / 2);
+    return static_cast<int>(step - step / 2 + jitter(rng));
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// How a failed attempt failed, which decides whether it is worth repeating.
+enum class FailureKind {
+    None,         // an answer below 500
+    Connect,      // no connection: the request never reached the device
+    Timeout,      // connect or transfer timeout
+    Dropped,      // connection lost mid-request; the device may have acted
+    ServerError,  // HTTP 5xx
+    Other,        // anything else (bad URL, write callback abort, ...)
+};
+
+// curlCode is a CURLcode.
+FailureKind classifyFailure(int curlCode, long httpCode);
+const char* failureName(FailureKind k);
+
+// Retries with exponential backoff and jitter, plus optional hedging of
+// idempotent reads. Requests that are not idempotent (running a program)
+// are only retried when they never reached the device.
+struct RetryPolicy {
+    int maxAttempts = 3;         // total attempts per call; 1 disables retries
+    int baseDelayMs = 25;        // backoff before the 2nd attempt, doubled after
+    int maxDelayMs = 1000;
+    bool retryConnect = true;
+    bool retryTimeout = true;
+    bool retryServerError = true;
+
+    int timeoutMs = 5000;        // per attempt
+    int connectTimeoutMs = 1500;
+
+    // Hedging: if a read has not answered after the hedgePercentile latency
+    // of its endpoint's recent history, a second copy is sent and the first
+    // answer wins. Needs hedgeMinSamples of history first.
+    bool hedge = false;
+    double hedgePercentile = 0.95;
+    int hedgeMinDelayMs = 2;
+    int hedgeMinSamples = 20;
+
+    bool shouldRetry(FailureKind k, bool idempotent) const;
+
+    // Delay before attempt number `attempt` (2 = first retry): half of the
+    // exponential step is fixed, the other half random, so concurrent
+    // clients spread out.
+    int backoffMs(int attempt) const;
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Compile-time table of the REST endpoints the client calls, and a
+// fixed-capacity URL builder for them. Building a request URL this way
+// touches no heap: the path, the stats key and the parameter names are
+// constants, and values are formatted straight into the builder's buffer.
+namespace routes {
+
+// Characters that need no percent-escaping in a query (RFC 3986 unreserved).
+constexpr bool unreserved(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+constexpr bool unreserved(std::string_view s) {
+    for (char c : s) {
+        if (!unreserved(c)) return false;
+    }
+    return !s.empty();
+}
+
+// A query parameter name, checked at compile time to need no escaping.
+struct Param {
+    std::string_view name;
+};
+
+struct Route {
+    const char* method;         // "GET" / "POST"
+    std::string_view path;      // "/v1/machine:readmem"
+    std::string_view endpoint;  // "GET /v1/machine:readmem", the stats key
+    bool idempotent;            // safe to repeat after a timeout or lost answer
+};
+
+constexpr bool endpointMatches(const Route& r) {
+    std::string_view m(r.method);
+    return r.endpoint.size() == m.size() + 1 + r.path.size() &&
+           r.endpoint.substr(0, m.size()) == m && r.endpoint[m.size()] == ' ' &&
+           r.endpoint.substr(m.size() + 1) == r.path;
+}
+
+// Writing the same bytes twice leaves memory as writing them once, so
+// writemem counts as idempotent; starting a program twice does not.
+inline constexpr Route kVersion{"GET", "/v1/version", "GET /v1/version", true};
+inline constexpr Route kReadMem{"GET", "/v1/machine:readmem", "GET /v1/machine:readmem", true};
+inline constexpr Route kWriteMem{"POST", "/v1/machine:writemem", "POST /v1/machine:writemem", true};
+inline constexpr Route kRunPrg{"POST", "/v1/runners:run_prg", "POST /v1/runners:run_prg", false};
+inline constexpr Route kRunCrt{"POST", "/v1/runners:run_crt", "POST /v1/runners:run_crt", false};
+inline constexpr Route kSidPlay{"POST", "/v1/runners:sidplay", "POST /v1/runners:sidplay", false};
+
+inline constexpr Param kAddress{"address"};
+inline constexpr Param kLength{"length"};
+inline constexpr Param kSongNr{"songnr"};
+
+static_assert(endpointMatches(kVersion) && endpointMatches(kReadMem) && endpointMatches(kWriteMem) &&
+              endpointMatches(kRunPrg) && endpointMatches(kRunCrt) && endpointMatches(kSidPlay),
+              "route endpoint must be \"<method> <path>\"");
+static_assert(unreserved(kAddress.name) && unreserved(kLength.name) && unreserved(kSongNr.name),
+              "parameter names are appended unescaped");
+
+// Typed values: each knows how to format itself without allocating.
+struct Hex4 {
+    uint16_t value;  // 4 lowercase hex digits, as the device expects
+};
+
+struct Dec {
+    uint64_t value;
+};
+
+inline char* formatHex4(char* out, uint16_t v) {
+    static const char kHex[] = "0123456789abcdef";
+    out[0] = kHex[(v >> 12) & 0xF];
+    out[1] = kHex[(v >> 8) & 0xF];
+    out[2] = kHex[(v >> 4) & 0xF];
+    out[3] = kHex[v & 0xF];
+    return out + 4;
+}
+
+inline char* formatDec(char* out, uint64_t v) {
+    char tmp[20];
+    size_t n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *out++ = tmp[--n];
+    return out;
+}
+
+// Base address + route path + query in a fixed buffer. Overflowing the
+// capacity throws; real device URLs are well under it.
+class UrlBuilder {
+public:
+    static constexpr size_t kCapacity = 512;
+
+    UrlBuilder(std::string_view base, const Route& route) {
+        append(base);
+        append(route.path);
+    }
+
+    UrlBuilder& param(Param p, Hex4 v) {
+        key(p);
+        reserve(4);
+        len_ = static_cast<size_t>(formatHex4(buf_ + len_, v.value) - buf_);
+        return *this;
+    }
+
+    UrlBuilder& param(Param p, Dec v) {
+        key(p);
+        reserve(20);
+        len_ = static_cast<size_t>(formatDec(buf_ + len_, v.value) - buf_);
+        return *this;
+    }
+
+    // Arbitrary text, percent-escaped.
+    UrlBuilder& param(Param p, std::string_view v) {
+        static const char kHex[] = "0123456789ABCDEF";
+        key(p);
+        for (char c : v) {
+            if (unreserved(c)) {
+                reserve(1);
+                buf_[len_++] = c;
+            } else {
+                reserve(3);
+                auto u = static_cast<unsigned char>(c);
+                buf_[len_++] = '%';
+                buf_[len_++] = kHex[u >> 4];
+                buf_[len_++] = kHex[u & 0xF];
+            }
+        }
+        return *this;
+    }
+
+    const char* c_str() {
+        buf_[len_] = '\0';
+        return buf_;
+    }
+    std::string_view view() const { return std::string_view(buf_, len_); }
+    size_t size() const { return len_; }
+
+private:
+    void reserve(size_t n) {
+        if (len_ + n > kCapacity) throw std::runtime_error("URL exceeds " + std::to_string(kCapacity) + " bytes");
+    }
+
+    void append(std::string_view s) {
+        reserve(s.size());
+        std::memcpy(buf_ + len_, s.data(), s.size());
+        len_ += s.size();
+    }
+
+    void key(Param p) {
+        reserve(p.name.size() + 2);
+        buf_[len_++] = query_ ? '&' : '?';
+        query_ = true;
+        std::memcpy(buf_ + len_, p.name.data(), p.name.size());
+        len_ += p.name.size();
+        buf_[len_++] = '=';
+    }
+
+    char buf_[kCapacity + 1];
+    size_t len_ = 0;
+    bool query_ = false;
+};
+
+} // namespace routes
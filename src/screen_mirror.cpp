@@ -0,0 +1,356 @@
+#include "screen_mirror.h"
+#include "routes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// VIC-II registers read each frame: $D011..$D024.
+constexpr uint16_t kVicRegs = 0xD011;
+constexpr uint32_t kVicRegCount = 0x14;
+constexpr uint16_t kColorRam = 0xD800;
+constexpr uint16_t kCia2PortA = 0xDD00;   // VIC bank in bits 0-1 (inverted)
+constexpr uint64_t kBankEvery = 16;       // frames between VIC bank reads
+constexpr int kMergeGapRows = 2;          // idle rows read anyway to save a request
+
+// Pepto's palette.
+constexpr uint8_t kPalette[16][3] = {
+    {0x00, 0x00, 0x00}, {0xFF, 0xFF, 0xFF}, {0x68, 0x37, 0x2B}, {0x70, 0xA4, 0xB2},
+    {0x6F, 0x3D, 0x86}, {0x58, 0x8D, 0x43}, {0x35, 0x28, 0x79}, {0xB8, 0xC7, 0x6F},
+    {0x6F, 0x4F, 0x25}, {0x43, 0x39, 0x00}, {0x9A, 0x67, 0x59}, {0x44, 0x44, 0x44},
+    {0x6C, 0x6C, 0x6C}, {0x9A, 0xD2, 0x84}, {0x6C, 0x5E, 0xB5}, {0x95, 0x95, 0x95},
+};
+
+// Screen codes $00-$7F of the uppercase/graphics character set. The
+// graphics characters map to the closest box-drawing or block glyph.
+const char* const kUpper[128] = {
+    "@", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O",
+    "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "[", "£", "]", "↑", "←",
+    " ", "!", "\"", "#", "$", "%", "&", "'", "(", ")", "*", "+", ",", "-", ".", "/",
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ":", ";", "<", "=", ">", "?",
+    "─", "♠", "│", "─", "─", "─", "─", "│", "│", "╮", "╰", "╯", "└", "╲", "╱", "┌",
+    "┐", "●", "─", "♥", "│", "╭", "╳", "○", "♣", "│", "♦", "┼", "▒", "│", "π", "◥",
+    " ", "▌", "▄", "▔", "▁", "▏", "▒", "▕", "▒", "◤", "▕", "├", "▗", "└", "┐", "▂",
+    "┌", "┴", "┬", "┤", "▎", "▍", "▐", "▔", "▔", "▃", "▟", "▖", "▝", "┘", "▘", "▚",
+};
+
+const char* const kLowerLetters[26] = {
+    "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m",
+    "n", "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z",
+};
+
+void appendDec(std::string& s, uint64_t v) {
+    char tmp[20];
+    s.append(tmp, static_cast<size_t>(routes::formatDec(tmp, v) - tmp));
+}
+
+void appendRgb(std::string& s, uint8_t c) {
+    const uint8_t* rgb = kPalette[c & 0x0F];
+    appendDec(s, rgb[0]);
+    s += ';';
+    appendDec(s, rgb[1]);
+    s += ';';
+    appendDec(s, rgb[2]);
+}
+
+} // namespace
+
+const char* ScreenMirror::glyph(uint8_t code, bool lowercase) {
+    code &= 0x7F;
+    if (lowercase) {
+        if (code >= 0x01 && code <= 0x1A) return kLowerLetters[code - 0x01];
+        if (code >= 0x41 && code <= 0x5A) return kUpper[code - 0x40];
+        switch (code) {
+        case 0x5E: return "▒";
+        case 0x5F: case 0x69: return "▨";
+        case 0x7A: return "✓";
+        default: break;
+        }
+    }
+    return kUpper[code];
+}
+
+bool ScreenMirror::Mode::operator==(const Mode& o) const {
+    return lowercase == o.lowercase && blank == o.blank && bitmap == o.bitmap && ecm == o.ecm &&
+           multicolor == o.multicolor && border == o.border && std::equal(bg, bg + 4, o.bg);
+}
+
+ScreenMirror::ScreenMirror(U64Server& server, std::ostream& out) : ScreenMirror(server, out, Options()) {}
+
+ScreenMirror::ScreenMirror(U64Server& server, std::ostream& out, Options opts)
+    : server_(server), out_(out), opts_(opts),
+      screen_(kCols * kRows), color_(kCols * kRows),
+      shownScreen_(kCols * kRows), shownColor_(kCols * kRows),
+      rowChanged_(kRows, 0), scratch_(kCols * kRows), intervalMs_(opts.minIntervalMs) {
+    if (opts_.minIntervalMs < 1) opts_.minIntervalMs = 1;
+    if (opts_.maxIntervalMs < opts_.minIntervalMs) opts_.maxIntervalMs = opts_.minIntervalMs;
+    if (opts_.coldRowsPerFrame < 1) opts_.coldRowsPerFrame = 1;
+}
+
+// ---------------------
+// Reading
+// ---------------------
+void ScreenMirror::read(uint16_t address, uint8_t* dst, uint32_t length) {
+    server_.peekMemoryInto(address, dst, length);
+    stats_.requests++;
+    stats_.bytesRead += length;
+}
+
+void ScreenMirror::readRegisters() {
+    // The bank only moves with a bank switch, which is rare; $D018 moves the
+    // screen within the bank and is re-read every frame with the rest.
+    if (stats_.frames % kBankEvery == 0) read(kCia2PortA, &dd00_, 1);
+
+    uint8_t r[kVicRegCount];
+    read(kVicRegs, r, kVicRegCount);
+    uint8_t d011 = r[0x00], d016 = r[0x05], d018 = r[0x07];
+
+    uint16_t bank = static_cast<uint16_t>((3 - (dd00_ & 0x03)) * 0x4000);
+    uint16_t screen = static_cast<uint16_t>(bank + (d018 >> 4) * 0x400);
+    if (screen != screenAddr_) {
+        screenAddr_ = screen;
+        fullRead_ = true;
+    }
+    // Only the character ROM's second half ($1800 in banks 0 and 2) holds
+    // the lowercase set; custom charsets are shown as uppercase.
+    mode_.lowercase = ((d018 >> 1) & 0x07) == 0x03;
+    mode_.blank = !(d011 & 0x10);
+    mode_.bitmap = (d011 & 0x20) != 0;
+    mode_.ecm = (d011 & 0x40) != 0;
+    mode_.multicolor = (d016 & 0x10) != 0;
+    mode_.border = r[0x0F] & 0x0F;
+    for (int i = 0; i < 4; ++i) mode_.bg[i] = r[0x10 + i] & 0x0F;
+}
+
+void ScreenMirror::readRows() {
+    uint64_t frame = stats_.frames;
+    // The first frame fills the screen; that is not activity.
+    uint64_t mark = frame == 0 ? 0 : frame + 1;
+    bool need[kRows];
+    for (int r = 0; r < kRows; ++r) {
+        need[r] = fullRead_ || (rowChanged_[r] && frame - rowChanged_[r] < static_cast<uint64_t>(opts_.hotFrames));
+    }
+    // Quiet rows are refreshed a few per frame in rotation, more as the
+    // frame interval grows, so a change anywhere shows within refreshMs.
+    int cold = std::max(opts_.coldRowsPerFrame,
+                        static_cast<int>(kRows * intervalMs_ / std::max(1, opts_.refreshMs) + 0.999));
+    for (int n = 0, tried = 0; n < cold && tried < kRows; ++tried) {
+        int r = coldCursor_;
+        coldCursor_ = (coldCursor_ + 1) % kRows;
+        if (!need[r]) { need[r] = true; ++n; }
+    }
+    fullRead_ = false;
+
+    for (int r = 0; r < kRows;) {
+        if (!need[r]) { ++r; continue; }
+        int end = r + 1;
+        for (int next = end; next < kRows && next <= end + kMergeGapRows; ++next) {
+            if (need[next]) end = next + 1;
+        }
+        uint32_t offset = static_cast<uint32_t>(r * kCols);
+        uint32_t length = static_cast<uint32_t>((end - r) * kCols);
+
+        read(static_cast<uint16_t>(screenAddr_ + offset), scratch_.data(), length);
+        for (int row = r; row < end; ++row) {
+            const uint8_t* src = scratch_.data() + (row - r) * kCols;
+            uint8_t* dst = screen_.data() + row * kCols;
+            if (!std::equal(src, src + kCols, dst)) {
+                std::copy(src, src + kCols, dst);
+                rowChanged_[row] = mark;
+            }
+        }
+
+        read(static_cast<uint16_t>(kColorRam + offset), scratch_.data(), length);
+        for (int row = r; row < end; ++row) {
+            uint8_t* src = scratch_.data() + (row - r) * kCols;
+            uint8_t* dst = color_.data() + row * kCols;
+            for (int c = 0; c < kCols; ++c) src[c] &= 0x0F; // upper nibble floats
+            if (!std::equal(src, src + kCols, dst)) {
+                std::copy(src, src + kCols, dst);
+                rowChanged_[row] = mark;
+            }
+        }
+        r = end;
+    }
+}
+
+// ---------------------
+// Rendering
+// ---------------------
+void ScreenMirror::moveTo(int row, int col) {
+    if (row == curRow_ && col == curCol_) return;
+    buf_ += "\x1b[";
+    appendDec(buf_, static_cast<uint64_t>(row));
+    buf_ += ';';
+    appendDec(buf_, static_cast<uint64_t>(col));
+    buf_ += 'H';
+    curRow_ = row;
+    curCol_ = col;
+}
+
+void ScreenMirror::setColors(uint8_t fg, uint8_t bg) {
+    if (fg == curFg_ && bg == curBg_) return;
+    buf_ += "\x1b[";
+    if (fg != curFg_) {
+        buf_ += "38;2;";
+        appendRgb(buf_, fg);
+        if (bg != curBg_) buf_ += ';';
+    }
+    if (bg != curBg_) {
+        buf_ += "48;2;";
+        appendRgb(buf_, bg);
+    }
+    buf_ += 'm';
+    curFg_ = fg;
+    curBg_ = bg;
+}
+
+// row/col are 1-based terminal positions.
+void ScreenMirror::cell(int row, int col, const char* g, uint8_t fg, uint8_t bg) {
+    moveTo(row, col);
+    setColors(fg, bg);
+    buf_ += g;
+    curCol_++;
+}
+
+void ScreenMirror::drawBorder() {
+    uint8_t b = mode_.border;
+    for (int col = 1; col <= kCols + 2; ++col) {
+        cell(1, col, " ", b, b);
+        cell(kRows + 2, col, " ", b, b);
+    }
+    for (int row = 2; row <= kRows + 1; ++row) {
+        cell(row, 1, " ", b, b);
+        cell(row, kCols + 2, " ", b, b);
+    }
+}
+
+void ScreenMirror::render(bool full) {
+    int origin = opts_.border ? 2 : 1;
+    if (full) {
+        buf_ += "\x1b[0m\x1b[2J";
+        curRow_ = curCol_ = curFg_ = curBg_ = -1;
+        if (opts_.border) drawBorder();
+    }
+    // With the display off or in a bitmap mode the text cells show nothing
+    // worth diffing; a mode change brings a full redraw.
+    bool text = !mode_.blank && !mode_.bitmap;
+    if (!full && !text) return;
+
+    for (int row = 0; row < kRows; ++row) {
+        for (int col = 0; col < kCols; ++col) {
+            size_t i = static_cast<size_t>(row * kCols + col);
+            uint8_t code = screen_[i], color = color_[i];
+            if (!full && code == shownScreen_[i] && color == shownColor_[i]) continue;
+            shownScreen_[i] = code;
+            shownColor_[i] = color;
+            stats_.cellsDrawn++;
+
+            if (!text) {
+                uint8_t bg = mode_.blank ? mode_.border : mode_.bg[0];
+                cell(row + origin, col + origin, " ", bg, bg);
+                continue;
+            }
+            uint8_t fg = mode_.multicolor && (color & 0x08) ? color & 0x07 : color;
+            if (mode_.ecm) {
+                cell(row + origin, col + origin, glyph(code & 0x3F, mode_.lowercase), fg, mode_.bg[code >> 6]);
+            } else if (code & 0x80) {
+                cell(row + origin, col + origin, glyph(code, mode_.lowercase), mode_.bg[0], fg);
+            } else {
+                cell(row + origin, col + origin, glyph(code, mode_.lowercase), fg, mode_.bg[0]);
+            }
+        }
+    }
+}
+
+void ScreenMirror::drawStatus() {
+    double now = std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+    if (statusClock_ > 0 && now - statusClock_ < 1.0) return;
+    uint64_t frames = stats_.frames - statusFrames_;
+    double fps = statusClock_ > 0 ? frames / (now - statusClock_) : 0.0;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%5.1f fps  %6.1f ms/frame  %5llu B read/frame  %6llu B out/frame",
+                  fps, latencyMs_,
+                  static_cast<unsigned long long>(frames ? (stats_.bytesRead - statusRead_) / frames : 0),
+                  static_cast<unsigned long long>(frames ? (stats_.bytesOut - statusOut_) / frames : 0));
+    statusClock_ = now;
+    statusFrames_ = stats_.frames;
+    statusRead_ = stats_.bytesRead;
+    statusOut_ = stats_.bytesOut;
+
+    moveTo(kRows + (opts_.border ? 3 : 1), 1);
+    buf_ += "\x1b[0m\x1b[K";
+    buf_ += line;
+    curFg_ = curBg_ = curCol_ = -1;
+}
+
+void ScreenMirror::flush() {
+    if (buf_.empty()) return;
+    out_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+    out_.flush();
+    stats_.bytesOut += buf_.size();
+    buf_.clear();
+}
+
+// ---------------------
+// Frames
+// ---------------------
+void ScreenMirror::begin() {
+    buf_ += "\x1b[?25l";
+    drawn_ = false;
+    flush();
+}
+
+void ScreenMirror::end() {
+    moveTo(kRows + (opts_.border ? 3 : 1) + (opts_.status ? 1 : 0), 1);
+    buf_ += "\x1b[0m\x1b[?25h";
+    flush();
+}
+
+size_t ScreenMirror::frame() {
+    ConcurrencyGovernor::Scope scope(RequestPriority::Background);
+    auto t0 = Clock::now();
+    readRegisters();
+    readRows();
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    latencyMs_ = stats_.frames == 0 ? ms : latencyMs_ * 0.8 + ms * 0.2;
+
+    uint64_t before = stats_.cellsDrawn;
+    bool full = !drawn_ || !(mode_ == shownMode_);
+    render(full);
+    drawn_ = true;
+    shownMode_ = mode_;
+    size_t cells = static_cast<size_t>(stats_.cellsDrawn - before);
+    stats_.frames++;
+    if (opts_.status) drawStatus();
+    flush();
+
+    // Same pacing as MemoryWatcher: a moving screen is polled as often as
+    // the cap allows but never more than every round trip, so a device
+    // spends at most half its time serving the mirror; a still screen backs
+    // off geometrically.
+    double floor = std::max<double>(opts_.minIntervalMs, latencyMs_);
+    if (cells) intervalMs_ = floor;
+    else intervalMs_ = std::min<double>(opts_.maxIntervalMs, intervalMs_ * 1.5 + 1.0);
+    intervalMs_ = std::max(intervalMs_, floor);
+    return cells;
+}
+
+void ScreenMirror::run(const std::atomic<bool>& stop, uint64_t maxFrames) {
+    while (!stop.load()) {
+        frame();
+        if (maxFrames && stats_.frames >= maxFrames) return;
+        // Sleep in slices so a stop request is honoured promptly.
+        auto wake = Clock::now() + std::chrono::microseconds(static_cast<int64_t>(intervalMs_ * 1000));
+        while (!stop.load()) {
+            auto now = Clock::now();
+            if (now >= wake) break;
+            std::this_thread::sleep_for(std::min<Clock::duration>(wake - now, std::chrono::milliseconds(50)));
+        }
+    }
+}
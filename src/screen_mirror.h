@@ -0,0 +1,114 @@
+#pragma once
+#include "u64_server.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Mirrors the C64's text screen into an ANSI terminal. Each frame reads the
+// VIC registers, then screen and color RAM, and redraws only the cells that
+// changed since the last frame.
+//
+// Reads follow the changes too: rows that changed recently are read every
+// frame, the others a few per frame in rotation. A static screen
+// therefore costs a few small requests per frame, and only the changed
+// cells reach the terminal. That leaves room to mirror several devices at
+// once, e.g. one per tmux pane.
+class ScreenMirror {
+public:
+    static constexpr int kCols = 40;
+    static constexpr int kRows = 25;
+
+    struct Options {
+        int minIntervalMs = 33;      // frame rate cap (~30 fps)
+        int maxIntervalMs = 250;     // slowest rate while nothing changes
+        int hotFrames = 8;           // a row is read every frame this long after it changed
+        int coldRowsPerFrame = 2;    // other rows refreshed per frame, in rotation...
+        int refreshMs = 1000;        // ...but enough that each is read this often
+        bool border = true;          // draw the border color around the screen
+        bool status = true;          // fps / latency / bytes line below the screen
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t requests = 0;
+        uint64_t bytesRead = 0;
+        uint64_t cellsDrawn = 0;
+        uint64_t bytesOut = 0;       // terminal output
+    };
+
+    ScreenMirror(U64Server& server, std::ostream& out);
+    ScreenMirror(U64Server& server, std::ostream& out, Options opts);
+
+    // Reads and renders one frame. Returns the number of cells redrawn.
+    size_t frame();
+
+    // Renders frames until stop is set or maxFrames (if > 0) have been
+    // drawn, pacing itself by request latency and screen activity.
+    void run(const std::atomic<bool>& stop, uint64_t maxFrames = 0);
+
+    // Hides the cursor and clears the terminal / restores it.
+    void begin();
+    void end();
+
+    const Stats& stats() const { return stats_; }
+    double latencyMs() const { return latencyMs_; }
+    double intervalMs() const { return intervalMs_; }
+
+    // Terminal glyph (UTF-8) for a screen code, ignoring the reverse bit.
+    static const char* glyph(uint8_t screenCode, bool lowercase);
+
+private:
+    // What the VIC says about how to show the text screen.
+    struct Mode {
+        bool lowercase = false;
+        bool blank = false;          // display disabled: all border color
+        bool bitmap = false;         // not a text mode; not mirrored
+        bool ecm = false;            // extended background color mode
+        bool multicolor = false;
+        uint8_t border = 14;
+        uint8_t bg[4] = {6, 0, 0, 0};
+        bool operator==(const Mode& o) const;
+    };
+
+    void readRegisters();
+    void readRows();
+    void read(uint16_t address, uint8_t* dst, uint32_t length);
+    void render(bool full);
+    void cell(int row, int col, const char* glyph, uint8_t fg, uint8_t bg);
+    void moveTo(int row, int col);
+    void setColors(uint8_t fg, uint8_t bg);
+    void drawBorder();
+    void drawStatus();
+    void flush();
+
+    U64Server& server_;
+    std::ostream& out_;
+    Options opts_;
+    Stats stats_;
+
+    Mode mode_, shownMode_;
+    uint8_t dd00_ = 0x03;
+    uint16_t screenAddr_ = 0;
+    bool fullRead_ = true;                          // read every row next frame
+    std::vector<uint8_t> screen_, color_;           // latest device contents
+    std::vector<uint8_t> shownScreen_, shownColor_; // what the terminal shows
+    std::vector<uint64_t> rowChanged_;              // 1 + frame a row last changed, 0 = never
+    std::vector<uint8_t> scratch_;
+    int coldCursor_ = 0;
+    bool drawn_ = false;
+
+    std::string buf_;          // terminal output of the current frame
+    int curRow_ = -1, curCol_ = -1;
+    int curFg_ = -1, curBg_ = -1;
+
+    double latencyMs_ = 0;     // EWMA of the read time of one frame
+    double intervalMs_ = 0;
+
+    // Counters as of the last status line, which is redrawn once a second.
+    double statusClock_ = 0;
+    uint64_t statusFrames_ = 0, statusRead_ = 0, statusOut_ = 0;
+};
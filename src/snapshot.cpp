@@ -0,0 +1,203 @@
+#include "snapshot.h"
+#include "memory_mirror.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+static const char kMagic[8] = {'U', '6', '4', 'S', 'N', 'A', 'P', '1'};
+
+// FNV-1a over a page, eight bytes at a time.
+static uint64_t hashPage(const uint8_t* p) {
+    uint64_t h = 1469598103934665603ULL;
+    for (uint32_t i = 0; i < SnapshotStore::kPageSize; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h = (h ^ w) * 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+// ---------------------
+// Binary helpers
+// ---------------------
+template <typename T>
+static void putLE(std::string& out, T v) {
+    for (size_t i = 0; i < sizeof(T); ++i) out += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+struct SnapReader {
+    const std::string& data;
+    size_t pos = 0;
+
+    const char* take(size_t n) {
+        if (data.size() - pos < n) throw std::runtime_error("snapshot: truncated file");
+        const char* p = data.data() + pos;
+        pos += n;
+        return p;
+    }
+    template <typename T>
+    T get() {
+        const char* p = take(sizeof(T));
+        T v = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) v |= static_cast<T>(static_cast<uint8_t>(p[i])) << (8 * i);
+        return v;
+    }
+};
+
+// ---------------------
+// SnapshotStore
+// ---------------------
+uint32_t SnapshotStore::intern(const uint8_t* p) {
+    uint64_t h = hashPage(p);
+    auto range = byHash_.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (std::memcmp(page(it->second), p, kPageSize) == 0) return it->second;
+    }
+    uint32_t index = static_cast<uint32_t>(uniquePages());
+    pool_.insert(pool_.end(), p, p + kPageSize);
+    byHash_.emplace(h, index);
+    return index;
+}
+
+const SnapshotStore::Snapshot& SnapshotStore::add(const std::string& name, uint16_t address,
+                                                  const std::vector<uint8_t>& bytes) {
+    if (address % kPageSize != 0 || bytes.size() % kPageSize != 0 || bytes.empty() ||
+        address + bytes.size() > 0x10000) {
+        throw std::runtime_error("snapshot: range must be whole pages within 64 KB");
+    }
+    if (name.size() > 0xFFFF) throw std::runtime_error("snapshot: name too long");
+
+    Snapshot s;
+    s.name = name;
+    s.createdUnix = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    s.firstPage = static_cast<uint16_t>(address / kPageSize);
+    for (size_t off = 0; off < bytes.size(); off += kPageSize) s.pages.push_back(intern(bytes.data() + off));
+
+    for (auto& old : snapshots_) {
+        if (old.name == name) {
+            old = std::move(s);
+            return old;
+        }
+    }
+    snapshots_.push_back(std::move(s));
+    return snapshots_.back();
+}
+
+const SnapshotStore::Snapshot* SnapshotStore::find(const std::string& name) const {
+    if (name.empty()) return snapshots_.empty() ? nullptr : &snapshots_.back();
+    for (const auto& s : snapshots_) {
+        if (s.name == name) return &s;
+    }
+    return nullptr;
+}
+
+std::vector<uint8_t> SnapshotStore::contents(const Snapshot& s) const {
+    std::vector<uint8_t> out;
+    out.reserve(s.length());
+    for (uint32_t idx : s.pages) out.insert(out.end(), page(idx), page(idx) + kPageSize);
+    return out;
+}
+
+SnapshotStore SnapshotStore::load(const std::string& path) {
+    SnapshotStore store;
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return store;
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    SnapReader r{data};
+    if (std::memcmp(r.take(sizeof(kMagic)), kMagic, sizeof(kMagic)) != 0)
+        throw std::runtime_error("snapshot: not a snapshot file: " + path);
+    if (r.get<uint32_t>() != kPageSize) throw std::runtime_error("snapshot: unsupported page size");
+    uint32_t pageCount = r.get<uint32_t>();
+    uint32_t snapCount = r.get<uint32_t>();
+
+    const char* pages = r.take(static_cast<size_t>(pageCount) * kPageSize);
+    store.pool_.assign(pages, pages + static_cast<size_t>(pageCount) * kPageSize);
+    for (uint32_t i = 0; i < pageCount; ++i) store.byHash_.emplace(hashPage(store.page(i)), i);
+
+    for (uint32_t n = 0; n < snapCount; ++n) {
+        Snapshot s;
+        uint16_t nameLen = r.get<uint16_t>();
+        s.name.assign(r.take(nameLen), nameLen);
+        s.createdUnix = r.get<uint64_t>();
+        s.firstPage = r.get<uint16_t>();
+        uint16_t count = r.get<uint16_t>();
+        if (s.firstPage + count > 0x10000 / kPageSize) throw std::runtime_error("snapshot: bad page range");
+        s.pages.resize(count);
+        for (auto& idx : s.pages) {
+            idx = r.get<uint32_t>();
+            if (idx >= pageCount) throw std::runtime_error("snapshot: bad page index");
+        }
+        store.snapshots_.push_back(std::move(s));
+    }
+    return store;
+}
+
+void SnapshotStore::save(const std::string& path) const {
+    std::string out(kMagic, sizeof(kMagic));
+    putLE<uint32_t>(out, kPageSize);
+    putLE<uint32_t>(out, static_cast<uint32_t>(uniquePages()));
+    putLE<uint32_t>(out, static_cast<uint32_t>(snapshots_.size()));
+    out.append(reinterpret_cast<const char*>(pool_.data()), pool_.size());
+    for (const auto& s : snapshots_) {
+        putLE<uint16_t>(out, static_cast<uint16_t>(s.name.size()));
+        out += s.name;
+        putLE<uint64_t>(out, s.createdUnix);
+        putLE<uint16_t>(out, s.firstPage);
+        putLE<uint16_t>(out, static_cast<uint16_t>(s.pages.size()));
+        for (uint32_t idx : s.pages) putLE<uint32_t>(out, idx);
+    }
+
+    // Unique per process, next to the target so the rename stays atomic;
+    // two saves racing cannot write into each other's temporary file.
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f) throw std::runtime_error("snapshot: cannot write " + tmp);
+        f.write(out.data(), static_cast<std::streamsize>(out.size()));
+        f.flush();
+        if (!f) { std::remove(tmp.c_str()); throw std::runtime_error("snapshot: cannot write " + tmp); }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("snapshot: cannot replace " + path + ": " + std::strerror(errno));
+    }
+}
+
+// ---------------------
+// restoreSnapshot
+// ---------------------
+RestoreResult restoreSnapshot(U64Server& server, const SnapshotStore& store,
+                              const SnapshotStore::Snapshot& snap) {
+    ConcurrencyGovernor::Scope scope(RequestPriority::Bulk);
+    RestoreResult res;
+    const uint16_t base = snap.address();
+
+    // One pipelined read of the whole range tells us what is already right.
+    MemoryMirror mirror(server);
+    mirror.sync(base, snap.length());
+
+    for (size_t i = 0; i < snap.pages.size(); ++i) {
+        uint16_t addr = static_cast<uint16_t>(base + i * SnapshotStore::kPageSize);
+        const uint8_t* want = store.page(snap.pages[i]);
+        res.pagesCompared++;
+        bool same = true;
+        for (uint32_t b = 0; b < SnapshotStore::kPageSize && same; ++b) {
+            same = mirror.shadow(static_cast<uint16_t>(addr + b)) == want[b];
+        }
+        if (same) continue;
+        res.pagesDiffering++;
+        mirror.stage(addr, want, SnapshotStore::kPageSize);
+    }
+
+    res.requests = mirror.flush();
+    res.bytesSent = mirror.stats().bytesSent;
+    return res;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "u64_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A series of C64 memory snapshots in one file. Memory is split into
+// 256-byte pages and every distinct page is stored once, however many
+// snapshots contain it, so mostly identical captures cost little more
+// than their differences.
+//
+// File layout (little-endian):
+//   "U64SNAP1"  u32 pageSize  u32 pageCount  u32 snapshotCount
+//   pageCount * pageSize bytes of unique pages
+//   per snapshot: u16 nameLen, name, u64 unix time, u16 firstPage,
+//                 u16 pageCount, pageCount * u32 page index
+class SnapshotStore {
+public:
+    static constexpr uint32_t kPageSize = 256;
+
+    struct Snapshot {
+        std::string name;
+        uint64_t createdUnix = 0;
+        uint16_t firstPage = 0;
+        std::vector<uint32_t> pages; // indices into the page pool
+
+        uint16_t address() const { return static_cast<uint16_t>(firstPage * kPageSize); }
+        uint32_t length() const { return static_cast<uint32_t>(pages.size()) * kPageSize; }
+    };
+
+    SnapshotStore() = default;
+
+    // Reads a store; a missing file yields an empty store.
+    static SnapshotStore load(const std::string& path);
+
+    // Writes to a temporary file and renames it over path.
+    void save(const std::string& path) const;
+
+    // Adds a snapshot of bytes captured at address. address must be page
+    // aligned and bytes a whole number of pages. A snapshot with the same
+    // name is replaced.
+    const Snapshot& add(const std::string& name, uint16_t address, const std::vector<uint8_t>& bytes);
+
+    // nullptr if absent; an empty name selects the newest snapshot.
+    const Snapshot* find(const std::string& name) const;
+
+    // The memory image of a snapshot.
+    std::vector<uint8_t> contents(const Snapshot& s) const;
+    const uint8_t* page(uint32_t index) const { return pool_.data() + static_cast<size_t>(index) * kPageSize; }
+
+    const std::vector<Snapshot>& snapshots() const { return snapshots_; }
+    size_t uniquePages() const { return pool_.size() / kPageSize; }
+
+private:
+    uint32_t intern(const uint8_t* page);
+
+    std::vector<uint8_t> pool_; // unique pages, back to back
+    std::vector<Snapshot> snapshots_;
+    std::unordered_multimap<uint64_t, uint32_t> byHash_; // page hash -> index
+};
+
+struct RestoreResult {
+    size_t pagesCompared = 0;
+    size_t pagesDiffering = 0;
+    size_t requests = 0;   // writemem requests issued
+    size_t bytesSent = 0;
+};
+
+// Reads the snapshot's range from the device and writes back only what
+// differs, with nearby changes merged into single writemem requests.
+RestoreResult restoreSnapshot(U64Server& server, const SnapshotStore& store,
+                              const SnapshotStore::Snapshot& snap);
@@ -0,0 +1,223 @@
+#include "subnet_scan.h"
+#include "version_probe.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static std::string ipv4ToString(uint32_t hostOrder) {
+    in_addr a{};
+    a.s_addr = htonl(hostOrder);
+    char buf[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &a, buf, sizeof(buf));
+    return buf;
+}
+
+// Leave headroom under RLIMIT_NOFILE for curl and the rest of the process.
+static size_t socketBudget() {
+    rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY) return 1024;
+    if (rl.rlim_cur <= 64) return 16;
+    return static_cast<size_t>(std::min<rlim_t>(rl.rlim_cur - 48, 4096));
+}
+
+SubnetScanner::SubnetScanner(ScanOptions opts) : opts_(opts) {}
+
+std::vector<std::vector<uint32_t>> SubnetScanner::localSubnets(size_t maxHostsPerIface) const {
+    std::vector<std::vector<uint32_t>> out;
+    if (maxHostsPerIface == 0) return out;
+
+    ifaddrs* ifs = nullptr;
+    if (getifaddrs(&ifs) != 0) return out;
+
+    std::set<std::pair<uint32_t, uint32_t>> seenNets;
+    for (ifaddrs* it = ifs; it; it = it->ifa_next) {
+        if (!it->ifa_addr || !it->ifa_netmask || it->ifa_addr->sa_family != AF_INET) continue;
+        if (!(it->ifa_flags & IFF_UP) || (it->ifa_flags & IFF_POINTOPOINT)) continue;
+        bool loopback = (it->ifa_flags & IFF_LOOPBACK) != 0;
+        if (loopback && !opts_.includeLoopback) continue;
+
+        uint32_t self = ntohl(reinterpret_cast<sockaddr_in*>(it->ifa_addr)->sin_addr.s_addr);
+        uint32_t mask = ntohl(reinterpret_cast<sockaddr_in*>(it->ifa_netmask)->sin_addr.s_addr);
+        uint32_t net = self & mask;
+        uint64_t size = static_cast<uint64_t>(~mask) + 1;
+        if (size < 4) continue; // /31 and /32 have no scannable neighbours
+        if (!seenNets.insert({net, mask}).second) continue;
+
+        // Window of maxHostsPerIface addresses, aligned, containing our own address.
+        uint64_t span = std::min<uint64_t>(size, maxHostsPerIface);
+        uint64_t first = net + ((self - net) / span) * span;
+        uint64_t last = first + span - 1;
+
+        std::vector<uint32_t> hosts;
+        hosts.reserve(static_cast<size_t>(span));
+        for (uint64_t h = first; h <= last; ++h) {
+            if (h == net || h == net + size - 1) continue; // network / broadcast
+            if (!loopback && h == self) continue;
+            hosts.push_back(static_cast<uint32_t>(h));
+        }
+        if (!hosts.empty()) out.push_back(std::move(hosts));
+    }
+    freeifaddrs(ifs);
+    return out;
+}
+
+std::vector<uint32_t> SubnetScanner::findOpenHosts(const std::vector<uint32_t>& hosts) const {
+    std::vector<uint32_t> open;
+    if (hosts.empty()) return open;
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) throw std::runtime_error("epoll_create1 failed");
+
+    struct Slot { int fd = -1; uint32_t host = 0; uint32_t gen = 0; };
+    const size_t budget = std::min(socketBudget(), hosts.size());
+    std::vector<Slot> slots(budget);
+    std::vector<uint32_t> freeSlots;
+    for (size_t i = budget; i-- > 0;) freeSlots.push_back(static_cast<uint32_t>(i));
+
+    // Every connect gets the same timeout, so start order is deadline order.
+    struct Deadline { uint32_t slot; uint32_t gen; Clock::time_point at; };
+    std::deque<Deadline> deadlines;
+    const auto timeout = std::chrono::milliseconds(opts_.connectTimeoutMs);
+
+    auto finish = [&](uint32_t slot, bool connected) {
+        Slot& s = slots[slot];
+        if (s.fd < 0) return;
+        if (connected) open.push_back(s.host);
+        epoll_ctl(ep, EPOLL_CTL_DEL, s.fd, nullptr);
+        close(s.fd);
+        s.fd = -1;
+        freeSlots.push_back(slot);
+    };
+
+    size_t next = 0;
+    size_t inFlight = 0;
+    epoll_event events[256];
+
+    auto cancelled = [&] { return opts_.cancel && opts_.cancel->load(); };
+
+    while ((next < hosts.size() || inFlight > 0) && !cancelled()) {
+        while (next < hosts.size() && !freeSlots.empty()) {
+            uint32_t host = hosts[next++];
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                // Out of descriptors or buffers: retry the host once a
+                // connect in flight frees one. With none in flight nothing
+                // will, so the host is skipped rather than retried forever.
+                if (inFlight > 0) { --next; break; }
+                continue;
+            }
+
+            sockaddr_in sa{};
+            sa.sin_family = AF_INET;
+            sa.sin_port = htons(opts_.port);
+            sa.sin_addr.s_addr = htonl(host);
+
+            int rc = connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa));
+            if (rc == 0) { open.push_back(host); close(fd); continue; }
+            if (errno != EINPROGRESS) { close(fd); continue; }
+
+            uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            slots[slot] = Slot{fd, host, slots[slot].gen + 1};
+
+            epoll_event ev{};
+            ev.events = EPOLLOUT;
+            ev.data.u32 = slot;
+            epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+            deadlines.push_back({slot, slots[slot].gen, Clock::now() + timeout});
+            ++inFlight;
+        }
+
+        if (inFlight == 0) continue;
+
+        auto now = Clock::now();
+        int waitMs = 0;
+        if (!deadlines.empty() && deadlines.front().at > now) {
+            waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadlines.front().at - now).count()) + 1;
+        }
+        if (opts_.cancel) waitMs = std::min(waitMs, 20);
+
+        int n = epoll_wait(ep, events, 256, waitMs);
+        for (int i = 0; i < n; ++i) {
+            uint32_t slot = events[i].data.u32;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(slots[slot].fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+            finish(slot, err == 0);
+            --inFlight;
+        }
+
+        now = Clock::now();
+        auto stale = [&](const Deadline& d) {
+            return slots[d.slot].fd < 0 || slots[d.slot].gen != d.gen;
+        };
+        while (!deadlines.empty() && (stale(deadlines.front()) || deadlines.front().at <= now)) {
+            Deadline d = deadlines.front();
+            deadlines.pop_front();
+            if (!stale(d)) { finish(d.slot, false); --inFlight; }
+        }
+    }
+
+    for (auto& s : slots) {
+        if (s.fd >= 0) close(s.fd); // only left open when cancelled
+    }
+    close(ep);
+    std::sort(open.begin(), open.end());
+    return open;
+}
+
+std::vector<DiscoveredService> SubnetScanner::scanHosts(const std::vector<uint32_t>& hosts) const {
+    std::vector<DiscoveredService> out;
+    auto openHosts = findOpenHosts(hosts);
+    if (openHosts.empty() || (opts_.cancel && opts_.cancel->load())) return out;
+
+    std::vector<std::string> urls;
+    urls.reserve(openHosts.size());
+    for (uint32_t h : openHosts) {
+        std::string url = "http://" + ipv4ToString(h);
+        if (opts_.port != 80) url += ":" + std::to_string(opts_.port);
+        urls.push_back(url);
+    }
+
+    auto probes = util::probeVersions(urls, opts_.probeTimeoutMs, "", nullptr, opts_.cancel);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        if (!probes[i].isUltimate) continue;
+        DiscoveredService svc;
+        svc.address = ipv4ToString(openHosts[i]);
+        svc.hostname = svc.address;
+        svc.port = opts_.port;
+        svc.firmware = probes[i].version;
+        svc.rttMs = probes[i].rttMs;
+        out.push_back(svc);
+    }
+    return out;
+}
+
+std::vector<DiscoveredService> SubnetScanner::scan(size_t maxHostsPerIface) const {
+    // All interfaces go through a single connect pass.
+    std::vector<uint32_t> all;
+    std::set<uint32_t> seen;
+    for (const auto& net : localSubnets(maxHostsPerIface)) {
+        for (uint32_t h : net) {
+            if (seen.insert(h).second) all.push_back(h);
+        }
+    }
+    return scanHosts(all);
+}
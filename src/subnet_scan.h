@@ -0,0 +1,38 @@
+#pragma once
+#include "discovery.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ScanOptions {
+    uint16_t port = 80;
+    int connectTimeoutMs = 150;   // per host; all hosts connect at once
+    int probeTimeoutMs = 1000;    // /v1/version confirmation of open hosts
+    bool includeLoopback = false;
+    const std::atomic<bool>* cancel = nullptr; // abandons the scan once set
+};
+
+// Fallback discovery when mDNS is unavailable: non-blocking connects to
+// every host of each local IPv4 subnet through one epoll set, followed by
+// a concurrent /v1/version probe of the hosts that accepted.
+class SubnetScanner {
+public:
+    explicit SubnetScanner(ScanOptions opts = ScanOptions());
+
+    // Host addresses (host byte order) of each local IPv4 interface's subnet,
+    // capped at maxHostsPerIface around the interface's own address.
+    std::vector<std::vector<uint32_t>> localSubnets(size_t maxHostsPerIface) const;
+
+    // Hosts from `hosts` that accepted a TCP connection on opts.port.
+    std::vector<uint32_t> findOpenHosts(const std::vector<uint32_t>& hosts) const;
+
+    // findOpenHosts + /v1/version confirmation.
+    std::vector<DiscoveredService> scanHosts(const std::vector<uint32_t>& hosts) const;
+
+    // Scan every local subnet.
+    std::vector<DiscoveredService> scan(size_t maxHostsPerIface) const;
+
+private:
+    ScanOptions opts_;
+};
@@ -0,0 +1,261 @@
+#include "suite_runner.h"
+#include "hex.h"
+#include "memory_watch.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// One device's job queue. The owner pops from the front, thieves from the
+// back, so they only contend when a single job is left.
+struct JobQueue {
+    std::mutex mu;
+    std::deque<size_t> jobs;
+    bool retired = false;
+};
+
+double msSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+} // namespace
+
+const char* SuiteRunner::statusName(Status s) {
+    switch (s) {
+    case Status::Pass: return "pass";
+    case Status::Fail: return "fail";
+    case Status::Timeout: return "timeout";
+    case Status::Error: return "error";
+    }
+    return "error";
+}
+
+SuiteRunner::SuiteRunner(std::vector<U64Server*> devices, Options opts)
+    : devices_(std::move(devices)), opts_(opts) {
+    if (devices_.empty()) throw std::runtime_error("suite: no devices");
+    if (opts_.maxAttempts < 1) opts_.maxAttempts = 1;
+    if (opts_.retireAfter < 1) opts_.retireAfter = 1;
+}
+
+SuiteRunner::Report SuiteRunner::run(const std::vector<std::string>& prgs, const Progress& progress) {
+    // Read every PRG up front: a missing file is the caller's mistake, not a
+    // device failure, and should stop the suite before anything runs.
+    std::vector<std::vector<uint8_t>> images;
+    images.reserve(prgs.size());
+    for (const auto& p : prgs) images.push_back(util::readFileBytes(p));
+
+    const size_t n = devices_.size();
+    Report report;
+    report.results.resize(prgs.size());
+    for (size_t j = 0; j < prgs.size(); ++j) report.results[j].prg = prgs[j];
+    report.devices.resize(n);
+    for (size_t d = 0; d < n; ++d) report.devices[d].address = devices_[d]->creds().address;
+
+    std::vector<JobQueue> queues(n);
+    for (size_t j = 0; j < prgs.size(); ++j) queues[j % n].jobs.push_back(j);
+    std::atomic<size_t> remaining{prgs.size()};
+    std::mutex doneMu;
+
+    auto finish = [&](size_t job) {
+        std::lock_guard<std::mutex> lk(doneMu);
+        remaining--;
+        if (progress) progress(report.results[job]);
+    };
+
+    auto popOwn = [&](size_t self, size_t& job) {
+        std::lock_guard<std::mutex> lk(queues[self].mu);
+        if (queues[self].jobs.empty()) return false;
+        job = queues[self].jobs.front();
+        queues[self].jobs.pop_front();
+        return true;
+    };
+
+    // Steals from the longest queue; sizes are sampled without holding every
+    // lock, so a lost race just means another look.
+    auto steal = [&](size_t self, size_t& job) {
+        size_t victim = n, longest = 0;
+        for (size_t d = 0; d < n; ++d) {
+            if (d == self) continue;
+            std::lock_guard<std::mutex> lk(queues[d].mu);
+            if (queues[d].jobs.size() > longest) { longest = queues[d].jobs.size(); victim = d; }
+        }
+        if (victim == n) return false;
+        std::lock_guard<std::mutex> lk(queues[victim].mu);
+        if (queues[victim].jobs.empty()) return false;
+        job = queues[victim].jobs.back();
+        queues[victim].jobs.pop_back();
+        return true;
+    };
+
+    // Hands a job that hit a device error to the shortest queue of another
+    // live device, or back to self if there is none. False if every device
+    // has been retired.
+    auto requeue = [&](size_t self, size_t job) {
+        size_t target = n, shortest = 0;
+        bool selfLive = false;
+        for (size_t d = 0; d < n; ++d) {
+            std::lock_guard<std::mutex> lk(queues[d].mu);
+            if (queues[d].retired) continue;
+            if (d == self) { selfLive = true; continue; }
+            if (target == n || queues[d].jobs.size() < shortest) {
+                target = d;
+                shortest = queues[d].jobs.size();
+            }
+        }
+        if (target == n && selfLive) target = self;
+        if (target == n) return false;
+        std::lock_guard<std::mutex> lk(queues[target].mu);
+        queues[target].jobs.push_front(job);
+        return true;
+    };
+
+    auto worker = [&](size_t self) {
+        ConcurrencyGovernor::Scope scope(RequestPriority::Bulk);
+        U64Server& server = *devices_[self];
+        DeviceStats& stats = report.devices[self];
+        int consecutiveErrors = 0;
+
+        while (remaining.load() > 0) {
+            size_t job = 0;
+            bool stolen = false;
+            if (!popOwn(self, job)) {
+                if (!steal(self, job)) {
+                    // Jobs still running elsewhere may come back after a device error.
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    continue;
+                }
+                stolen = true;
+            }
+
+            Result& r = report.results[job];
+            r.device = stats.address;
+            r.attempts++;
+            r.output.clear();
+            stats.jobs++;
+            if (stolen) stats.stolen++;
+
+            auto t0 = Clock::now();
+            try {
+                server.pokeMemory(opts_.marker, {0x00});
+                server.runPRG(images[job]);
+
+                MemoryWatcher watcher(server);
+                watcher.add(MemoryWatcher::notEquals(opts_.marker, {0x00}));
+                if (watcher.waitAny(opts_.timeoutMs) < 0) {
+                    r.status = Status::Timeout;
+                    r.marker = 0;
+                } else {
+                    r.marker = watcher.current(0)[0];
+                    r.status = r.marker == opts_.pass ? Status::Pass : Status::Fail;
+                }
+                // Collected on timeouts too: it is what a hung test left behind.
+                if (opts_.collectLength > 0) {
+                    r.output = opts_.collectLength > 4096
+                        ? server.peekMemoryBulk(opts_.collectAddress, opts_.collectLength)
+                        : server.peekMemory(opts_.collectAddress, opts_.collectLength);
+                }
+                r.error.clear();
+                r.ms = msSince(t0);
+                stats.busyMs += r.ms;
+                consecutiveErrors = 0;
+                finish(job);
+            } catch (const std::exception& e) {
+                r.status = Status::Error;
+                r.error = e.what();
+                r.ms = msSince(t0);
+                stats.busyMs += r.ms;
+                stats.errors++;
+
+                bool retire = ++consecutiveErrors >= opts_.retireAfter;
+                if (retire) {
+                    std::lock_guard<std::mutex> lk(queues[self].mu);
+                    queues[self].retired = true;
+                    stats.retired = true;
+                }
+                if (r.attempts >= opts_.maxAttempts || !requeue(self, job)) finish(job);
+                if (retire) return; // the others steal what is left in this queue
+            }
+        }
+    };
+
+    auto t0 = Clock::now();
+    std::vector<std::thread> threads;
+    threads.reserve(n);
+    for (size_t d = 0; d < n; ++d) threads.emplace_back(worker, d);
+    for (auto& t : threads) t.join();
+    report.wallMs = msSince(t0);
+
+    // Jobs stranded in the queues of retired devices once none was left.
+    for (auto& q : queues) {
+        for (size_t job : q.jobs) {
+            Result& r = report.results[job];
+            r.status = Status::Error;
+            if (r.error.empty()) r.error = "no device left to run it";
+        }
+    }
+    return report;
+}
+
+size_t SuiteRunner::Report::count(Status s) const {
+    return static_cast<size_t>(std::count_if(results.begin(), results.end(),
+                                             [s](const Result& r) { return r.status == s; }));
+}
+
+void SuiteRunner::Report::writeJson(std::ostream& out) const {
+    std::ios::fmtflags f = out.flags();
+    std::streamsize prec = out.precision();
+    out << std::fixed << std::setprecision(1);
+
+    double jobMs = 0;
+    for (const auto& r : results) jobMs += r.ms;
+    out << "{\n  \"summary\": {\"jobs\": " << results.size()
+        << ", \"pass\": " << count(Status::Pass)
+        << ", \"fail\": " << count(Status::Fail)
+        << ", \"timeout\": " << count(Status::Timeout)
+        << ", \"error\": " << count(Status::Error)
+        << ", \"devices\": " << devices.size()
+        << ", \"wall_ms\": " << wallMs
+        << ", \"job_ms\": " << jobMs << "},\n";
+
+    out << "  \"devices\": [";
+    for (size_t i = 0; i < devices.size(); ++i) {
+        const DeviceStats& d = devices[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"address\": \"" << util::escapeJson(d.address)
+            << "\", \"jobs\": " << d.jobs
+            << ", \"stolen\": " << d.stolen
+            << ", \"errors\": " << d.errors
+            << ", \"busy_ms\": " << d.busyMs
+            << ", \"retired\": " << (d.retired ? "true" : "false") << "}";
+    }
+    out << (devices.empty() ? "],\n" : "\n  ],\n");
+
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"prg\": \"" << util::escapeJson(r.prg)
+            << "\", \"device\": \"" << util::escapeJson(r.device)
+            << "\", \"status\": \"" << statusName(r.status)
+            << "\", \"marker\": " << static_cast<int>(r.marker)
+            << ", \"ms\": " << r.ms
+            << ", \"attempts\": " << r.attempts
+            << ", \"output\": \"" << hex::encode(r.output) << "\"";
+        if (!r.error.empty()) out << ", \"error\": \"" << util::escapeJson(r.error) << "\"";
+        out << "}";
+    }
+    out << (results.empty() ? "]\n}\n" : "\n  ]\n}\n");
+
+    out.flags(f);
+    out.precision(prec);
+}
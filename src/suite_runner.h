@@ -0,0 +1,77 @@
+#pragma once
+#include "u64_server.h"
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs a suite of test PRGs across several devices. Every job clears a
+// result marker byte, runs its PRG, waits for the marker to become
+// non-zero and collects a memory region as its output.
+//
+// Scheduling is work stealing: jobs are dealt round-robin into one queue
+// per device. Each device takes jobs from the front of its own queue, and
+// an idle device steals from the back of the longest other queue. Devices
+// that finish short tests early pick up the rest, so the suite takes about
+// total work / devices. A job whose device fails (as opposed to a test
+// that fails or hangs) moves to another device; a device that keeps
+// failing is retired and its queue is taken over by the others.
+class SuiteRunner {
+public:
+    struct Options {
+        uint16_t marker = 0;         // result byte, cleared to 00 before each run
+        uint8_t pass = 0x01;         // marker value meaning "passed"; others fail
+        int timeoutMs = 10000;       // per job, from the start of the PRG
+        uint16_t collectAddress = 0;
+        uint32_t collectLength = 0;  // 0: collect nothing
+        int maxAttempts = 2;         // per job, on different devices if possible
+        int retireAfter = 2;         // consecutive device errors that retire a device
+    };
+
+    enum class Status { Pass, Fail, Timeout, Error };
+
+    struct Result {
+        std::string prg;
+        std::string device;          // base URL of the device that ran it last
+        Status status = Status::Error;
+        uint8_t marker = 0;
+        double ms = 0;               // last attempt, clear to collect
+        int attempts = 0;
+        std::vector<uint8_t> output;
+        std::string error;
+    };
+
+    struct DeviceStats {
+        std::string address;
+        size_t jobs = 0;             // attempts run, including failed ones
+        size_t stolen = 0;           // jobs taken from another device's queue
+        size_t errors = 0;
+        double busyMs = 0;
+        bool retired = false;
+    };
+
+    struct Report {
+        std::vector<Result> results; // in suite order
+        std::vector<DeviceStats> devices;
+        double wallMs = 0;
+
+        size_t count(Status s) const;
+        // Machine-readable form, see the README.
+        void writeJson(std::ostream& out) const;
+    };
+
+    // Called from worker threads as each job finishes; calls are serialised.
+    using Progress = std::function<void(const Result&)>;
+
+    SuiteRunner(std::vector<U64Server*> devices, Options opts);
+
+    Report run(const std::vector<std::string>& prgs, const Progress& progress = nullptr);
+
+    static const char* statusName(Status s);
+
+private:
+    std::vector<U64Server*> devices_;
+    Options opts_;
+};
@@ -0,0 +1,179 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+static const char kMagic[8] = {'U', '6', '4', 'T', 'R', 'A', 'C', 'E'};
+static const uint8_t kVersion = 1;
+
+// Buffered records are written out once they reach this size.
+static const size_t kFlushBytes = 1 << 16;
+
+// ---------------------
+// Binary helpers
+// ---------------------
+static void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static void putBytes(std::string& out, const void* p, size_t n) {
+    putVarint(out, n);
+    out.append(static_cast<const char*>(p), n);
+}
+
+struct TraceReader {
+    const std::string& data;
+    size_t pos = 0;
+
+    bool atEnd() const { return pos == data.size(); }
+
+    const char* take(size_t n) {
+        if (data.size() - pos < n) throw std::runtime_error("trace: truncated file");
+        const char* p = data.data() + pos;
+        pos += n;
+        return p;
+    }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = static_cast<uint8_t>(*take(1));
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("trace: bad varint");
+    }
+
+    int64_t svarint() {
+        uint64_t z = varint();
+        return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+    }
+
+    std::string_view bytes() {
+        uint64_t n = varint();
+        if (n > data.size() - pos) throw std::runtime_error("trace: truncated file");
+        return std::string_view(take(static_cast<size_t>(n)), static_cast<size_t>(n));
+    }
+};
+
+// ---------------------
+// Writer
+// ---------------------
+trace::Writer::Writer(const std::string& path)
+    : file_(path, std::ios::binary | std::ios::trunc), path_(path), origin_(Clock::now()) {
+    if (!file_) throw std::runtime_error("trace: cannot write " + path);
+    buf_.append(kMagic, sizeof(kMagic));
+    buf_ += static_cast<char>(kVersion);
+    uint64_t unixMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    for (int i = 0; i < 8; ++i) buf_ += static_cast<char>((unixMs >> (8 * i)) & 0xFF);
+}
+
+trace::Writer::~Writer() {
+    try { flush(); } catch (...) {}
+}
+
+void trace::Writer::write(const Exchange& e) {
+    auto us = [&](Clock::duration d) {
+        return static_cast<uint64_t>(std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+    };
+    uint64_t startUs = us(e.start - origin_);
+    uint64_t durationUs = us(e.end - e.start);
+
+    std::lock_guard<std::mutex> lk(mu_);
+    if (failed_) return;
+    auto it = endpoints_.find(e.endpoint);
+    if (it != endpoints_.end()) {
+        putVarint(buf_, it->second);
+    } else {
+        uint32_t index = static_cast<uint32_t>(endpoints_.size());
+        endpoints_.emplace(std::string(e.endpoint), index);
+        putVarint(buf_, index);
+        putBytes(buf_, e.endpoint.data(), e.endpoint.size());
+    }
+    int64_t delta = static_cast<int64_t>(startUs - lastStartUs_);
+    putVarint(buf_, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    lastStartUs_ = startUs;
+    putVarint(buf_, durationUs);
+    putVarint(buf_, static_cast<uint64_t>(std::max(0L, e.status)));
+    buf_ += static_cast<char>(e.octet ? 1 : 0);
+    putBytes(buf_, e.query.data(), e.query.size());
+    putBytes(buf_, e.body, e.bodyLength);
+    putBytes(buf_, e.response, e.responseLength);
+    records_++;
+    if (buf_.size() >= kFlushBytes) flushLocked();
+}
+
+void trace::Writer::flush() {
+    std::lock_guard<std::mutex> lk(mu_);
+    flushLocked();
+    if (failed_) throw std::runtime_error("trace: write failed: " + path_);
+}
+
+void trace::Writer::flushLocked() {
+    if (!failed_ && !buf_.empty()) {
+        file_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+        file_.flush();
+        if (!file_) failed_ = true;
+    }
+    buf_.clear();
+}
+
+uint64_t trace::Writer::records() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return records_;
+}
+
+// ---------------------
+// Reader
+// ---------------------
+std::vector<trace::Record> trace::read(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("trace: cannot read " + path);
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    TraceReader r{data};
+    if (!std::equal(kMagic, kMagic + sizeof(kMagic), r.take(sizeof(kMagic)))) {
+        throw std::runtime_error("trace: not a trace file: " + path);
+    }
+    uint8_t version = static_cast<uint8_t>(*r.take(1));
+    if (version != kVersion) throw std::runtime_error("trace: unsupported version " + std::to_string(version));
+    r.take(8); // start time, informational
+
+    std::vector<std::string> endpoints;
+    std::vector<Record> out;
+    int64_t start = 0;
+    while (!r.atEnd()) {
+        Record rec;
+        uint64_t index = r.varint();
+        if (index == endpoints.size()) endpoints.emplace_back(r.bytes());
+        else if (index > endpoints.size()) throw std::runtime_error("trace: bad endpoint index");
+        const std::string& ep = endpoints[static_cast<size_t>(index)];
+        size_t space = ep.find(' ');
+        if (space == std::string::npos) throw std::runtime_error("trace: bad endpoint: " + ep);
+        rec.method = ep.substr(0, space);
+        rec.path = ep.substr(space + 1);
+
+        start += r.svarint();
+        if (start < 0) throw std::runtime_error("trace: bad start time");
+        rec.startUs = static_cast<uint64_t>(start);
+        rec.durationUs = r.varint();
+        rec.status = static_cast<long>(r.varint());
+        rec.octet = (*r.take(1) & 1) != 0;
+        rec.query = std::string(r.bytes());
+        std::string_view body = r.bytes();
+        rec.body.assign(body.begin(), body.end());
+        std::string_view response = r.bytes();
+        rec.response.assign(response.begin(), response.end());
+        out.push_back(std::move(rec));
+    }
+    std::stable_sort(out.begin(), out.end(),
+                     [](const Record& a, const Record& b) { return a.startUs < b.startUs; });
+    return out;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Request traces: every request a U64Server makes, with its response and
+// timing, for replaying real sessions against a device or the mock.
+//
+// File layout: "U64TRACE", u8 version, u64 unix time (ms) of the start,
+// then records until the end of the file, each:
+//   varint endpoint   index into the endpoints seen so far; one past the
+//                     last introduces a new "<method> <path>", given as
+//                     varint length + bytes
+//   svarint start     microseconds since the previous record's start
+//   varint duration   microseconds
+//   varint status     HTTP status, 0 = no answer
+//   u8 flags          bit 0: body sent as application/octet-stream
+//   varint length + bytes, three times: query string, body, response
+// Varints are LEB128, svarints zigzag-encoded. Records are written as
+// requests finish, so starts are not in order.
+namespace trace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Record {
+    std::string method;
+    std::string path;
+    std::string query;           // without the '?'
+    bool octet = false;
+    std::vector<uint8_t> body;
+    long status = 0;             // 0 = no HTTP answer
+    std::vector<uint8_t> response;
+    uint64_t startUs = 0;        // since the capture started
+    uint64_t durationUs = 0;     // the whole call, including retries
+};
+
+// What a writer is given; views into the caller's buffers.
+struct Exchange {
+    std::string_view endpoint;   // "<method> <path>"
+    std::string_view query;
+    bool octet = false;
+    const uint8_t* body = nullptr;
+    size_t bodyLength = 0;
+    long status = 0;
+    const uint8_t* response = nullptr;
+    size_t responseLength = 0;
+    Clock::time_point start;
+    Clock::time_point end;
+};
+
+// Appends records to a trace file; safe to share between threads and
+// servers. Records are buffered and written in large blocks. write()
+// never throws, so a full disk does not fail the requests being traced;
+// flush() reports it.
+class Writer {
+public:
+    explicit Writer(const std::string& path); // truncates
+    ~Writer();                                // flushes
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void write(const Exchange& e);
+    void flush(); // throws if any write failed
+    uint64_t records() const;
+
+private:
+    void flushLocked(); // mu_ held
+
+    mutable std::mutex mu_;
+    std::ofstream file_;
+    std::string path_;
+    std::string buf_;
+    Clock::time_point origin_;
+    uint64_t lastStartUs_ = 0;
+    uint64_t records_ = 0;
+    bool failed_ = false;
+    // Transparent comparator: known endpoints are found without allocating.
+    std::map<std::string, uint32_t, std::less<>> endpoints_;
+};
+
+// Every record of a trace, ordered by start time.
+std::vector<Record> read(const std::string& path);
+
+} // namespace trace
@@ -1,26 +1,130 @@
 #include "u64_server.h"
+#include "curl_pool.h"
+#include "file_source.h"
+#include "request_stats.h"
+#include "routes.h"
+#include "trace.h"
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
 #include <stdexcept>
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <utility>
 
-#include <curl/curl.h>
+// Growable response body, reserved from Content-Length on the first write
+// so the vector is allocated once instead of grown chunk by chunk.
+struct VecSink {
+    std::vector<uint8_t>* v = nullptr;
+    CURL* curl = nullptr;
+    bool sized = false;
+};
 
 static size_t curlWriteToVec(void* ptr, size_t size, size_t nmemb, void* userdata) {
     size_t n = size * nmemb;
-    auto* v = reinterpret_cast<std::vector<uint8_t>*>(userdata);
+    auto* s = reinterpret_cast<VecSink*>(userdata);
+    if (!s->sized) {
+        s->sized = true;
+        curl_off_t len = -1;
+        if (curl_easy_getinfo(s->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len) == CURLE_OK &&
+            len > 0 && len <= (64 << 20)) {
+            s->v->reserve(static_cast<size_t>(len));
+        }
+    }
     auto* b = reinterpret_cast<uint8_t*>(ptr);
-    v->insert(v->end(), b, b + n);
+    s->v->insert(s->v->end(), b, b + n);
     return n;
 }
 
-U64Server::U64Server(Creds creds) : creds_(std::move(creds)) {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+// Writes into a fixed, preallocated region; overlong bodies fail the transfer.
+struct SpanSink {
+    uint8_t* dst = nullptr;
+    size_t cap = 0;
+    size_t got = 0;
+};
+
+static size_t curlWriteToSpan(void* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t n = size * nmemb;
+    auto* s = reinterpret_cast<SpanSink*>(userdata);
+    if (n > s->cap - s->got) return 0;
+    std::memcpy(s->dst + s->got, ptr, n);
+    s->got += n;
+    return n;
+}
+
+// Feeds an upload body to curl straight from the file.
+static size_t curlReadFromSource(char* buf, size_t size, size_t nitems, void* userdata) {
+    auto* src = reinterpret_cast<FileSource*>(userdata);
+    try {
+        size_t n = src->read(src->pos, reinterpret_cast<uint8_t*>(buf), size * nitems);
+        src->pos += n;
+        return n;
+    } catch (...) {
+        return CURL_READFUNC_ABORT;
+    }
+}
+
+// Lets curl rewind the body, e.g. when a reused connection turns out dead.
+static int curlSeekSource(void* userdata, curl_off_t offset, int origin) {
+    auto* src = reinterpret_cast<FileSource*>(userdata);
+    if (origin != SEEK_SET || offset < 0 || static_cast<uint64_t>(offset) > src->size())
+        return CURL_SEEKFUNC_CANTSEEK;
+    src->pos = static_cast<uint64_t>(offset);
+    return CURL_SEEKFUNC_OK;
+}
+
+void U64Server::SlistDeleter::operator()(curl_slist* l) const {
+    curl_slist_free_all(l);
+}
+
+// RFC 3986 unreserved characters pass through, everything else is %XX.
+static void appendEscaped(std::string& out, const std::string& s) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (unsigned char c : s) {
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0x0F];
+        }
+    }
+}
 
+U64Server::U64Server(Creds creds)
+    : creds_(std::move(creds)), pool_(std::make_unique<CurlPool>()),
+      stats_(std::make_shared<RequestStats>()), buffers_(std::make_unique<BufferPool>()),
+      governor_(std::make_unique<ConcurrencyGovernor>(stats_.get())) {
     if (!creds_.address.empty() && creds_.address.back() == '/') creds_.address.pop_back();
-    // quick connectivity check; don't throw on auth failure, but do throw on no connection
-    (void)getVersion();
+
+    std::string pw = "X-Password: " + creds_.password;
+    curl_slist* h = curl_slist_append(nullptr, pw.c_str());
+    // The Ultimate's server does not answer 100-continue; don't wait for it.
+    h = curl_slist_append(h, "Expect:");
+    headers_.reset(h);
+
+    h = curl_slist_append(nullptr, pw.c_str());
+    h = curl_slist_append(h, "Expect:");
+    h = curl_slist_append(h, "Content-Type: application/octet-stream");
+    headersOctet_.reset(h);
+
+    if (!headers_ || !headersOctet_) throw std::runtime_error("curl_slist_append failed");
 }
 
+U64Server::~U64Server() = default;
+
+U64Server::U64Server(U64Server&&) noexcept = default;
+
+U64Server& U64Server::operator=(U64Server&&) noexcept = default;
+
+// ---------------------
+// Private helpers
+// ---------------------
+
 std::string U64Server::buildUrl(
     const std::string& path,
     const std::map<std::string, std::string>& params
@@ -32,98 +136,380 @@ std::string U64Server::buildUrl(
     url += path;
 
     if (!params.empty()) {
-        CURL* curl = curl_easy_init();
-        if (!curl) throw std::runtime_error("curl_easy_init failed");
-
         url += "?";
         bool first = true;
         for (const auto& kv : params) {
-            char* ek = curl_easy_escape(curl, kv.first.c_str(), 0);
-            char* ev = curl_easy_escape(curl, kv.second.c_str(), 0);
             if (!first) url += "&";
             first = false;
-            url += (ek ? ek : kv.first.c_str());
+            appendEscaped(url, kv.first);
             url += "=";
-            url += (ev ? ev : kv.second.c_str());
-            if (ek) curl_free(ek);
-            if (ev) curl_free(ev);
+            appendEscaped(url, kv.second);
         }
-        curl_easy_cleanup(curl);
     }
 
     return url;
 }
 
+void U64Server::requireAddress() const {
+    if (creds_.address.empty()) {
+        throw std::runtime_error("No address set. Provide address in creds or use discovery.");
+    }
+}
+
+void U64Server::capture(std::string_view endpoint, std::string_view url, bool octet,
+                        const uint8_t* body, size_t bodyLength, long status,
+                        const uint8_t* response, size_t responseLength,
+                        std::chrono::steady_clock::time_point start) const {
+    if (!capture_) return;
+    trace::Exchange e;
+    e.endpoint = endpoint;
+    size_t q = url.find('?');
+    if (q != std::string_view::npos) e.query = url.substr(q + 1);
+    e.octet = octet;
+    e.body = body;
+    e.bodyLength = bodyLength;
+    e.status = status;
+    e.response = response;
+    e.responseLength = responseLength;
+    e.start = start;
+    e.end = std::chrono::steady_clock::now();
+    capture_->write(e);
+}
+
+// ---------------------
+// Retries and hedging
+// ---------------------
+
+// Runs attempt(n) for n = 1, 2, ... until it succeeds, fails in a way the
+// policy does not retry, or the attempts run out. attempt returns the
+// CURLcode and HTTP status of its try.
+template <typename Attempt>
+static std::pair<CURLcode, long> withRetries(const RetryPolicy& policy, RequestStats& stats,
+                                             std::string_view endpoint, bool idempotent, Attempt attempt) {
+    for (int n = 1;; ++n) {
+        std::pair<CURLcode, long> r = attempt(n);
+        FailureKind k = classifyFailure(r.first, r.second);
+        if (k == FailureKind::None || n >= policy.maxAttempts || !policy.shouldRetry(k, idempotent)) return r;
+        stats.recordRetry(endpoint, failureName(k));
+        std::this_thread::sleep_for(std::chrono::milliseconds(policy.backoffMs(n + 1)));
+    }
+}
+
+// Where one leg of a GET writes its body. bind, if set, is told the handle
+// before the transfer starts.
+struct GetTarget {
+    size_t (*fn)(void*, size_t, size_t, void*) = nullptr;
+    void* data = nullptr;
+    void (*bind)(void* data, CURL* curl) = nullptr;
+};
+
+static void bindVecSink(void* data, CURL* curl) {
+    static_cast<VecSink*>(data)->curl = curl;
+}
+
+struct GetContext {
+    CurlPool& pool;
+    curl_slist* headers;
+    RequestStats& stats;
+    const RetryPolicy& policy;
+    ConcurrencyGovernor& governor;
+};
+
+static void setupGet(const GetContext& ctx, CURL* curl, const char* url, const GetTarget& t) {
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, ctx.headers);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, t.fn);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, t.data);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(ctx.policy.timeoutMs));
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(ctx.policy.connectTimeoutMs));
+    if (t.bind) t.bind(t.data, curl);
+}
+
+// One attempt of an idempotent GET. With hedging enabled and enough latency
+// history, a second copy goes to `hedge` once the primary has taken longer
+// than the policy's percentile, and the first answer wins. Returns the leg
+// whose result is reported in rc/code: 0 = primary, 1 = hedge. The hedge
+// is only sent if the concurrency governor has a slot free for it.
+static int hedgedGet(const GetContext& ctx, const routes::Route& route, const char* url,
+                     const GetTarget& primary, const GetTarget& hedge, CURLcode& rc, long& code) {
+    double delayMs = -1;
+    if (ctx.policy.hedge && hedge.fn) {
+        delayMs = ctx.stats.percentileMs(route.endpoint, ctx.policy.hedgePercentile,
+                                         static_cast<uint64_t>(std::max(1, ctx.policy.hedgeMinSamples)));
+        if (delayMs >= 0) delayMs = std::max<double>(delayMs, ctx.policy.hedgeMinDelayMs);
+    }
+
+    const RequestPriority prio = ConcurrencyGovernor::current();
+    if (delayMs < 0) {
+        ConcurrencyGovernor::Permit permit(ctx.governor, prio);
+        CurlPool::Lease lease(ctx.pool);
+        setupGet(ctx, lease.get(), url, primary);
+        rc = curl_easy_perform(lease.get());
+        code = 0;
+        curl_easy_getinfo(lease.get(), CURLINFO_RESPONSE_CODE, &code);
+        recordCurlTransfer(ctx.stats, lease.get(), route.endpoint, rc, code);
+        double rttMs;
+        ConcurrencyGovernor::Outcome outcome = transferOutcome(lease.get(), rc, code, true, rttMs);
+        permit.done(rttMs, outcome);
+        return 0;
+    }
+
+    struct Leg {
+        CURL* curl = nullptr;
+        bool done = false;
+        bool permitted = false; // holds a governor slot
+        CURLcode rc = CURLE_OK;
+        long code = 0;
+    };
+    Leg legs[2];
+    const GetTarget* targets[2] = {&primary, &hedge};
+
+    CURLM* multi = curl_multi_init();
+    if (!multi) throw std::runtime_error("curl_multi_init failed");
+    auto cleanup = [&] {
+        for (auto& leg : legs) {
+            if (leg.permitted) ctx.governor.release(0, ConcurrencyGovernor::Outcome::Ignored);
+            leg.permitted = false;
+            if (!leg.curl) continue;
+            curl_multi_remove_handle(multi, leg.curl);
+            ctx.pool.release(leg.curl);
+            leg.curl = nullptr;
+        }
+        curl_multi_cleanup(multi);
+    };
+    auto start = [&](int i) {
+        legs[i].curl = ctx.pool.acquire();
+        setupGet(ctx, legs[i].curl, url, *targets[i]);
+        curl_easy_setopt(legs[i].curl, CURLOPT_PRIVATE, reinterpret_cast<char*>(static_cast<intptr_t>(i)));
+        curl_multi_add_handle(multi, legs[i].curl);
+    };
+
+    int winner = -1;
+    bool hedged = false;
+    bool hedgeRefused = false;
+    try {
+        ctx.governor.acquire(prio);
+        legs[0].permitted = true;
+        start(0);
+        const auto t0 = std::chrono::steady_clock::now();
+        while (winner < 0) {
+            int running = 0;
+            curl_multi_perform(multi, &running);
+            int queued = 0;
+            while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+                if (msg->msg != CURLMSG_DONE) continue;
+                char* priv = nullptr;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+                Leg& leg = legs[reinterpret_cast<intptr_t>(priv)];
+                leg.done = true;
+                leg.rc = msg->data.result;
+                curl_easy_getinfo(leg.curl, CURLINFO_RESPONSE_CODE, &leg.code);
+                recordCurlTransfer(ctx.stats, leg.curl, route.endpoint, leg.rc, leg.code);
+                double rttMs;
+                ConcurrencyGovernor::Outcome outcome = transferOutcome(leg.curl, leg.rc, leg.code, true, rttMs);
+                ctx.governor.release(rttMs, outcome);
+                leg.permitted = false;
+                if (winner < 0 && classifyFailure(leg.rc, leg.code) == FailureKind::None) {
+                    winner = static_cast<int>(reinterpret_cast<intptr_t>(priv));
+                }
+            }
+            if (winner >= 0) break;
+            // Every leg failed: report the primary, the retry layer decides.
+            if (legs[0].done && (!hedged || legs[1].done)) { winner = 0; break; }
+
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if (!hedged && !hedgeRefused && elapsed >= delayMs) {
+                // A device at its limit is slow because it is busy; another
+                // copy would only add to that.
+                if (!ctx.governor.tryAcquire(prio)) {
+                    hedgeRefused = true;
+                    continue;
+                }
+                legs[1].permitted = true;
+                start(1);
+                hedged = true;
+                continue;
+            }
+            int waitMs = hedged || hedgeRefused ? 100 : std::max(1, static_cast<int>(delayMs - elapsed + 0.999));
+            curl_multi_poll(multi, nullptr, 0, waitMs, nullptr);
+        }
+    } catch (...) {
+        cleanup();
+        throw;
+    }
+    cleanup();
+
+    if (hedged) ctx.stats.recordHedge(route.endpoint, winner == 1);
+    rc = legs[winner].rc;
+    code = legs[winner].code;
+    return winner;
+}
+
 U64Server::HttpResult U64Server::request(
     const std::string& method,
     const std::string& path,
     const std::map<std::string, std::string>& params,
     const std::vector<uint8_t>* body,
-    const std::string& contentType
+    const std::string& contentType,
+    FileSource* upload
 ) const {
-    if (creds_.address.empty()) {
-        throw std::runtime_error("No address set. Provide address in creds or use discovery.");
-    }
+    requireAddress();
 
     std::string url = buildUrl(path, params);
+    return perform(method.c_str(), method + " " + path, url.c_str(), body, contentType, upload, method == "GET");
+}
 
-    CURL* curl = curl_easy_init();
-    if (!curl) throw std::runtime_error("curl_easy_init failed");
-
+U64Server::HttpResult U64Server::perform(
+    const char* method,
+    std::string_view endpoint,
+    const char* url,
+    const std::vector<uint8_t>* body,
+    std::string_view contentType,
+    FileSource* upload,
+    bool idempotent
+) const {
     HttpResult out;
 
-    // headers
-    struct curl_slist* headers = nullptr;
-    std::string pw = "X-Password: " + creds_.password;
-    headers = curl_slist_append(headers, pw.c_str());
-    if (!contentType.empty()) {
-        std::string ct = "Content-Type: " + contentType;
-        headers = curl_slist_append(headers, ct.c_str());
+    // headers: the two common lists are prebuilt, anything else is one-off
+    Slist custom;
+    curl_slist* headers = headers_.get();
+    if (contentType == "application/octet-stream") {
+        headers = headersOctet_.get();
+    } else if (!contentType.empty()) {
+        std::string pw = "X-Password: " + creds_.password;
+        std::string ct = "Content-Type: " + std::string(contentType);
+        curl_slist* h = curl_slist_append(nullptr, pw.c_str());
+        h = curl_slist_append(h, "Expect:");
+        h = curl_slist_append(h, ct.c_str());
+        custom.reset(h);
+        headers = h;
     }
 
+    const bool sample = !upload && (!body || body->size() <= ConcurrencyGovernor::kMaxSampledBody);
+    const RequestPriority prio = ConcurrencyGovernor::current();
+    const auto t0 = std::chrono::steady_clock::now();
+
     std::vector<uint8_t> response;
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteToVec);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 5000L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 1500L);
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-
-    if (method == "GET") {
-        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-    } else if (method == "POST") {
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        if (body) {
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body->size()));
+    auto attempt = [&](int) -> std::pair<CURLcode, long> {
+        ConcurrencyGovernor::Permit permit(*governor_, prio);
+        CurlPool::Lease lease(*pool_);
+        CURL* curl = lease.get();
+        response.clear();
+        VecSink sink{&response, curl, false};
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteToVec);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(retry_.timeoutMs));
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(retry_.connectTimeoutMs));
+
+        if (upload) {
+            upload->pos = 0;
+            curl_easy_setopt(curl, CURLOPT_POST, 1L);
+            curl_easy_setopt(curl, CURLOPT_READFUNCTION, curlReadFromSource);
+            curl_easy_setopt(curl, CURLOPT_READDATA, upload);
+            curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, curlSeekSource);
+            curl_easy_setopt(curl, CURLOPT_SEEKDATA, upload);
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(upload->size()));
+            // Large images may take longer than the pool's total timeout; give up
+            // only when the transfer stalls instead.
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 0L);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+            curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+        } else if (std::strcmp(method, "GET") == 0) {
+            curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        } else if (std::strcmp(method, "POST") == 0) {
+            curl_easy_setopt(curl, CURLOPT_POST, 1L);
+            if (body) {
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data());
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body->size()));
+            } else {
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L);
+            }
         } else {
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L);
+            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+            if (body) {
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data());
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body->size()));
+            }
         }
-    } else {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
-        if (body) {
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(body->size()));
+
+        CURLcode rc = curl_easy_perform(curl);
+        long code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        recordCurlTransfer(*stats_, curl, endpoint, rc, code);
+        double rttMs;
+        ConcurrencyGovernor::Outcome outcome = transferOutcome(curl, rc, code, sample, rttMs);
+        permit.done(rttMs, outcome);
+        return {rc, code};
+    };
+
+    auto r = withRetries(retry_, *stats_, endpoint, idempotent, attempt);
+    if (capture_) {
+        // A streamed upload is read back from its file for the trace.
+        std::vector<uint8_t> uploaded;
+        if (upload) {
+            uploaded.resize(static_cast<size_t>(upload->size()));
+            uploaded.resize(upload->read(0, uploaded.data(), uploaded.size()));
         }
+        const std::vector<uint8_t>* sent = upload ? &uploaded : body;
+        capture(endpoint, url, contentType == "application/octet-stream",
+                sent ? sent->data() : nullptr, sent ? sent->size() : 0,
+                r.first == CURLE_OK ? r.second : 0, response.data(), response.size(), t0);
+    }
+    if (r.first != CURLE_OK) {
+        throw std::runtime_error(std::string("HTTP request failed: ") + curl_easy_strerror(r.first));
     }
+    out.httpCode = r.second;
+    out.body = std::move(response);
+    return out;
+}
 
-    CURLcode rc = curl_easy_perform(curl);
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &out.httpCode);
+// Hot-path requests go through the route table: the URL is built in a
+// fixed buffer and the stats key is a constant, so nothing is allocated
+// before the transfer.
+U64Server::HttpResult U64Server::perform(const routes::Route& route, routes::UrlBuilder& url,
+                                         const std::vector<uint8_t>* body, bool octet) const {
+    return perform(route.method, route.endpoint, url.c_str(), body,
+                   octet ? "application/octet-stream" : "", nullptr, route.idempotent);
+}
 
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+// Idempotent GET into a vector, hedged and retried per retry_.
+U64Server::HttpResult U64Server::get(const routes::Route& route, routes::UrlBuilder& url) const {
+    HttpResult out;
+    std::vector<uint8_t> spare;
+    VecSink sinks[2] = {{&out.body, nullptr, false}, {&spare, nullptr, false}};
+    GetTarget primary{curlWriteToVec, &sinks[0], bindVecSink};
+    GetTarget hedge{curlWriteToVec, &sinks[1], bindVecSink};
+    GetContext ctx{*pool_, headers_.get(), *stats_, retry_, *governor_};
 
-    if (rc != CURLE_OK) {
-        throw std::runtime_error(std::string("HTTP request failed: ") + curl_easy_strerror(rc));
+    int leg = 0;
+    const char* u = url.c_str();
+    const auto t0 = std::chrono::steady_clock::now();
+    auto r = withRetries(retry_, *stats_, route.endpoint, route.idempotent, [&](int) {
+        out.body.clear();
+        spare.clear();
+        sinks[0].sized = sinks[1].sized = false;
+        CURLcode rc;
+        long code;
+        leg = hedgedGet(ctx, route, u, primary, hedge, rc, code);
+        return std::make_pair(rc, code);
+    });
+    if (leg == 1) out.body.swap(spare);
+    capture(route.endpoint, url.view(), false, nullptr, 0, r.first == CURLE_OK ? r.second : 0,
+            out.body.data(), out.body.size(), t0);
+    if (r.first != CURLE_OK) {
+        throw std::runtime_error(std::string("HTTP request failed: ") + curl_easy_strerror(r.first));
     }
-
-    out.body = std::move(response);
+    out.httpCode = r.second;
     return out;
 }
 
 std::vector<uint8_t> U64Server::getVersion() {
-    auto res = request("GET", "/v1/version", {}, nullptr, "");
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kVersion);
+    auto res = get(routes::kVersion, url);
     // Some firmwares may return 401/403 if password required; still means host is reachable.
     if (res.httpCode == 0) {
         throw std::runtime_error("No HTTP response code from /v1/version");
@@ -132,25 +518,75 @@ std::vector<uint8_t> U64Server::getVersion() {
 }
 
 void U64Server::runPRG(const std::vector<uint8_t>& prgBytes) {
-    auto res = request("POST", "/v1/runners:run_prg", {}, &prgBytes, "application/octet-stream");
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kRunPrg);
+    auto res = perform(routes::kRunPrg, url, &prgBytes, true);
     if (res.httpCode < 200 || res.httpCode >= 300) {
         std::string bodyStr(res.body.begin(), res.body.end());
         throw std::runtime_error("runPRG failed HTTP " + std::to_string(res.httpCode) + " body: " + bodyStr);
     }
 }
 
-std::vector<uint8_t> U64Server::peekMemory(uint16_t address, uint32_t length) {
-    std::map<std::string, std::string> params;
-    std::ostringstream a;
-    a << std::hex;
-    a.width(4);
-    a.fill('0');
-    a << address;
+void U64Server::postFile(const std::string& what, const std::string& path,
+                         const std::map<std::string, std::string>& params,
+                         const std::string& file) const {
+    FileSource src(file);
+    auto res = request("POST", path, params, nullptr, "application/octet-stream", &src);
+    if (res.httpCode < 200 || res.httpCode >= 300) {
+        std::string bodyStr(res.body.begin(), res.body.end());
+        throw std::runtime_error(what + " failed HTTP " + std::to_string(res.httpCode) + " body: " + bodyStr);
+    }
+}
+
+void U64Server::postFile(const std::string& what, const routes::Route& route, routes::UrlBuilder& url,
+                         const std::string& file) const {
+    FileSource src(file);
+    auto res = perform(route.method, route.endpoint, url.c_str(), nullptr, "application/octet-stream", &src,
+                       route.idempotent);
+    if (res.httpCode < 200 || res.httpCode >= 300) {
+        std::string bodyStr(res.body.begin(), res.body.end());
+        throw std::runtime_error(what + " failed HTTP " + std::to_string(res.httpCode) + " body: " + bodyStr);
+    }
+}
+
+void U64Server::runPRGFile(const std::string& path) {
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kRunPrg);
+    postFile("runPRG", routes::kRunPrg, url, path);
+}
 
-    params["address"] = a.str();
-    params["length"] = std::to_string(length);
+void U64Server::runCRTFile(const std::string& path) {
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kRunCrt);
+    postFile("runCRT", routes::kRunCrt, url, path);
+}
+
+void U64Server::playSIDFile(const std::string& path, int song) {
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kSidPlay);
+    if (song >= 0) url.param(routes::kSongNr, routes::Dec{static_cast<uint64_t>(song)});
+    postFile("playSID", routes::kSidPlay, url, path);
+}
+
+void U64Server::mountImageFile(const std::string& drive, const std::string& path, const std::string& mode) {
+    size_t dot = path.find_last_of('.');
+    std::string type = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (auto& ch : type) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    if (type != "d64" && type != "g64" && type != "d71" && type != "g71" && type != "d81") {
+        throw std::runtime_error("mount: unsupported image type: " + path);
+    }
+    if (mode != "readwrite" && mode != "readonly" && mode != "unlinked") {
+        throw std::runtime_error("mount: mode must be readwrite, readonly or unlinked");
+    }
+    postFile("mount", "/v1/drives/" + drive + ":mount", {{"type", type}, {"mode", mode}}, path);
+}
+
+std::vector<uint8_t> U64Server::peekMemory(uint16_t address, uint32_t length) {
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kReadMem);
+    url.param(routes::kAddress, routes::Hex4{address}).param(routes::kLength, routes::Dec{length});
 
-    auto res = request("GET", "/v1/machine:readmem", params, nullptr, "");
+    auto res = get(routes::kReadMem, url);
     if (res.httpCode < 200 || res.httpCode >= 300) {
         std::string bodyStr(res.body.begin(), res.body.end());
         throw std::runtime_error("peekMemory failed HTTP " + std::to_string(res.httpCode) + " body: " + bodyStr);
@@ -158,19 +594,262 @@ std::vector<uint8_t> U64Server::peekMemory(uint16_t address, uint32_t length) {
     return res.body;
 }
 
-void U64Server::pokeMemory(uint16_t address, const std::vector<uint8_t>& data) {
-    std::map<std::string, std::string> params;
-    std::ostringstream a;
-    a << std::hex;
-    a.width(4);
-    a.fill('0');
-    a << address;
+void U64Server::peekMemoryInto(uint16_t address, uint8_t* dst, uint32_t length) {
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kReadMem);
+    url.param(routes::kAddress, routes::Hex4{address}).param(routes::kLength, routes::Dec{length});
+
+    // A hedge copy lands in a pooled buffer so the two legs never share dst.
+    BufferPool::Buffer spare;
+    if (retry_.hedge) spare = buffers_->acquire(length);
+    SpanSink sinks[2] = {{dst, length, 0}, {spare.data(), spare.size(), 0}};
+    GetTarget primary{curlWriteToSpan, &sinks[0]};
+    GetTarget hedge;
+    if (retry_.hedge) hedge = GetTarget{curlWriteToSpan, &sinks[1]};
+    GetContext ctx{*pool_, headers_.get(), *stats_, retry_, *governor_};
 
-    params["address"] = a.str();
+    int leg = 0;
+    const char* u = url.c_str();
+    const auto t0 = std::chrono::steady_clock::now();
+    auto r = withRetries(retry_, *stats_, routes::kReadMem.endpoint, true, [&](int) {
+        sinks[0].got = sinks[1].got = 0;
+        CURLcode rc;
+        long code;
+        leg = hedgedGet(ctx, routes::kReadMem, u, primary, hedge, rc, code);
+        return std::make_pair(rc, code);
+    });
+    CURLcode rc = r.first;
+    long code = r.second;
+    bool answered = rc == CURLE_OK || (rc == CURLE_WRITE_ERROR && code >= 300);
+    capture(routes::kReadMem.endpoint, url.view(), false, nullptr, 0, answered ? code : 0,
+            leg == 1 ? spare.data() : dst, sinks[leg].got, t0);
 
-    auto res = request("POST", "/v1/machine:writemem", params, &data, "application/octet-stream");
+    // A body longer than the span aborts the write, which is also an error.
+    if (!answered) {
+        throw std::runtime_error(std::string("HTTP request failed: ") + curl_easy_strerror(rc));
+    }
+    if (code < 200 || code >= 300) {
+        throw std::runtime_error("peekMemory failed HTTP " + std::to_string(code));
+    }
+    const SpanSink& sink = sinks[leg];
+    if (sink.got != length) {
+        throw std::runtime_error("peekMemory: short read " + std::to_string(sink.got) + "/" + std::to_string(length));
+    }
+    if (leg == 1) std::memcpy(dst, spare.data(), length);
+}
+
+BufferPool::Buffer U64Server::peekMemoryPooled(uint16_t address, uint32_t length) {
+    BufferPool::Buffer buf = buffers_->acquire(length);
+    peekMemoryInto(address, buf.data(), length);
+    return buf;
+}
+
+void U64Server::pokeMemory(uint16_t address, const std::vector<uint8_t>& data) {
+    requireAddress();
+    routes::UrlBuilder url(creds_.address, routes::kWriteMem);
+    url.param(routes::kAddress, routes::Hex4{address});
+
+    auto res = perform(routes::kWriteMem, url, &data, true);
     if (res.httpCode < 200 || res.httpCode >= 300) {
         std::string bodyStr(res.body.begin(), res.body.end());
         throw std::runtime_error("pokeMemory failed HTTP " + std::to_string(res.httpCode) + " body: " + bodyStr);
     }
 }
+
+std::vector<uint8_t> U64Server::peekMemoryBulk(uint16_t address, uint32_t length, const BulkReadOptions& opts) {
+    if (static_cast<uint32_t>(address) + length > 0x10000) {
+        throw std::runtime_error("peekMemoryBulk: range exceeds 64 KB address space");
+    }
+    requireAddress();
+
+    std::vector<uint8_t> out(length);
+    if (length == 0) return out;
+
+    const uint32_t chunkSize = opts.chunkSize ? opts.chunkSize : length;
+    const size_t maxInFlight = opts.maxInFlight > 0 ? static_cast<size_t>(opts.maxInFlight) : 1;
+
+    struct Chunk {
+        uint32_t offset = 0;
+        uint32_t len = 0;
+        int attempts = 0;
+        std::string url;
+        SpanSink sink;
+        CURL* curl = nullptr;
+        std::string lastError;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point retryAt; // backoff before the next attempt
+    };
+
+    std::vector<Chunk> chunks;
+    for (uint32_t off = 0; off < length; off += chunkSize) {
+        Chunk c;
+        c.offset = off;
+        c.len = std::min(chunkSize, length - off);
+        routes::UrlBuilder url(creds_.address, routes::kReadMem);
+        url.param(routes::kAddress, routes::Hex4{static_cast<uint16_t>(address + off)})
+           .param(routes::kLength, routes::Dec{c.len});
+        c.url = url.view();
+        chunks.push_back(std::move(c));
+    }
+
+    struct MultiGuard {
+        CURLM* multi;
+        CurlPool& pool;
+        ConcurrencyGovernor& governor;
+        std::vector<Chunk>& chunks;
+        ~MultiGuard() {
+            for (auto& c : chunks) {
+                if (!c.curl) continue;
+                governor.release(0, ConcurrencyGovernor::Outcome::Ignored);
+                curl_multi_remove_handle(multi, c.curl);
+                pool.release(c.curl);
+                c.curl = nullptr;
+            }
+            curl_multi_cleanup(multi);
+        }
+    };
+
+    CURLM* multi = curl_multi_init();
+    if (!multi) throw std::runtime_error("curl_multi_init failed");
+    MultiGuard guard{multi, *pool_, *governor_, chunks};
+
+    std::deque<size_t> todo;
+    for (size_t i = 0; i < chunks.size(); ++i) todo.push_back(i);
+    std::vector<size_t> backingOff; // failed chunks waiting for their retryAt
+    size_t inFlight = 0;
+    std::vector<size_t> failed;
+
+    auto start = [&](size_t i) {
+        Chunk& c = chunks[i];
+        c.attempts++;
+        if (c.attempts == 1) c.started = std::chrono::steady_clock::now();
+        c.sink = SpanSink{out.data() + c.offset, c.len, 0};
+        c.curl = pool_->acquire();
+        curl_easy_setopt(c.curl, CURLOPT_URL, c.url.c_str());
+        curl_easy_setopt(c.curl, CURLOPT_HTTPHEADER, headers_.get());
+        curl_easy_setopt(c.curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(c.curl, CURLOPT_TIMEOUT_MS, static_cast<long>(retry_.timeoutMs));
+        curl_easy_setopt(c.curl, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(retry_.connectTimeoutMs));
+        curl_easy_setopt(c.curl, CURLOPT_WRITEFUNCTION, curlWriteToSpan);
+        curl_easy_setopt(c.curl, CURLOPT_WRITEDATA, &c.sink);
+        curl_easy_setopt(c.curl, CURLOPT_PRIVATE, reinterpret_cast<char*>(i));
+        curl_multi_add_handle(multi, c.curl);
+        inFlight++;
+    };
+
+    // Each chunk in flight holds a governor slot. Slots beyond the first are
+    // only taken when free, so a bulk read shrinks to what the device's
+    // limit leaves over instead of queueing ahead of other requests.
+    ConcurrencyGovernor::Scope scope(RequestPriority::Bulk);
+    const RequestPriority prio = ConcurrencyGovernor::current();
+
+    while (!todo.empty() || !backingOff.empty() || inFlight > 0) {
+        // Chunks whose backoff has run out go back in line.
+        auto now = std::chrono::steady_clock::now();
+        auto nextRetry = std::chrono::steady_clock::time_point::max();
+        for (size_t k = 0; k < backingOff.size();) {
+            size_t i = backingOff[k];
+            if (chunks[i].retryAt <= now) {
+                todo.push_back(i);
+                backingOff[k] = backingOff.back();
+                backingOff.pop_back();
+            } else {
+                nextRetry = std::min(nextRetry, chunks[i].retryAt);
+                ++k;
+            }
+        }
+        if (todo.empty() && inFlight == 0) {
+            std::this_thread::sleep_until(nextRetry);
+            continue;
+        }
+
+        bool throttled = false;
+        while (inFlight < maxInFlight && !todo.empty()) {
+            if (inFlight == 0) {
+                governor_->acquire(prio);
+            } else if (!governor_->tryAcquire(prio)) {
+                throttled = true;
+                break;
+            }
+            start(todo.front());
+            todo.pop_front();
+        }
+
+        int running = 0;
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            throw std::runtime_error("peekMemoryBulk: curl_multi_perform failed");
+        }
+
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            char* priv = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+            size_t i = reinterpret_cast<size_t>(priv);
+            Chunk& c = chunks[i];
+
+            const CURLcode result = msg->data.result; // msg dies with the handle's removal
+            long code = 0;
+            curl_easy_getinfo(c.curl, CURLINFO_RESPONSE_CODE, &code);
+            recordCurlTransfer(*stats_, c.curl, routes::kReadMem.endpoint, result, code);
+            double rttMs;
+            ConcurrencyGovernor::Outcome outcome = transferOutcome(c.curl, result, code, true, rttMs);
+            FailureKind kind = classifyFailure(result, code);
+            if (result != CURLE_OK) {
+                c.lastError = curl_easy_strerror(result);
+            } else if (code < 200 || code >= 300) {
+                c.lastError = "HTTP " + std::to_string(code);
+            } else if (c.sink.got != c.len) {
+                c.lastError = "short read " + std::to_string(c.sink.got) + "/" + std::to_string(c.len);
+                kind = FailureKind::Dropped; // body cut short, like CURLE_PARTIAL_FILE
+            } else {
+                c.lastError.clear();
+            }
+            const bool retry = !c.lastError.empty() && c.attempts <= opts.maxRetries &&
+                               retry_.shouldRetry(kind, routes::kReadMem.idempotent);
+
+            curl_multi_remove_handle(multi, c.curl);
+            pool_->release(c.curl);
+            c.curl = nullptr;
+            governor_->release(rttMs, outcome);
+            inFlight--;
+
+            // One trace record per chunk, with the answer that settled it.
+            if (!retry) {
+                capture(routes::kReadMem.endpoint, c.url, false, nullptr, 0,
+                        result == CURLE_OK ? code : 0, out.data() + c.offset, c.sink.got, c.started);
+            }
+            if (c.lastError.empty()) continue;
+            if (retry) {
+                stats_->recordRetry(routes::kReadMem.endpoint, failureName(kind));
+                c.retryAt = std::chrono::steady_clock::now() +
+                            std::chrono::milliseconds(retry_.backoffMs(c.attempts + 1));
+                backingOff.push_back(i);
+                nextRetry = std::min(nextRetry, c.retryAt);
+            } else {
+                failed.push_back(i);
+            }
+        }
+
+        // Only block when no slot can be refilled right now, and no longer
+        // than the next backoff has to run.
+        if (inFlight > 0 && (todo.empty() || inFlight >= maxInFlight || throttled)) {
+            int waitMs = 100;
+            if (!backingOff.empty()) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    nextRetry - std::chrono::steady_clock::now()).count();
+                waitMs = static_cast<int>(std::max<long long>(0, std::min<long long>(waitMs, left)));
+            }
+            curl_multi_poll(multi, nullptr, 0, waitMs, nullptr);
+        }
+    }
+
+    if (!failed.empty()) {
+        const Chunk& c = chunks[failed.front()];
+        char at[4];
+        routes::formatHex4(at, static_cast<uint16_t>(address + c.offset));
+        throw std::runtime_error("peekMemoryBulk failed at $" + std::string(at, 4) +
+                                 " (" + std::to_string(failed.size()) + " chunk(s)): " + c.lastError);
+    }
+    return out;
+}
@@ -1,8 +1,22 @@
 #pragma once
+#include "buffer_pool.h"
+#include "concurrency_governor.h"
+#include "retry_policy.h"
+
+#include <chrono>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <memory>
+
+class CurlPool;
+class FileSource;
+namespace routes { struct Route; class UrlBuilder; }
+class RequestStats;
+namespace trace { class Writer; }
+struct curl_slist;
 
 class U64Server {
 public:
@@ -12,7 +26,35 @@ public:
         bool enableMessageBox = false; // parity field; Linux no-op
     };
 
+    // Does not touch the network; call getVersion() to check connectivity.
     explicit U64Server(Creds creds);
+    ~U64Server();
+
+    U64Server(U64Server&&) noexcept;
+    U64Server& operator=(U64Server&&) noexcept;
+
+    const Creds& creds() const { return creds_; }
+
+    // Timings, byte counts and status codes of every request to this device.
+    RequestStats& stats() const { return *stats_; }
+
+    // Retries, backoff, timeouts and hedging of the blocking calls.
+    // Set before requests are in flight; not synchronised with them.
+    void setRetryPolicy(const RetryPolicy& policy) { retry_ = policy; }
+    const RetryPolicy& retryPolicy() const { return retry_; }
+
+    // Adaptive limit on the requests in flight to this device, shared by
+    // the blocking calls, bulk reads and U64AsyncClient. Requests wait
+    // their turn by the calling thread's priority (ConcurrencyGovernor::
+    // Scope). Unlike the retry policy this may change at any time.
+    void setConcurrency(const ConcurrencyGovernor::Options& opts) { governor_->configure(opts); }
+    ConcurrencyGovernor& governor() const { return *governor_; }
+
+    // Capture mode: while set, every request and its response and timing
+    // is appended to the trace (see trace.h), for u64-replay. A call that
+    // was retried or hedged is one record. nullptr stops capturing. Set
+    // before requests are in flight.
+    void setCapture(std::shared_ptr<trace::Writer> writer) { capture_ = std::move(writer); }
 
     // GET /v1/version (connectivity check)
     std::vector<uint8_t> getVersion();
@@ -20,15 +62,74 @@ public:
     // POST /v1/runners:run_prg (raw .prg bytes)
     void runPRG(const std::vector<uint8_t>& prgBytes);
 
+    // The *File variants stream the file from disk (memory-mapped or read
+    // incrementally) instead of loading it into memory first.
+
+    // POST /v1/runners:run_prg
+    void runPRGFile(const std::string& path);
+
+    // POST /v1/runners:run_crt (cartridge image)
+    void runCRTFile(const std::string& path);
+
+    // POST /v1/runners:sidplay?songnr=... (song < 0 plays the default tune)
+    void playSIDFile(const std::string& path, int song = -1);
+
+    // POST /v1/drives/<drive>:mount?type=...&mode=...
+    // The image type (d64, g64, d71, g71, d81) comes from the file extension;
+    // mode is readwrite, readonly or unlinked.
+    void mountImageFile(const std::string& drive, const std::string& path,
+                        const std::string& mode = "readwrite");
+
     // GET /v1/machine:readmem?address=....&length=...
     std::vector<uint8_t> peekMemory(uint16_t address, uint32_t length);
 
+    // Allocation-free variants of peekMemory for polling loops: read into a
+    // caller-owned span of exactly length bytes, or into a buffer recycled
+    // through this server's pool. Both throw on HTTP errors and short reads.
+    void peekMemoryInto(uint16_t address, uint8_t* dst, uint32_t length);
+    BufferPool::Buffer peekMemoryPooled(uint16_t address, uint32_t length);
+
+    // Pool that backs peekMemoryPooled; callers may draw scratch space from it.
+    BufferPool& buffers() const { return *buffers_; }
+
     // POST /v1/machine:writemem?address=....
     void pokeMemory(uint16_t address, const std::vector<uint8_t>& data);
 
+    struct BulkReadOptions {
+        uint32_t chunkSize = 4096; // bytes per machine:readmem request
+        int maxInFlight = 4;       // requests kept in flight at once
+        int maxRetries = 2;        // extra attempts per failed chunk
+    };
+
+    // Reads [address, address+length) as several pipelined readmem requests
+    // over pooled connections and returns one contiguous buffer. Each request
+    // gets retry_'s timeouts; only the chunks that fail in a way retry_
+    // retries are sent again, after its backoff and at most maxRetries
+    // times. address + length must not exceed 64 KB.
+    std::vector<uint8_t> peekMemoryBulk(uint16_t address, uint32_t length, const BulkReadOptions& opts);
+    std::vector<uint8_t> peekMemoryBulk(uint16_t address, uint32_t length) {
+        return peekMemoryBulk(address, length, BulkReadOptions());
+    }
+
 private:
+    friend class U64AsyncClient; // drives requests on its own event loop
+
     Creds creds_;
 
+    // Keep-alive handles shared by every request to this device.
+    std::unique_ptr<CurlPool> pool_;
+    std::shared_ptr<RequestStats> stats_;
+    std::unique_ptr<BufferPool> buffers_;
+    std::unique_ptr<ConcurrencyGovernor> governor_;
+    std::shared_ptr<trace::Writer> capture_;
+    RetryPolicy retry_;
+
+    // Header lists built once per server instead of once per request.
+    struct SlistDeleter { void operator()(curl_slist* l) const; };
+    using Slist = std::unique_ptr<curl_slist, SlistDeleter>;
+    Slist headers_;       // X-Password
+    Slist headersOctet_;  // X-Password + application/octet-stream
+
     struct HttpResult {
         long httpCode = 0;
         std::vector<uint8_t> body;
@@ -39,9 +140,42 @@ private:
         const std::string& path,
         const std::map<std::string, std::string>& params,
         const std::vector<uint8_t>* body,
-        const std::string& contentType
+        const std::string& contentType,
+        FileSource* upload = nullptr
     ) const;
 
+    // request() minus URL building: the URL is ready and endpoint is the
+    // "<method> <path>" stats key. Failed attempts are retried per retry_.
+    HttpResult perform(
+        const char* method,
+        std::string_view endpoint,
+        const char* url,
+        const std::vector<uint8_t>* body,
+        std::string_view contentType,
+        FileSource* upload,
+        bool idempotent
+    ) const;
+    HttpResult perform(const routes::Route& route, routes::UrlBuilder& url,
+                       const std::vector<uint8_t>* body, bool octet) const;
+
+    // Idempotent GET, hedged when retry_ asks for it.
+    HttpResult get(const routes::Route& route, routes::UrlBuilder& url) const;
+
+    void requireAddress() const;
+
+    // Appends one exchange to capture_, if set. url is the full URL sent.
+    void capture(std::string_view endpoint, std::string_view url, bool octet,
+                 const uint8_t* body, size_t bodyLength, long status,
+                 const uint8_t* response, size_t responseLength,
+                 std::chrono::steady_clock::time_point start) const;
+
+    // POSTs a file as an octet-stream body; throws on a non-2xx answer.
+    void postFile(const std::string& what, const std::string& path,
+                  const std::map<std::string, std::string>& params,
+                  const std::string& file) const;
+    void postFile(const std::string& what, const routes::Route& route, routes::UrlBuilder& url,
+                  const std::string& file) const;
+
     std::string buildUrl(
         const std::string& path,
         const std::map<std::string, std::string>& params
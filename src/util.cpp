@@ -1,13 +1,13 @@
 #include "util.h"
 #include "u64_server.h"
 #include "discovery.h"
+#include "subnet_scan.h"
 
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
 #include <cstring>
-#include <filesystem>
 
 // ---------------------
 // readFileBytes
@@ -61,47 +61,62 @@ util::Creds util::loadCreds(const std::string& path) {
 }
 
 // ---------------------
-// Cache
+// parseNumber
 // ---------------------
-static std::string escapeJson(const std::string& s) {
-    std::string out;
-    for (char c : s) {
-        if (c == '"' || c == '\\') out += '\\';
-        out += c;
-    }
-    return out;
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
 }
 
-void util::writeCache(const std::string& path, const std::string& address, const std::string& hostname) {
-    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
-    std::ofstream f(path);
-    if (!f) return;
-    f << "{\n";
-    f << "  \"address\": \"" << escapeJson(address) << "\",\n";
-    f << "  \"hostname\": \"" << escapeJson(hostname) << "\"\n";
-    f << "}\n";
+uint32_t util::parseNumber(const std::string& s) {
+    size_t i = 0;
+    int base = 10;
+    if (!s.empty() && s[0] == '$') { base = 16; i = 1; }
+    else if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) { base = 16; i = 2; }
+    if (i >= s.size()) throw std::runtime_error("Invalid number: '" + s + "'");
+
+    uint64_t v = 0;
+    for (; i < s.size(); ++i) {
+        int d = hexDigit(s[i]);
+        if (d < 0 || d >= base) {
+            throw std::runtime_error("Invalid number: '" + s + "' (use $ or 0x for hex)");
+        }
+        v = v * base + d;
+        if (v > 0xFFFFFFFFull) throw std::runtime_error("Number out of range: " + s);
+    }
+    return static_cast<uint32_t>(v);
 }
 
-bool util::readCache(const std::string& path, std::string& address, std::string& hostname) {
-    std::ifstream f(path);
-    if (!f) return false;
-    std::string content((std::istreambuf_iterator<char>(f)), {});
-    auto findVal = [&](const std::string& key) -> std::string {
-        auto p = content.find("\"" + key + "\"");
-        if (p == std::string::npos) return "";
-        p = content.find(":", p);
-        if (p == std::string::npos) return "";
-        p = content.find("\"", p);
-        if (p == std::string::npos) return "";
-        auto end = content.find("\"", p + 1);
-        if (end == std::string::npos) return "";
-        return content.substr(p + 1, end - (p + 1));
-    };
-    address = findVal("address");
-    hostname = findVal("hostname");
-    return !address.empty();
+std::string util::escapeJson(const std::string& s) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        unsigned char u = static_cast<unsigned char>(c);
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (u < 0x20) {
+                out += "\\u00";
+                out += kHex[u >> 4];
+                out += kHex[u & 0xF];
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out;
 }
 
+// ---------------------
+// validateDevice
+// ---------------------
 bool util::validateDevice(const std::string& address) {
     try {
         U64Server::Creds c;
@@ -118,9 +133,11 @@ bool util::validateDevice(const std::string& address) {
 // ---------------------
 // discoverU64
 // ---------------------
-std::vector<DiscoveredService> util::discoverU64(int timeoutMs, int /*maxHostsPerIface*/) {
-    // Current discovery method uses mDNS/Avahi browsing & resolving.
-    // maxHostsPerIface is preserved for API compatibility for potential future expansion.
-    DiscoveryService d;
-    return d.discoverMDNS(timeoutMs);
+std::vector<DiscoveredService> util::discoverU64(int timeoutMs, int maxHostsPerIface) {
+    // Subnet scan for networks where mDNS is blocked: every host of each
+    // local IPv4 subnet is connected to at once, then confirmed via /v1/version.
+    ScanOptions opts;
+    opts.connectTimeoutMs = timeoutMs;
+    SubnetScanner scanner(opts);
+    return scanner.scan(maxHostsPerIface > 0 ? static_cast<size_t>(maxHostsPerIface) : 0);
 }
@@ -22,9 +22,15 @@ Creds loadCreds(const std::string& path);
 std::vector<DiscoveredService> discoverU64(int timeoutMs, int maxHostsPerIface);
 int promptPickIndex(const std::vector<DiscoveredService>& devs);
 
-// Cache
-void writeCache(const std::string& path, const std::string& address, const std::string& hostname);
-bool readCache(const std::string& path, std::string& address, std::string& hostname);
+// Numbers from the command line: $C000, 0xC000 or decimal. Byte strings
+// go through hex::decode.
+uint32_t parseNumber(const std::string& s);
+
+// Escapes a string for a JSON string literal: quotes, backslashes and
+// control characters (\n, \r, \t, else \u00XX).
+std::string escapeJson(const std::string& s);
+
+// True if GET /v1/version answers (the discovery cache lives in device_cache.h)
 bool validateDevice(const std::string& address);
 
 } // namespace util
@@ -0,0 +1,268 @@
+#include "version_probe.h"
+#include "curl_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+static size_t curlWriteToString(void* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t n = size * nmemb;
+    auto* s = static_cast<std::string*>(userdata);
+    // Version replies are tiny; anything large is not an Ultimate.
+    if (s->size() + n > 4096) return 0;
+    s->append(static_cast<const char*>(ptr), n);
+    return n;
+}
+
+static std::string jsonStringField(const std::string& j, const std::string& key) {
+    auto pos = j.find("\"" + key + "\"");
+    if (pos == std::string::npos) return "";
+    pos = j.find(':', pos);
+    if (pos == std::string::npos) return "";
+    pos = j.find('"', pos);
+    if (pos == std::string::npos) return "";
+    auto end = j.find('"', pos + 1);
+    if (end == std::string::npos) return "";
+    return j.substr(pos + 1, end - pos - 1);
+}
+
+// Notes an HTTP auth challenge, which Ultimates never send.
+static size_t curlProbeHeader(char* buf, size_t size, size_t nitems, void* userdata) {
+    size_t n = size * nitems;
+    static const char kChallenge[] = "www-authenticate:";
+    const size_t len = sizeof(kChallenge) - 1;
+    if (n >= len && std::equal(buf, buf + len, kChallenge,
+                               [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; })) {
+        static_cast<util::VersionProbe*>(userdata)->authChallenge = true;
+    }
+    return n;
+}
+
+// 2xx with a version field, or a password rejection: protected Ultimates
+// answer 403 without a challenge. 401 and challenged 403s come from routers,
+// NAS boxes and printers with HTTP auth.
+static void classify(util::VersionProbe& p) {
+    p.version = jsonStringField(p.body, "version");
+    bool ok2xx = p.httpCode >= 200 && p.httpCode < 300 && !p.version.empty();
+    p.isUltimate = ok2xx || (p.httpCode == 403 && !p.authChallenge);
+}
+
+static std::string versionUrl(const std::string& baseUrl) {
+    std::string base = baseUrl;
+    if (!base.empty() && base.back() == '/') base.pop_back();
+    return base + "/v1/version";
+}
+
+// One GET of url into p.body; the probe is the handle's private pointer.
+static CURL* newProbeHandle(const std::string& url, curl_slist* headers, util::VersionProbe& p, int timeoutMs) {
+    CURL* e = curl_easy_init();
+    if (!e) return nullptr;
+    curl_easy_setopt(e, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(e, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(e, CURLOPT_WRITEFUNCTION, curlWriteToString);
+    curl_easy_setopt(e, CURLOPT_WRITEDATA, &p.body);
+    curl_easy_setopt(e, CURLOPT_HEADERFUNCTION, curlProbeHeader);
+    curl_easy_setopt(e, CURLOPT_HEADERDATA, &p);
+    curl_easy_setopt(e, CURLOPT_TIMEOUT_MS, static_cast<long>(timeoutMs));
+    curl_easy_setopt(e, CURLOPT_CONNECTTIMEOUT_MS, static_cast<long>(timeoutMs));
+    curl_easy_setopt(e, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(e, CURLOPT_PRIVATE, reinterpret_cast<char*>(&p));
+    return e;
+}
+
+// Fills in the probe of a finished handle.
+static util::VersionProbe& finishProbe(CURLMsg* msg) {
+    char* priv = nullptr;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    auto* p = reinterpret_cast<util::VersionProbe*>(priv);
+    if (msg->data.result == CURLE_OK) {
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &p->httpCode);
+        curl_off_t us = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_TOTAL_TIME_T, &us);
+        p->rttMs = static_cast<double>(us) / 1000.0;
+    }
+    classify(*p);
+    return *p;
+}
+
+std::vector<util::VersionProbe> util::probeVersions(
+    const std::vector<std::string>& baseUrls,
+    int timeoutMs,
+    const std::string& password)
+{
+    return probeVersions(baseUrls, timeoutMs, password, nullptr, nullptr);
+}
+
+std::vector<util::VersionProbe> util::probeVersions(
+    const std::vector<std::string>& baseUrls,
+    int timeoutMs,
+    const std::string& password,
+    const ProbeCallback& onResult,
+    const std::atomic<bool>* cancel)
+{
+    std::vector<VersionProbe> out(baseUrls.size());
+    if (baseUrls.empty()) return out;
+
+    ensureCurlGlobalInit();
+
+    struct MultiDeleter { void operator()(CURLM* m) const { curl_multi_cleanup(m); } };
+    std::unique_ptr<CURLM, MultiDeleter> multi(curl_multi_init());
+    if (!multi) return out;
+
+    std::string pw = "X-Password: " + password;
+    curl_slist* headers = curl_slist_append(nullptr, pw.c_str());
+
+    std::vector<CURL*> easies(baseUrls.size(), nullptr);
+    std::vector<std::string> urls(baseUrls.size());
+
+    for (size_t i = 0; i < baseUrls.size(); ++i) {
+        out[i].baseUrl = baseUrls[i];
+        urls[i] = versionUrl(baseUrls[i]);
+        CURL* e = newProbeHandle(urls[i], headers, out[i], timeoutMs);
+        if (!e) continue;
+        curl_multi_add_handle(multi.get(), e);
+        easies[i] = e;
+    }
+
+    // With a cancel flag, wake up often enough to notice it.
+    const int pollMs = cancel ? 20 : 100;
+    bool stop = false;
+    int running = 0;
+    do {
+        if (curl_multi_perform(multi.get(), &running) != CURLM_OK) break;
+        if (running) curl_multi_poll(multi.get(), nullptr, 0, pollMs, nullptr);
+
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi.get(), &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            const VersionProbe& p = finishProbe(msg);
+            if (onResult && !onResult(p)) stop = true;
+        }
+        if (cancel && cancel->load()) stop = true;
+    } while (running && !stop);
+
+    for (CURL* e : easies) {
+        if (!e) continue;
+        curl_multi_remove_handle(multi.get(), e);
+        curl_easy_cleanup(e);
+    }
+    curl_slist_free_all(headers);
+
+    return out;
+}
+
+// ---------------------
+// VersionProber
+// ---------------------
+struct util::VersionProber::Job {
+    VersionProbe probe;
+    std::string url;
+    int timeoutMs = 0;
+    CURL* easy = nullptr;
+};
+
+util::VersionProber::VersionProber(std::string password, std::function<void()> onFinished)
+    : header_("X-Password: " + password), onFinished_(std::move(onFinished)) {
+    ensureCurlGlobalInit();
+    multi_ = curl_multi_init();
+    if (!multi_) throw std::runtime_error("curl_multi_init failed");
+    thread_ = std::thread([this] { loop(); });
+}
+
+util::VersionProber::~VersionProber() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    curl_multi_wakeup(static_cast<CURLM*>(multi_));
+    thread_.join();
+    curl_multi_cleanup(static_cast<CURLM*>(multi_));
+}
+
+void util::VersionProber::add(const std::string& baseUrl, int timeoutMs) {
+    auto job = std::make_unique<Job>();
+    job->probe.baseUrl = baseUrl;
+    job->url = versionUrl(baseUrl);
+    job->timeoutMs = timeoutMs;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        added_.push_back(std::move(job));
+        pending_++;
+    }
+    curl_multi_wakeup(static_cast<CURLM*>(multi_));
+}
+
+std::vector<util::VersionProbe> util::VersionProber::take() {
+    std::lock_guard<std::mutex> lk(mu_);
+    std::vector<VersionProbe> out;
+    out.swap(finished_);
+    pending_ -= out.size();
+    return out;
+}
+
+size_t util::VersionProber::pending() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return pending_;
+}
+
+bool util::VersionProber::wait(int timeoutMs) {
+    std::unique_lock<std::mutex> lk(mu_);
+    return cv_.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&] { return !finished_.empty(); });
+}
+
+void util::VersionProber::loop() {
+    CURLM* multi = static_cast<CURLM*>(multi_);
+    curl_slist* headers = curl_slist_append(nullptr, header_.c_str());
+    std::vector<std::unique_ptr<Job>> running;
+
+    for (;;) {
+        bool any = false;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            if (stop_) break;
+            for (auto& job : added_) {
+                job->easy = newProbeHandle(job->url, headers, job->probe, job->timeoutMs);
+                if (job->easy) {
+                    curl_multi_add_handle(multi, job->easy);
+                    running.push_back(std::move(job));
+                } else {
+                    classify(job->probe);
+                    finished_.push_back(std::move(job->probe));
+                    any = true;
+                }
+            }
+            added_.clear();
+        }
+
+        int still = 0;
+        curl_multi_perform(multi, &still);
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* e = msg->easy_handle;
+            VersionProbe& p = finishProbe(msg);
+            curl_multi_remove_handle(multi, e);
+            curl_easy_cleanup(e);
+            auto it = std::find_if(running.begin(), running.end(),
+                                   [&](const std::unique_ptr<Job>& j) { return j->easy == e; });
+            std::lock_guard<std::mutex> lk(mu_);
+            finished_.push_back(std::move(p));
+            running.erase(it);
+            any = true;
+        }
+        if (any) {
+            cv_.notify_all();
+            if (onFinished_) onFinished_();
+        }
+        // add() and the destructor wake this up.
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+
+    for (auto& job : running) {
+        curl_multi_remove_handle(multi, job->easy);
+        curl_easy_cleanup(job->easy);
+    }
+    curl_slist_free_all(headers);
+}
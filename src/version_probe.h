@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace util {
+
+struct VersionProbe {
+    std::string baseUrl;   // e.g. http://10.0.0.183
+    long httpCode = 0;     // 0 = no HTTP response
+    std::string body;
+    std::string version;   // "version" field of the JSON reply, if any
+    double rttMs = 0;
+    bool authChallenge = false; // WWW-Authenticate in the reply
+    bool isUltimate = false;
+};
+
+// GET /v1/version on every base URL concurrently (one curl multi loop).
+// The whole batch is bounded by timeoutMs, not by the sum of the probes.
+std::vector<VersionProbe> probeVersions(
+    const std::vector<std::string>& baseUrls,
+    int timeoutMs,
+    const std::string& password = "");
+
+// Called as each probe finishes; returning false abandons the rest.
+using ProbeCallback = std::function<bool(const VersionProbe&)>;
+
+// Same, reporting probes as they complete. Setting *cancel from another
+// thread also abandons the batch; unfinished probes keep httpCode 0.
+std::vector<VersionProbe> probeVersions(
+    const std::vector<std::string>& baseUrls,
+    int timeoutMs,
+    const std::string& password,
+    const ProbeCallback& onResult,
+    const std::atomic<bool>* cancel = nullptr);
+
+// Probes added one at a time, as candidates turn up, each with its own
+// deadline from when it is added. One background curl multi loop runs
+// them all at once, so a batch takes as long as its slowest probe.
+class VersionProber {
+public:
+    // onFinished runs on the prober's thread after each probe; it may wake
+    // the caller's loop but must not call back into the prober.
+    explicit VersionProber(std::string password = "", std::function<void()> onFinished = nullptr);
+    ~VersionProber(); // abandons unfinished probes
+
+    VersionProber(const VersionProber&) = delete;
+    VersionProber& operator=(const VersionProber&) = delete;
+
+    void add(const std::string& baseUrl, int timeoutMs);
+
+    // Probes finished since the last call.
+    std::vector<VersionProbe> take();
+
+    size_t pending() const; // added, not yet taken
+
+    // Waits up to timeoutMs for a probe to finish; false if none did.
+    bool wait(int timeoutMs);
+
+private:
+    struct Job;
+    void loop();
+
+    std::string header_;
+    std::function<void()> onFinished_;
+    void* multi_ = nullptr;  // CURLM*, touched by loop() only after construction
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::vector<std::unique_ptr<Job>> added_;     // waiting for the loop
+    std::vector<VersionProbe> finished_;
+    size_t pending_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace util